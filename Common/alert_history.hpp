@@ -0,0 +1,435 @@
+/*
+  Historique des alertes overpower (JSON Lines) + index temporel
+
+  - AlertHistoryWriter : fichier ouvert en continu, ajout par lots (group
+    commit : un write() et au plus un fsync par lot), rotation par taille
+    et/ou par âge du segment.
+  - Chaque segment "x.jsonl" a un index "x.jsonl.idx" : une entrée binaire
+    de 24 octets par ligne (t_ms, offset, longueur, hash de la machine).
+  - history_query() : alertes d'un intervalle de temps (et d'une machine)
+    en lisant les index puis seulement les lignes retenues.
+
+  Segments archivés : "<stem>.<AAAAMMJJ-HHMMSS><ext>" (date de début), le
+  segment actif garde le nom history_path (compatible avec l'ancien fichier).
+*/
+
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace alert_history {
+
+using nlohmann::json;
+namespace fs = std::filesystem;
+
+struct IndexEntry {
+  int64_t  t_ms;      // epoch, millisecondes
+  uint64_t offset;    // début de la ligne dans le segment
+  uint32_t len;       // longueur, '\n' compris
+  uint32_t machine;   // fnv1a(machine), filtrage rapide
+};
+static_assert(sizeof(IndexEntry) == 24, "format d'index sur disque");
+
+inline uint32_t machine_hash(const std::string &m) {
+  uint32_t h = 2166136261u;
+  for (unsigned char c : m) { h ^= c; h *= 16777619u; }
+  return h;
+}
+
+inline int64_t now_ms() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// "AAAA-MM-JJTHH:MM:SS[.fff][Z|±HH[:]MM]" (ou espace à la place du T) -> epoch ms.
+// Sans fuseau : heure locale (comme now_iso_local d'overpower_email). -1 si illisible.
+inline int64_t parse_iso_ms(const std::string &s) {
+  std::tm tm{};
+  int frac_len = 0;
+  long frac = 0;
+  char sep = 0;
+  int consumed = 0;
+  if (std::sscanf(s.c_str(), "%4d-%2d-%2d%c%2d:%2d:%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                  &sep, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &consumed) != 7 ||
+      (sep != 'T' && sep != ' '))
+    return -1;
+  size_t pos = (size_t)consumed;
+  if (pos < s.size() && (s[pos] == '.' || s[pos] == ',')) {
+    for (++pos; pos < s.size() && std::isdigit((unsigned char)s[pos]); ++pos)
+      if (frac_len < 3) { frac = frac * 10 + (s[pos] - '0'); ++frac_len; }
+  }
+  for (; frac_len < 3; ++frac_len) frac *= 10;
+  tm.tm_year -= 1900;
+  tm.tm_mon  -= 1;
+
+  int64_t t_s;
+  if (pos < s.size() && (s[pos] == 'Z' || s[pos] == 'z')) {
+    t_s = (int64_t)timegm(&tm);
+  } else if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) {
+    int hh = 0, mm = 0;
+    const char *z = s.c_str() + pos + 1;
+    if (std::sscanf(z, "%2d:%2d", &hh, &mm) != 2 && std::sscanf(z, "%2d%2d", &hh, &mm) < 1) return -1;
+    const int64_t off = (int64_t)(hh * 3600 + mm * 60) * (s[pos] == '+' ? 1 : -1);
+    t_s = (int64_t)timegm(&tm) - off;
+  } else {
+    tm.tm_isdst = -1;
+    t_s = (int64_t)std::mktime(&tm);
+  }
+  return t_s * 1000 + frac;
+}
+
+// Instant d'une ligne d'historique : t_ms, sinon le champ timestamp des lignes
+// écrites avant l'index (chaîne ISO ou {"$date": ...}). -1 si aucun.
+inline int64_t record_time_ms(const json &j) {
+  if (!j.is_object()) return -1;
+  auto it = j.find("t_ms");
+  if (it != j.end() && it->is_number()) return it->get<int64_t>();
+  it = j.find("timestamp");
+  if (it == j.end()) return -1;
+  const json *ts = &*it;
+  if (ts->is_object() && ts->contains("$date")) ts = &(*ts)["$date"];
+  if (ts->is_string()) return parse_iso_ms(ts->get<std::string>());
+  if (ts->is_number()) return ts->get<int64_t>();
+  if (ts->is_object() && ts->contains("$numberLong") && (*ts)["$numberLong"].is_string()) {
+    try { return std::stoll((*ts)["$numberLong"].get<std::string>()); } catch (...) {}
+  }
+  return -1;
+}
+
+// Nom d'un segment archivé : "<stem>.AAAAMMJJ-HHMMSS[-k]<ext>" exactement (k : rotations
+// dans la même seconde). Renvoie la clé de tri (horodatage, k) ; tout autre fichier
+// du dossier (index .idx, fichier sans rapport) est refusé.
+inline bool parse_segment_name(const std::string &name, const std::string &stem, const std::string &ext,
+                               std::string &stamp, long &k) {
+  if (name.size() < stem.size() + 15 + ext.size() || name.compare(0, stem.size(), stem) != 0 ||
+      name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+    return false;
+  const std::string mid = name.substr(stem.size(), name.size() - stem.size() - ext.size());
+  auto digits = [&mid](size_t from, size_t to) {
+    for (size_t i = from; i < to; ++i)
+      if (!std::isdigit((unsigned char)mid[i])) return false;
+    return to > from;
+  };
+  if (mid.size() < 15 || !digits(0, 8) || mid[8] != '-' || !digits(9, 15)) return false;
+  k = 0;
+  if (mid.size() > 15) {
+    if (mid[15] != '-' || !digits(16, mid.size()) || mid.size() > 16 + 9) return false;
+    k = std::stol(mid.substr(16));
+  }
+  stamp = mid.substr(0, 15);
+  return true;
+}
+
+// Chemin d'archive du segment actif path, démarré à stamp : "<stem>.<stamp><ext>",
+// ou "-k" avec k supérieur à tout segment existant de la même seconde (même si
+// les précédents ont été purgés), pour que l'ordre reste chronologique.
+inline fs::path archive_path(const fs::path &p, const std::string &stamp) {
+  const std::string stem = p.stem().string() + ".", ext = p.extension().string();
+  const fs::path dir = p.has_parent_path() ? p.parent_path() : fs::path(".");
+  long next = -1;   // -1 : nom de base libre
+  std::error_code ec;
+  for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+    std::string st;
+    long k = 0;
+    if (parse_segment_name(it->path().filename().string(), stem, ext, st, k) && st == stamp)
+      next = std::max(next, k);
+  }
+  return p.parent_path() / (stem + stamp + (next < 0 ? "" : "-" + std::to_string(next + 1)) + ext);
+}
+
+enum class FsyncPolicy { Never, Batch, Interval };
+
+inline FsyncPolicy parse_fsync(const std::string &s) {
+  if (s == "never")    return FsyncPolicy::Never;
+  if (s == "interval") return FsyncPolicy::Interval;
+  return FsyncPolicy::Batch;
+}
+
+// Une alerte à écrire : la ligne JSON est construite par l'appelant
+struct Record {
+  int64_t     t_ms;
+  std::string machine;
+  std::string line;   // sans '\n'
+};
+
+// ——— écrivain : un seul fil (le worker de notification) ———
+class AlertHistoryWriter {
+public:
+  struct Config {
+    std::string path;
+    uint64_t    max_bytes{16u << 20};   // 0 = pas de rotation par taille
+    int64_t     rotate_s{86400};        // 0 = pas de rotation par âge
+    int         max_segments{0};        // segments archivés gardés, 0 = tous
+    FsyncPolicy fsync{FsyncPolicy::Batch};
+    double      fsync_interval_s{5.0};
+  };
+
+  AlertHistoryWriter() = default;
+  AlertHistoryWriter(const AlertHistoryWriter &) = delete;
+  AlertHistoryWriter &operator=(const AlertHistoryWriter &) = delete;
+  ~AlertHistoryWriter() { close(); }
+
+  void configure(const Config &cfg) {
+    close();
+    _cfg = cfg;
+  }
+
+  bool enabled() const { return !_cfg.path.empty(); }
+
+  // Ajoute un lot : données puis index (un write chacun), fsync selon la politique
+  bool append(const std::vector<Record> &batch) {
+    if (!enabled() || batch.empty()) return true;
+    if (_fd < 0 && !open()) return false;
+    if (needs_rotation(batch.front().t_ms)) {
+      rotate();
+      if (_fd < 0 && !open()) return false;
+    }
+
+    std::string data;
+    std::vector<IndexEntry> idx;
+    idx.reserve(batch.size());
+    for (const auto &r : batch) {
+      idx.push_back({r.t_ms, _size + data.size(), (uint32_t)(r.line.size() + 1), machine_hash(r.machine)});
+      data += r.line;
+      data += '\n';
+    }
+    if (!write_all(_fd, data.data(), data.size()) ||
+        !write_all(_idx_fd, idx.data(), idx.size() * sizeof(IndexEntry))) {
+      std::cerr << "[alert_history] WARN: write failed on " << _cfg.path << std::endl;
+      close();
+      return false;
+    }
+    _size += data.size();
+    if (_seg_start_ms == 0) _seg_start_ms = batch.front().t_ms;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (_cfg.fsync == FsyncPolicy::Batch ||
+        (_cfg.fsync == FsyncPolicy::Interval &&
+         now - _last_sync >= std::chrono::duration<double>(_cfg.fsync_interval_s))) {
+      ::fdatasync(_fd);
+      ::fdatasync(_idx_fd);
+      _last_sync = now;
+    }
+    return true;
+  }
+
+  void close() {
+    if (_fd >= 0)     { if (_cfg.fsync != FsyncPolicy::Never) ::fdatasync(_fd); ::close(_fd); }
+    if (_idx_fd >= 0) { if (_cfg.fsync != FsyncPolicy::Never) ::fdatasync(_idx_fd); ::close(_idx_fd); }
+    _fd = _idx_fd = -1;
+  }
+
+private:
+  bool open() {
+    fs::path p(_cfg.path);
+    if (p.has_parent_path()) {
+      std::error_code ec;
+      fs::create_directories(p.parent_path(), ec);
+    }
+    _fd     = ::open(_cfg.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    _idx_fd = ::open((_cfg.path + ".idx").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (_fd < 0 || _idx_fd < 0) {
+      std::cerr << "[alert_history] WARN: cannot open history_path=" << _cfg.path << std::endl;
+      close();
+      return false;
+    }
+    struct stat st{};
+    fstat(_fd, &st);
+    _size = (uint64_t)st.st_size;
+    recover_index();
+    ::lseek(_idx_fd, 0, SEEK_END);
+    return true;
+  }
+
+  // Remet l'index en accord avec les données après un arrêt brutal :
+  // entrées orphelines retirées, lignes non indexées ré-indexées (champ t_ms,
+  // ou timestamp pour les lignes d'avant l'index ; illisible : instant de la
+  // ligne précédente, pour garder l'index trié)
+  void recover_index() {
+    struct stat st{};
+    fstat(_idx_fd, &st);
+    uint64_t n = (uint64_t)st.st_size / sizeof(IndexEntry);
+    IndexEntry e{};
+    while (n > 0) {
+      pread(_idx_fd, &e, sizeof(e), (off_t)((n - 1) * sizeof(IndexEntry)));
+      if (e.offset + e.len <= _size) break;
+      --n;
+    }
+    uint64_t indexed_end = n > 0 ? e.offset + e.len : 0;
+    if (ftruncate(_idx_fd, (off_t)(n * sizeof(IndexEntry))) != 0) return;
+
+    if (n > 0) {
+      IndexEntry first{};
+      pread(_idx_fd, &first, sizeof(first), 0);
+      _seg_start_ms = first.t_ms;
+    } else {
+      _seg_start_ms = 0;
+    }
+    if (indexed_end >= _size) return;
+
+    // lignes présentes mais absentes de l'index (ou ancien fichier sans index)
+    int rfd = ::open(_cfg.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (rfd < 0) return;
+    std::string buf((size_t)(_size - indexed_end), '\0');
+    ssize_t got = pread(rfd, buf.data(), buf.size(), (off_t)indexed_end);
+    ::close(rfd);
+    if (got <= 0) return;
+    buf.resize((size_t)got);
+    std::vector<IndexEntry> add;
+    int64_t prev_t = n > 0 ? e.t_ms : 0;
+    size_t pos = 0, nl;
+    while ((nl = buf.find('\n', pos)) != std::string::npos) {
+      json j = json::parse(buf.begin() + pos, buf.begin() + nl, nullptr, false);
+      int64_t t = record_time_ms(j);
+      if (t < 0) t = prev_t;
+      prev_t = t;
+      std::string m = j.is_object() ? j.value("machine", std::string()) : std::string();
+      add.push_back({t, indexed_end + pos, (uint32_t)(nl - pos + 1), machine_hash(m)});
+      pos = nl + 1;
+    }
+    ::lseek(_idx_fd, 0, SEEK_END);
+    write_all(_idx_fd, add.data(), add.size() * sizeof(IndexEntry));
+    if (_seg_start_ms == 0 && !add.empty()) _seg_start_ms = add.front().t_ms;
+  }
+
+  bool needs_rotation(int64_t t_ms) const {
+    if (_size == 0) return false;
+    if (_cfg.max_bytes > 0 && _size >= _cfg.max_bytes) return true;
+    return _cfg.rotate_s > 0 && _seg_start_ms > 0 && t_ms - _seg_start_ms >= _cfg.rotate_s * 1000;
+  }
+
+  void rotate() {
+    close();
+    fs::path p(_cfg.path);
+    std::time_t t = (std::time_t)(_seg_start_ms > 0 ? _seg_start_ms / 1000 : std::time(nullptr));
+    std::tm tm{};
+    localtime_r(&t, &tm);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    const fs::path arch = archive_path(p, stamp);
+    std::error_code ec;
+    fs::rename(p.string() + ".idx", arch.string() + ".idx", ec);
+    fs::rename(p, arch, ec);
+    _size = 0;
+    _seg_start_ms = 0;
+    prune();
+  }
+
+  void prune();
+
+  static bool write_all(int fd, const void *data, size_t len) {
+    const char *p = static_cast<const char *>(data);
+    while (len > 0) {
+      ssize_t n = ::write(fd, p, len);
+      if (n <= 0) return false;
+      p += n;
+      len -= (size_t)n;
+    }
+    return true;
+  }
+
+  Config   _cfg;
+  int      _fd{-1}, _idx_fd{-1};
+  uint64_t _size{0};
+  int64_t  _seg_start_ms{0};
+  std::chrono::steady_clock::time_point _last_sync{};
+};
+
+// Segments de l'historique, du plus ancien au plus récent (actif en dernier)
+inline std::vector<fs::path> segments(const std::string &path) {
+  fs::path p(path);
+  const std::string stem = p.stem().string() + ".", ext = p.extension().string();
+  struct Seg { std::string stamp; long k; fs::path path; };
+  std::vector<Seg> found;
+  std::error_code ec;
+  fs::path dir = p.has_parent_path() ? p.parent_path() : fs::path(".");
+  for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+    Seg sg;
+    if (it->path() != p && parse_segment_name(it->path().filename().string(), stem, ext, sg.stamp, sg.k)) {
+      sg.path = it->path();
+      found.push_back(std::move(sg));
+    }
+  }
+  // (horodatage, k) : ordre chronologique, y compris pour "-k" qui trierait avant "."
+  std::sort(found.begin(), found.end(), [](const Seg &a, const Seg &b) {
+    return a.stamp != b.stamp ? a.stamp < b.stamp : a.k < b.k;
+  });
+  std::vector<fs::path> out;
+  out.reserve(found.size() + 1);
+  for (auto &sg : found) out.push_back(std::move(sg.path));
+  if (fs::exists(p, ec)) out.push_back(p);
+  return out;
+}
+
+inline void AlertHistoryWriter::prune() {
+  if (_cfg.max_segments <= 0) return;
+  auto segs = segments(_cfg.path);
+  if (!segs.empty() && segs.back() == fs::path(_cfg.path)) segs.pop_back();
+  for (size_t i = 0; i + (size_t)_cfg.max_segments < segs.size(); ++i) {
+    std::error_code ec;
+    fs::remove(segs[i], ec);
+    fs::remove(segs[i].string() + ".idx", ec);
+  }
+}
+
+// ——— lecture : alertes de [from_ms, to_ms] (machine vide = toutes), ordre
+//     chronologique, au plus limit. Ne lit que les index et les lignes retenues.
+inline std::vector<json> history_query(const std::string &path, int64_t from_ms, int64_t to_ms,
+                                       const std::string &machine = {}, size_t limit = 1000) {
+  std::vector<json> out;
+  const uint32_t mh = machine_hash(machine);
+  for (const auto &seg : segments(path)) {
+    int ifd = ::open((seg.string() + ".idx").c_str(), O_RDONLY | O_CLOEXEC);
+    if (ifd < 0) continue;   // segment sans index : ignoré (ré-indexé à l'ouverture par l'écrivain)
+    struct stat st{};
+    fstat(ifd, &st);
+    const size_t n = (size_t)st.st_size / sizeof(IndexEntry);
+    IndexEntry first{}, last{};
+    if (n == 0 || pread(ifd, &first, sizeof(first), 0) != (ssize_t)sizeof(first) ||
+        pread(ifd, &last, sizeof(last), (off_t)((n - 1) * sizeof(IndexEntry))) != (ssize_t)sizeof(last) ||
+        last.t_ms < from_ms || first.t_ms > to_ms) {
+      ::close(ifd);
+      continue;
+    }
+    std::vector<IndexEntry> idx(n);
+    ssize_t got = pread(ifd, idx.data(), n * sizeof(IndexEntry), 0);
+    ::close(ifd);
+    idx.resize((size_t)std::max<ssize_t>(got, 0) / sizeof(IndexEntry));
+
+    int dfd = ::open(seg.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dfd < 0) continue;
+    // entrées triées par temps : recherche du début par dichotomie
+    auto it = std::lower_bound(idx.begin(), idx.end(), from_ms,
+                               [](const IndexEntry &e, int64_t t) { return e.t_ms < t; });
+    std::string line;
+    for (; it != idx.end() && it->t_ms <= to_ms; ++it) {
+      if (!machine.empty() && it->machine != mh) continue;
+      line.resize(it->len);
+      if (pread(dfd, line.data(), it->len, (off_t)it->offset) != (ssize_t)it->len) break;
+      json j = json::parse(line, nullptr, false);
+      if (j.is_discarded()) continue;
+      if (!machine.empty() && j.value("machine", std::string()) != machine) continue;   // collision de hash
+      out.push_back(std::move(j));
+      if (out.size() >= limit) { ::close(dfd); return out; }
+    }
+    ::close(dfd);
+  }
+  return out;
+}
+
+} // namespace alert_history
@@ -0,0 +1,216 @@
+// gui_shm.hpp
+// Canal d'état sink -> GUI Python en mémoire partagée POSIX (shm_open + mmap),
+// partagé par sound_fft_alarm_gui et accel_fft_alarm_gui.
+//
+// Disposition du segment (ordre natif, offsets fixés par les capacités) :
+//   [0, 64)   Header
+//   f_low     float32[max_bands]
+//   f_high    float32[max_bands]
+//   mag       float32[max_bands]
+//   waterfall float32[wf_cap * max_bands]  anneau de lignes, wf_head = prochaine ligne
+//
+// seq sert de seqlock : impair pendant une écriture. Le lecteur lit seq, copie,
+// relit seq et recommence si elle est impaire ou a changé. Les données sont
+// écrites en place : ni fichier ni JSON sur le chemin chaud.
+//
+// Le sink supprime le segment (shm_unlink) en s'arrêtant : une GUI encore
+// attachée garde son mapping, puis se rattache au segment recréé par le sink
+// suivant (changement d'inode, voir ShmState.poll des scripts Python).
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace gui_shm {
+
+static constexpr char     kMagic[8] = {'M','A','D','S','G','U','I','1'};
+static constexpr uint32_t kVersion  = 1;
+
+struct Header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  std::atomic<uint64_t> seq;     // seqlock (impair = écriture en cours)
+  uint32_t max_bands;            // capacité des tableaux de bandes
+  uint32_t wf_cap;               // capacité du waterfall (lignes)
+  uint32_t n_bands;              // bandes valides
+  uint32_t wf_rows;              // lignes de waterfall valides
+  uint32_t wf_cols;              // colonnes du waterfall
+  uint32_t wf_head;              // prochaine ligne écrite dans l'anneau
+  float    max_mag;
+  uint32_t flags;                // bit 0 : alarme
+  uint64_t wf_seq;               // incrémenté à chaque ligne de waterfall
+};
+static_assert(sizeof(Header) == 64, "Header : 64 octets attendus");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "seqlock inter-processus");
+
+static constexpr uint32_t kAlarm = 1u;
+
+inline size_t segment_size(uint32_t max_bands, uint32_t wf_cap) {
+  return sizeof(Header) + sizeof(float) * size_t(max_bands) * (3 + size_t(wf_cap));
+}
+
+class Writer {
+public:
+  Writer() = default;
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+  ~Writer() { close(); }
+
+  // Crée (ou reprend) le segment /name ; il n'est jamais réduit, pour qu'une
+  // GUI encore attachée à l'ancienne taille ne lise pas hors du mapping
+  bool open(const std::string &name, uint32_t max_bands, uint32_t wf_cap, std::string &err) {
+    close();
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0) { err = "shm_open " + name + " : " + std::strerror(errno); return false; }
+    size_t size = segment_size(max_bands, wf_cap);
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && size_t(st.st_size) > size) size = size_t(st.st_size);
+    if (::ftruncate(fd, off_t(size)) != 0) {
+      err = "ftruncate " + name + " : " + std::strerror(errno);
+      ::close(fd);
+      return false;
+    }
+    void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) { err = "mmap " + name + " : " + std::strerror(errno); return false; }
+    _base = static_cast<char *>(p);
+    _size = size;
+    _name = name;
+    _hdr  = reinterpret_cast<Header *>(_base);
+
+    // seq reprend après la valeur laissée par un sink précédent (paire), pour
+    // que la GUI voie le redémarrage comme une mise à jour
+    uint64_t seq = 0;
+    if (std::memcmp(_hdr->magic, kMagic, sizeof(kMagic)) == 0)
+      seq = (_hdr->seq.load(std::memory_order_relaxed) + 1) & ~uint64_t(1);
+    _hdr->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(_hdr->magic, kMagic, sizeof(kMagic));
+    _hdr->version     = kVersion;
+    _hdr->header_size = sizeof(Header);
+    _hdr->max_bands   = max_bands;
+    _hdr->wf_cap      = wf_cap;
+    _hdr->n_bands = _hdr->wf_rows = _hdr->wf_cols = _hdr->wf_head = 0;
+    _hdr->max_mag = 0.0f;
+    _hdr->flags   = 0;
+    _hdr->wf_seq  = 0;
+    _hdr->seq.store(seq + 2, std::memory_order_release);
+    return true;
+  }
+
+  void close() {
+    if (_base) ::munmap(_base, _size);
+    _base = nullptr;
+    _hdr  = nullptr;
+    _size = 0;
+  }
+
+  // Ferme et supprime le segment (arrêt du sink ou changement de nom)
+  void remove() {
+    const bool owned = _base != nullptr;
+    close();
+    if (owned && !_name.empty()) ::shm_unlink(_name.c_str());
+    _name.clear();
+  }
+
+  const std::string &name() const { return _name; }
+
+  bool ok() const { return _hdr != nullptr; }
+  uint32_t max_bands() const { return _hdr ? _hdr->max_bands : 0; }
+
+  // begin() ... remplissage ... commit() : une publication vue d'un bloc par la GUI
+  void begin() {
+    const uint64_t s = _hdr->seq.load(std::memory_order_relaxed);
+    _hdr->seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void commit(uint32_t n_bands, float max_mag, bool alarm) {
+    _hdr->n_bands = n_bands < _hdr->max_bands ? n_bands : _hdr->max_bands;
+    _hdr->max_mag = max_mag;
+    _hdr->flags   = alarm ? kAlarm : 0u;
+    const uint64_t s = _hdr->seq.load(std::memory_order_relaxed);
+    _hdr->seq.store(s + 1, std::memory_order_release);
+  }
+
+  float *f_low()  { return reinterpret_cast<float *>(_base + sizeof(Header)); }
+  float *f_high() { return f_low() + _hdr->max_bands; }
+  float *mag()    { return f_low() + 2 * size_t(_hdr->max_bands); }
+
+  // Ligne suivante de l'anneau (cols valeurs à remplir) ; nullptr si trop large.
+  // Un changement de largeur vide le waterfall.
+  float *next_row(uint32_t cols) {
+    if (_hdr->wf_cap == 0 || cols == 0 || cols > _hdr->max_bands) return nullptr;
+    if (cols != _hdr->wf_cols) { _hdr->wf_cols = cols; _hdr->wf_rows = 0; _hdr->wf_head = 0; }
+    float *row = f_low() + size_t(_hdr->max_bands) * (3 + size_t(_hdr->wf_head));
+    _hdr->wf_head = (_hdr->wf_head + 1) % _hdr->wf_cap;
+    if (_hdr->wf_rows < _hdr->wf_cap) _hdr->wf_rows++;
+    _hdr->wf_seq++;
+    return row;
+  }
+
+private:
+  char   *_base{nullptr};
+  size_t  _size{0};
+  Header *_hdr{nullptr};
+  std::string _name;
+};
+
+// Champ numérique d'un objet JSON (0 si absent ou d'un autre type) : rien ne
+// doit lever d'exception entre begin() et commit()
+template <class Json>
+inline float num(const Json &o, const char *key) {
+  if (!o.is_object()) return 0.0f;
+  auto it = o.find(key);
+  return (it != o.end() && it->is_number()) ? it->template get<float>() : 0.0f;
+}
+
+// Bandes [{f_low, f_high, mean_mag}] ou tons goertzel [{f_hz, mag}] (bande de
+// largeur nulle) -> tableaux du segment ; renvoie le nombre de bandes écrites
+template <class Json>
+inline uint32_t write_bands(Writer &w, const Json &arr, bool tones, uint64_t &truncated) {
+  float *lo = w.f_low(), *hi = w.f_high(), *mg = w.mag();
+  const uint32_t cap = w.max_bands();
+  uint32_t n = 0;
+  for (const auto &b : arr) {
+    if (n == cap) { truncated++; break; }
+    if (tones) { lo[n] = hi[n] = num(b, "f_hz"); mg[n] = num(b, "mag"); }
+    else       { lo[n] = num(b, "f_low"); hi[n] = num(b, "f_high"); mg[n] = num(b, "mean_mag"); }
+    ++n;
+  }
+  return n;
+}
+
+// Bloc "waterfall" publié par le filter (mode row ou tile) -> anneau du segment
+template <class Json>
+inline void write_waterfall(Writer &w, const Json &wf) {
+  auto ci = wf.find("cols");
+  if (ci == wf.end() || !ci->is_number_integer()) return;
+  const int64_t cols = ci->template get<int64_t>();
+  if (cols <= 0 || cols > int64_t(w.max_bands())) return;
+  const uint32_t c = uint32_t(cols);
+  auto copy_row = [&](const Json &src, size_t off) {
+    if (float *row = w.next_row(c))
+      for (uint32_t i = 0; i < c; ++i) row[i] = src[off + i].is_number() ? src[off + i].template get<float>() : 0.0f;
+  };
+  auto ri = wf.find("row");
+  auto di = wf.find("data");
+  auto mi = wf.find("mode");
+  const bool row_mode = mi != wf.end() && mi->is_string() && *mi == "row";
+  if (row_mode && ri != wf.end() && ri->is_array()) {
+    if (ri->size() == c) copy_row(*ri, 0);
+  } else if (di != wf.end() && di->is_array()) {
+    for (size_t off = 0; off + c <= di->size(); off += c) copy_row(*di, off);
+  }
+}
+
+} // namespace gui_shm
@@ -0,0 +1,64 @@
+// gui_sink_common.hpp
+// Aides communes aux sinks GUI sound_fft_alarm_gui et accel_fft_alarm_gui
+// (canal fichier JSON) : waterfall accumulé côté sink et tons Goertzel.
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Waterfall côté sink : on accumule les lignes/tuiles publiées par le filter
+// dans une matrice bornée que la GUI affiche telle quelle (aucun recalcul).
+struct WaterfallBuffer {
+  size_t rows{0}, cols{0}, head{0}, count{0};
+  std::vector<float> data;
+
+  void reset(size_t r) { rows = r; cols = 0; head = 0; count = 0; data.clear(); }
+
+  void push(const float *row, size_t c) {
+    if (rows == 0 || c == 0) return;
+    if (c != cols) { cols = c; head = 0; count = 0; data.assign(rows * cols, 0.0f); }
+    std::copy(row, row + c, data.begin() + head * cols);
+    head = (head + 1) % rows;
+    if (count < rows) count++;
+  }
+
+  // Ajoute un bloc "waterfall" publié par le filter (mode row ou tile)
+  void add(const nlohmann::json &wf) {
+    const size_t c = wf.value("cols", size_t(0));
+    if (c == 0) return;
+    std::vector<float> tmp;
+    if (wf.value("mode", std::string()) == "row" && wf.contains("row")) {
+      tmp = wf["row"].get<std::vector<float>>();
+      if (tmp.size() == c) push(tmp.data(), c);
+    } else if (wf.contains("data")) {
+      tmp = wf["data"].get<std::vector<float>>();
+      for (size_t off = 0; off + c <= tmp.size(); off += c) push(&tmp[off], c);
+    }
+  }
+
+  // Lignes de la plus ancienne à la plus récente
+  nlohmann::json to_json() const {
+    std::vector<float> flat;
+    flat.reserve(count * cols);
+    for (size_t i = 0; i < count; ++i) {
+      const float *r = &data[((head + rows - count + i) % rows) * cols];
+      flat.insert(flat.end(), r, r + cols);
+    }
+    return { {"rows", count}, {"cols", cols}, {"data", flat} };
+  }
+};
+
+// Mode goertzel du filter : les tons sont présentés à la GUI comme des
+// bandes de largeur nulle (f_low = f_high = f_hz).
+inline nlohmann::json tones_as_bands(const nlohmann::json &tones) {
+  nlohmann::json bands = nlohmann::json::array();
+  for (auto &t : tones) {
+    const double f = t.value("f_hz", 0.0);
+    bands.push_back({ {"f_low", f}, {"f_high", f}, {"mean_mag", t.value("mag", 0.0)},
+                      {"label", t.value("label", std::string())}, {"alarm", t.value("alarm", false)} });
+  }
+  return bands;
+}
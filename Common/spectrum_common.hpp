@@ -0,0 +1,658 @@
+// spectrum_common.hpp
+// Briques communes aux filters sound_fft et accel_fft : historique
+// spectrogramme (waterfall), banc de Goertzel, baseline par bande et
+// pipeline de calcul asynchrone. Chaque filter ne garde que sa transformée
+// et son format de sortie.
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <complex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ----------- Historique spectrogramme (anneau borné) --------------------------
+// Matrice float contiguë [rows x cols] : une ligne = un spectre (bandes).
+// Ajouter une ligne coûte O(cols), la mémoire est fixée par reset().
+struct SpectrogramRing {
+  size_t rows{0}, cols{0};
+  size_t head{0};               // prochaine ligne à écrire
+  size_t count{0};              // lignes valides (<= rows)
+  uint64_t total{0};            // nb total de lignes ajoutées (numéro de séquence)
+  std::vector<float>  data;     // rows * cols
+  std::vector<double> t;        // instant (s) de chaque ligne
+
+  void reset(size_t r, size_t c) {
+    rows = r; cols = c; head = 0; count = 0; total = 0;
+    data.assign(rows * cols, 0.0f);
+    t.assign(rows, 0.0);
+  }
+
+  void push(const std::vector<float> &row, double t_s) {
+    if (rows == 0 || row.size() != cols) return;
+    std::copy(row.begin(), row.end(), data.begin() + head * cols);
+    t[head] = t_s;
+    head = (head + 1) % rows;
+    if (count < rows) count++;
+    total++;
+  }
+
+  // i = 0 -> ligne la plus ancienne encore présente
+  const float *row(size_t i) const {
+    return &data[((head + rows - count + i) % rows) * cols];
+  }
+  double row_t(size_t i) const { return t[(head + rows - count + i) % rows]; }
+};
+
+// Tuile waterfall : les n dernières lignes, sous-échantillonnées en temps
+// (max par groupe de lignes) vers au plus out_rows lignes.
+inline nlohmann::json waterfall_tile(const SpectrogramRing &ring, size_t n, size_t out_rows) {
+  n = std::min(n, ring.count);
+  nlohmann::json tile = nlohmann::json::object();
+  if (n == 0 || ring.cols == 0) return tile;
+  out_rows = std::max<size_t>(1, std::min(out_rows, n));
+
+  const size_t first = ring.count - n;
+  std::vector<float> flat(out_rows * ring.cols, 0.0f);
+  for (size_t r = 0; r < out_rows; ++r) {
+    const size_t lo = first + (r * n) / out_rows;
+    const size_t hi = first + ((r + 1) * n) / out_rows;
+    float *dst = &flat[r * ring.cols];
+    std::copy(ring.row(lo), ring.row(lo) + ring.cols, dst);
+    for (size_t i = lo + 1; i < hi; ++i) {
+      const float *src = ring.row(i);
+      for (size_t c = 0; c < ring.cols; ++c) dst[c] = std::max(dst[c], src[c]);
+    }
+  }
+  tile["mode"] = "tile";
+  tile["seq"]  = ring.total;
+  tile["rows"] = out_rows;
+  tile["cols"] = ring.cols;
+  tile["t0"]   = ring.row_t(first);
+  tile["t1"]   = ring.row_t(ring.count - 1);
+  tile["data"] = flat;
+  return tile;
+}
+
+// Nombre de bandes de largeur width entre f_min et f_max (même découpage
+// que bands_aggregate)
+inline size_t band_count(double fmin, double fmax, double width) {
+  size_t n = 0;
+  for (double b = fmin; b < fmax; b += width) n++;
+  return n;
+}
+
+// Historique + export waterfall d'un filter :
+//   waterfall        = "none" | "rows" | "tiles"
+//   history_s        = 60      durée de l'anneau (à la cadence des spectres)
+//   history_max_rows = 4096    plafond de lignes
+//   tile_period      = 32      lignes entre 2 tuiles
+//   tile_rows        = 16      lignes par tuile
+struct SpectrumHistory {
+  std::string mode{"none"};
+  double history_s{60.0};
+  size_t max_rows{4096};
+  int    tile_period{32};
+  int    tile_rows{16};
+  SpectrogramRing    ring;
+  std::vector<float> row;
+
+  void configure(const nlohmann::json &p) {
+    mode        = p.value("waterfall", std::string("none"));
+    history_s   = p.value("history_s", 60.0);
+    max_rows    = p.value("history_max_rows", size_t(4096));
+    tile_period = std::max(1, p.value("tile_period", 32));
+    tile_rows   = std::max(1, p.value("tile_rows", 16));
+    ring.reset(0, 0);
+  }
+
+  // Anneau borné : history_s à la cadence des spectres (spectres / s)
+  void reset(double spectra_per_s, size_t cols) {
+    ring.reset(0, 0);
+    if (mode == "none") return;
+    size_t rows = size_t(std::ceil(std::max(0.0, history_s) * spectra_per_s));
+    rows = std::clamp<size_t>(rows, 1, std::max<size_t>(1, max_rows));
+    ring.reset(rows, cols);
+    row.assign(cols, 0.0f);
+  }
+
+  // Ajoute la ligne O(bandes) et, selon le mode, le bloc "waterfall" dans out
+  void push(const std::vector<double> &vals, double t_s, nlohmann::json &out) {
+    if (ring.rows == 0) return;
+    for (size_t i = 0; i < row.size() && i < vals.size(); ++i) row[i] = float(vals[i]);
+    ring.push(row, t_s);
+
+    if (mode == "rows") {
+      out["waterfall"] = {
+        {"mode", "row"}, {"seq", ring.total}, {"t", t_s},
+        {"cols", ring.cols}, {"row", row}
+      };
+    } else if (mode == "tiles" && ring.total % uint64_t(tile_period) == 0) {
+      out["waterfall"] = waterfall_tile(ring, size_t(tile_period), size_t(tile_rows));
+    }
+  }
+};
+
+// ----------- Banc de Goertzel (mode "goertzel") -------------------------------
+// Quelques fréquences connues (harmoniques broche, passage de dents) :
+// une récurrence de Goertzel par fréquence, mise à jour à chaque échantillon,
+// soit O(nb_fréquences) par échantillon au lieu d'un spectre complet.
+struct GoertzelTone {
+  std::string label;
+  double f_hz{0.0};
+  double threshold{0.0};
+  size_t bin_lo{0}, bin_hi{0};  // fréquences du banc couvertes par ce ton
+  int    over_count{0};
+};
+
+struct GoertzelBank {
+  // Tableaux contigus (structure de tableaux) -> boucle vectorisable
+  std::vector<double> coeff, s1, s2;
+  std::vector<double> f_hz;
+  size_t n{0};                  // échantillons accumulés dans le bloc courant
+
+  size_t add(double f, double fs) {
+    f_hz.push_back(f);
+    coeff.push_back(2.0 * std::cos(2.0 * M_PI * f / fs));
+    s1.push_back(0.0);
+    s2.push_back(0.0);
+    return f_hz.size() - 1;
+  }
+
+  void clear() { coeff.clear(); s1.clear(); s2.clear(); f_hz.clear(); n = 0; }
+  void reset() { std::fill(s1.begin(), s1.end(), 0.0); std::fill(s2.begin(), s2.end(), 0.0); n = 0; }
+
+  void update(double x) {
+    const size_t M = coeff.size();
+    double *p1 = s1.data(), *p2 = s2.data();
+    const double *c = coeff.data();
+    for (size_t m = 0; m < M; ++m) {
+      const double s0 = x + c[m] * p1[m] - p2[m];
+      p2[m] = p1[m];
+      p1[m] = s0;
+    }
+    n++;
+  }
+
+  // Amplitude mono-latérale (même échelle que dft_real)
+  double magnitude(size_t m) const {
+    if (n == 0) return 0.0;
+    const double p = s1[m] * s1[m] + s2[m] * s2[m] - coeff[m] * s1[m] * s2[m];
+    return 2.0 * std::sqrt(std::max(0.0, p)) / double(n);
+  }
+};
+
+// Nombre court pour les libellés ("120", "1.5", "87.33") au lieu de
+// std::to_string ("120.000000")
+inline std::string short_num(double v) {
+  char buf[32];
+  std::snprintf(buf, sizeof buf, "%g", v);
+  return buf;
+}
+
+// Construit la liste des tons depuis mads.ini :
+//   tones_hz        = [120.0, 350.0]       fréquences fixes
+//   spindle_rpm     = 12000                 vitesse broche
+//   spindle_orders  = [1, 2, 3]             harmoniques de la fréquence broche
+//   teeth           = 4                     nb de dents -> fréquence de passage
+//   tooth_orders    = [1, 2]                harmoniques du passage de dents
+//   spindle_tolerance = 0.02                plage ±2 % autour des fréquences broche
+//   tone_thresholds = [...]                 seuil par ton (sinon "threshold")
+inline std::vector<GoertzelTone> goertzel_tones(const nlohmann::json &p, double fs,
+                                                double def_threshold, GoertzelBank &bank) {
+  std::vector<GoertzelTone> tones;
+  bank.clear();
+  const double nyq = fs / 2.0;
+
+  auto add_tone = [&](const std::string &label, double f, double tol) {
+    if (f <= 0.0 || f >= nyq) return;
+    GoertzelTone t;
+    t.label = label;
+    t.f_hz  = f;
+    t.bin_lo = bank.f_hz.size();
+    if (tol > 0.0) {
+      // plage : 3 fréquences (bas, centre, haut), on garde le max
+      bank.add(f * (1.0 - tol), fs);
+      bank.add(f, fs);
+      bank.add(std::min(f * (1.0 + tol), nyq * 0.999), fs);
+    } else {
+      bank.add(f, fs);
+    }
+    t.bin_hi = bank.f_hz.size();
+    tones.push_back(t);
+  };
+
+  if (p.contains("tones_hz") && p["tones_hz"].is_array()) {
+    for (auto &f : p["tones_hz"])
+      if (f.is_number()) add_tone(short_num(f.get<double>()) + " Hz", f.get<double>(), 0.0);
+  }
+
+  const double rpm = p.value("spindle_rpm", 0.0);
+  const double tol = p.value("spindle_tolerance", 0.0);
+  if (rpm > 0.0) {
+    const double f_rot = rpm / 60.0;
+    nlohmann::json orders = p.value("spindle_orders", nlohmann::json::array({1}));
+    for (auto &o : orders)
+      if (o.is_number()) add_tone("spindle x" + short_num(o.get<double>()), f_rot * o.get<double>(), tol);
+
+    const int teeth = p.value("teeth", 0);
+    if (teeth > 0) {
+      nlohmann::json t_orders = p.value("tooth_orders", nlohmann::json::array({1}));
+      for (auto &o : t_orders)
+        if (o.is_number())
+          add_tone("tooth x" + short_num(o.get<double>()), f_rot * teeth * o.get<double>(), tol);
+    }
+  }
+
+  const nlohmann::json thr = p.value("tone_thresholds", nlohmann::json::array());
+  for (size_t i = 0; i < tones.size(); ++i)
+    tones[i].threshold = (i < thr.size() && thr[i].is_number()) ? thr[i].get<double>() : def_threshold;
+  return tones;
+}
+
+// ----------- Baseline par bande (apprentissage en ligne) ---------------------
+// Moyenne et variance à pondération exponentielle (Welford/West) pour chaque
+// bande, mises à jour en une passe sur des tableaux contigus : O(bandes) par
+// fenêtre. Persistée dans un petit fichier binaire pour survivre aux redémarrages.
+struct BandBaseline {
+  std::vector<double> mean, var, z;
+  uint64_t n{0};               // fenêtres apprises
+  bool frozen{false};
+
+  void reset(size_t bands) {
+    mean.assign(bands, 0.0); var.assign(bands, 0.0); z.assign(bands, 0.0); n = 0;
+  }
+
+  // alpha : poids de la nouvelle fenêtre ; pendant les premières fenêtres on
+  // prend 1/(n+1) (moyenne arithmétique exacte) tant que c'est plus grand.
+  void update(const std::vector<double> &x, double alpha) {
+    const double a = std::max(alpha, 1.0 / double(n + 1));
+    const size_t B = std::min(x.size(), mean.size());
+    double *m = mean.data(), *v = var.data();
+    const double *px = x.data();
+    for (size_t i = 0; i < B; ++i) {
+      const double d   = px[i] - m[i];
+      const double inc = a * d;
+      m[i] += inc;
+      v[i]  = (1.0 - a) * (v[i] + d * inc);
+    }
+    n++;
+  }
+
+  // z-scores dans `z`, retourne l'indice de la bande au z maximal
+  size_t zscores(const std::vector<double> &x, double min_std, double &max_z) {
+    const size_t B = std::min(x.size(), mean.size());
+    const double floor2 = min_std * min_std;
+    const double *m = mean.data(), *v = var.data(), *px = x.data();
+    double *pz = z.data();
+    for (size_t i = 0; i < B; ++i)
+      pz[i] = (px[i] - m[i]) / std::sqrt(std::max(v[i], floor2));
+    size_t arg = 0;
+    max_z = (B > 0) ? pz[0] : 0.0;
+    for (size_t i = 1; i < B; ++i) if (pz[i] > max_z) { max_z = pz[i]; arg = i; }
+    return arg;
+  }
+
+  // Format : "MADSBL1\0" | u32 bandes | u32 0 | u64 n | f64 f_min | f64 f_max | mean[] | var[]
+  bool save(const std::string &path, double fmin, double fmax) const {
+    const std::string tmp = path + ".tmp";
+    {
+      std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+      if (!f) return false;
+      const char magic[8] = {'M','A','D','S','B','L','1','\0'};
+      const uint32_t bands = uint32_t(mean.size()), pad = 0;
+      f.write(magic, 8);
+      f.write(reinterpret_cast<const char*>(&bands), sizeof bands);
+      f.write(reinterpret_cast<const char*>(&pad), sizeof pad);
+      f.write(reinterpret_cast<const char*>(&n), sizeof n);
+      f.write(reinterpret_cast<const char*>(&fmin), sizeof fmin);
+      f.write(reinterpret_cast<const char*>(&fmax), sizeof fmax);
+      f.write(reinterpret_cast<const char*>(mean.data()), std::streamsize(bands * sizeof(double)));
+      f.write(reinterpret_cast<const char*>(var.data()),  std::streamsize(bands * sizeof(double)));
+      if (!f) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+  }
+
+  // Ne charge que si le découpage en bandes est identique
+  bool load(const std::string &path, size_t bands, double fmin, double fmax) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) return false;
+    char magic[8]; uint32_t nb = 0, pad = 0; uint64_t nn = 0; double f0 = 0, f1 = 0;
+    f.read(magic, 8);
+    f.read(reinterpret_cast<char*>(&nb), sizeof nb);
+    f.read(reinterpret_cast<char*>(&pad), sizeof pad);
+    f.read(reinterpret_cast<char*>(&nn), sizeof nn);
+    f.read(reinterpret_cast<char*>(&f0), sizeof f0);
+    f.read(reinterpret_cast<char*>(&f1), sizeof f1);
+    if (!f || std::string(magic, 7) != "MADSBL1" || nb != bands || f0 != fmin || f1 != fmax) return false;
+    std::vector<double> m(nb), v(nb);
+    f.read(reinterpret_cast<char*>(m.data()), std::streamsize(nb * sizeof(double)));
+    f.read(reinterpret_cast<char*>(v.data()), std::streamsize(nb * sizeof(double)));
+    if (!f) return false;
+    mean.swap(m); var.swap(v); z.assign(nb, 0.0); n = nn;
+    return true;
+  }
+};
+
+// Baseline + alarme z-score avec hystérésis (remplace le seuil global) :
+//   baseline               = false   active la baseline
+//   baseline_alpha         = 0.01    poids d'une fenêtre
+//   baseline_learn_windows = 200     fenêtres apprises avant d'alarmer
+//   z_on / z_off           = 6 / 3   entrée / sortie d'alarme
+//   baseline_min_std       = 1e-4    plancher d'écart-type
+//   baseline_path          = ""      fichier de persistance
+//   baseline_save_every    = 500     fenêtres entre 2 sauvegardes, 0 = jamais
+//   baseline_frozen        = false   démarre sans apprentissage
+struct BaselineAlarm {
+  bool   enabled{false};
+  double alpha{0.01};
+  int    learn{200};
+  double z_on{6.0}, z_off{3.0};
+  double min_std{1.0e-4};
+  std::string path;
+  int    save_every{500};
+  int    confirm{2};
+  double fmin{0.0}, fmax{0.0};  // découpage en bandes (clé du fichier)
+  std::string tag;              // préfixe des messages console
+  bool   alarm{false};
+  int    over{0};
+  BandBaseline model;
+
+  void configure(const nlohmann::json &p, int confirm_windows, double f_min, double f_max,
+                 const std::string &plugin) {
+    enabled    = p.value("baseline", false);
+    alpha      = p.value("baseline_alpha", 0.01);
+    learn      = p.value("baseline_learn_windows", 200);
+    z_on       = p.value("z_on", 6.0);
+    z_off      = p.value("z_off", 3.0);
+    min_std    = p.value("baseline_min_std", 1.0e-4);
+    path       = p.value("baseline_path", std::string(""));
+    save_every = p.value("baseline_save_every", 500);
+    confirm    = confirm_windows;
+    fmin = f_min; fmax = f_max;
+    tag  = plugin;
+    model.reset(0);
+    model.frozen = p.value("baseline_frozen", false);
+    alarm = false;
+    over  = 0;
+  }
+
+  // freeze : plus d'apprentissage ; resume : reprend ; relearn : repart de zéro
+  void command(const std::string &cmd) {
+    if (cmd == "freeze")       model.frozen = true;
+    else if (cmd == "resume")  model.frozen = false;
+    else if (cmd == "relearn") { model.reset(model.mean.size()); alarm = false; over = 0; }
+    else if (cmd == "save" && !path.empty()) model.save(path, fmin, fmax);
+    else return;
+    std::cerr << "[" << tag << "] baseline: " << cmd << std::endl;
+  }
+
+  // Sauvegarde finale (destructeur du filter)
+  void save_on_exit() const {
+    if (enabled && !path.empty() && model.n > 0) model.save(path, fmin, fmax);
+  }
+
+  // Une fenêtre : z-scores, hystérésis z_on/z_off, puis apprentissage
+  // (sauf si figée, en alarme ou si la fenêtre est elle-même anormale).
+  bool step(const std::vector<double> &vals, nlohmann::json &bands, nlohmann::json &info) {
+    const size_t B = vals.size();
+    if (model.mean.size() != B) {
+      model.reset(B);
+      if (!path.empty() && model.load(path, B, fmin, fmax))
+        std::cerr << "[" << tag << "] baseline rechargée (" << model.n
+                  << " fenêtres) depuis " << path << std::endl;
+    }
+
+    const bool learning = model.n < uint64_t(learn);
+    double max_z = 0.0;
+    size_t arg = 0;
+    if (!learning) {
+      arg = model.zscores(vals, min_std, max_z);
+      for (size_t i = 0; i < B; ++i) bands[i]["z"] = model.z[i];
+
+      if (alarm) {
+        if (max_z < z_off) { alarm = false; over = 0; }
+      } else if (max_z > z_on) {
+        if (++over >= confirm) alarm = true;
+      } else {
+        over = 0;
+      }
+    }
+
+    if (!model.frozen && !alarm && (learning || max_z <= z_on)) {
+      model.update(vals, alpha);
+      if (!path.empty() && save_every > 0 && model.n % uint64_t(save_every) == 0)
+        model.save(path, fmin, fmax);
+    }
+
+    info = {
+      {"state", learning ? "learning" : (model.frozen ? "frozen" : "active")},
+      {"windows", model.n},
+      {"learn_windows", learn},
+      {"z_on", z_on},
+      {"z_off", z_off},
+      {"max_z", max_z},
+      {"max_z_band", learning ? nlohmann::json() : nlohmann::json(arg)}
+    };
+    return alarm;
+  }
+};
+
+// ----------- Fenêtre glissante O(1) + pipeline asynchrone ---------------------
+// Anneau de taille fixe : l'ajout d'un échantillon est O(1) (plus d'erase en
+// tête de vector), snapshot() recopie la fenêtre dans l'ordre chronologique.
+struct SampleRing {
+  std::vector<double> data;
+  size_t head{0}, fill{0};
+
+  void reset(size_t n) { data.assign(n, 0.0); head = 0; fill = 0; }
+  size_t size() const { return fill; }
+  bool full() const { return fill > 0 && fill == data.size(); }
+
+  void push(double x) {
+    data[head] = x;
+    head = (head + 1) % data.size();
+    if (fill < data.size()) fill++;
+  }
+
+  void snapshot(std::vector<double> &out) const {
+    const size_t N = data.size();
+    out.resize(fill);
+    const size_t first = (head + N - fill) % N;
+    const size_t n1 = std::min(fill, N - first);
+    std::copy(data.begin() + first, data.begin() + first + n1, out.begin());
+    std::copy(data.begin(), data.begin() + (fill - n1), out.begin() + n1);
+  }
+};
+
+// Tampons de travail d'un calcul de spectre, réutilisés d'une fenêtre à l'autre
+// (un jeu par worker, un pour le chemin synchrone)
+struct SpectrumScratch {
+  std::vector<std::complex<double>> a, b;
+  std::vector<double> freqs, mag;
+};
+
+// Spectre calculé par un worker (bandes déjà agrégées)
+struct SpectrumResult {
+  uint64_t seq{0};        // numéro de fenêtre
+  uint64_t n_samples{0};  // échantillons reçus au moment du snapshot
+  double   fs{0.0};       // cadence de la fenêtre
+  nlohmann::json bands;
+};
+
+// Fenêtre glissante partagée entre load_data et les workers. L'anneau, la
+// cadence, les compteurs et la file de résultats sont protégés par _mx ; la
+// transformée (compute) tourne hors verrou sur un snapshot.
+class SpectrumPipeline {
+public:
+  using Compute = std::function<nlohmann::json(const std::vector<double> &, double, SpectrumScratch &)>;
+
+  SpectrumPipeline() = default;
+  SpectrumPipeline(const SpectrumPipeline &) = delete;
+  SpectrumPipeline &operator=(const SpectrumPipeline &) = delete;
+  ~SpectrumPipeline() { stop(); }
+
+  // Taille de fenêtre, pas et cadence : vide l'anneau, invalide les calculs en cours
+  void configure(size_t win_size, int hop_size, double fs) {
+    std::lock_guard<std::mutex> lk(_mx);
+    _ring.reset(win_size);
+    _hop         = size_t(std::max(1, hop_size));
+    _fs          = fs;
+    _n_samples   = 0;
+    _since_hop   = 0;
+    _pending_seq = _taken_seq;
+    _results.clear();
+    _gen++;
+  }
+
+  void start(int workers, int result_cap, Compute compute) {
+    stop();
+    std::lock_guard<std::mutex> lk(_mx);
+    _compute    = std::move(compute);
+    _result_cap = size_t(std::max(1, result_cap));
+    _stop       = false;
+    _async      = true;
+    for (int i = 0; i < std::max(1, workers); ++i)
+      _workers.emplace_back([this]() { worker_loop(); });
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lk(_mx);
+      _stop  = true;
+      _async = false;
+    }
+    _cv.notify_all();
+    for (auto &t : _workers) if (t.joinable()) t.join();
+    _workers.clear();
+  }
+
+  size_t workers() const { return _workers.size(); }
+
+  // Empile un échantillon (O(1)) ; en asynchrone, réveille un worker tous les
+  // hop_size échantillons une fois la fenêtre pleine
+  void push(double x) {
+    std::lock_guard<std::mutex> lk(_mx);
+    _ring.push(x);
+    _n_samples++;
+    _since_hop++;
+    if (_async && _ring.full() && _since_hop >= _hop) {
+      _since_hop = 0;
+      _pending_seq++;
+      _cv.notify_one();
+    }
+  }
+
+  // Chemin synchrone : copie de la fenêtre si elle est pleine et qu'un pas
+  // s'est écoulé, sinon l'état ("buffering" / "hop") est écrit dans status
+  bool take_window(std::vector<double> &window, SpectrumResult &r, nlohmann::json &status) {
+    std::lock_guard<std::mutex> lk(_mx);
+    if (!_ring.full()) {
+      status["status"] = "buffering";
+      status["filled"] = _ring.size();
+      status["need"]   = _ring.data.size();
+      return false;
+    }
+    if (_since_hop < _hop) {
+      status["status"] = "hop";
+      return false;
+    }
+    _since_hop = 0;
+    _ring.snapshot(window);
+    r.n_samples = _n_samples;
+    r.fs        = _fs;
+    return true;
+  }
+
+  // Chemin asynchrone : résultat terminé le plus récent (les plus anciens sont
+  // comptés "stale"), sinon l'état ("computing" / "buffering") dans status
+  bool take_result(SpectrumResult &r, nlohmann::json &status) {
+    std::lock_guard<std::mutex> lk(_mx);
+    bool fresh = false;
+    if (!_results.empty()) {
+      auto newest = std::max_element(_results.begin(), _results.end(),
+        [](const SpectrumResult &a, const SpectrumResult &b) { return a.seq < b.seq; });
+      fresh = newest->seq > _last_seq_out;
+      if (fresh) { r = std::move(*newest); _last_seq_out = r.seq; }
+      _stale_results += _results.size() - (fresh ? 1 : 0);
+      _results.clear();
+    }
+    if (!fresh) {
+      status["status"] = _ring.full() ? "computing" : "buffering";
+      status["filled"] = _ring.size();
+      status["need"]   = _ring.data.size();
+    }
+    return fresh;
+  }
+
+  // Bloc "pipeline" de la sortie
+  nlohmann::json stats() const {
+    return {
+      {"workers", _workers.size()},
+      {"dropped_windows", _dropped_windows.load()},
+      {"dropped_results", _dropped_results.load()},
+      {"stale_results", _stale_results.load()}
+    };
+  }
+
+  uint64_t dropped_windows() const { return _dropped_windows.load(); }
+  uint64_t dropped_results() const { return _dropped_results.load(); }
+
+private:
+  // Worker : prend la fenêtre la plus récente, calcule hors verrou, dépose le
+  // résultat dans une file bornée (la plus ancienne entrée est jetée si pleine)
+  void worker_loop() {
+    std::vector<double> window;
+    SpectrumScratch scratch;
+    std::unique_lock<std::mutex> lk(_mx);
+    while (true) {
+      _cv.wait(lk, [this]() { return _stop || _pending_seq > _taken_seq; });
+      if (_stop) return;
+
+      _dropped_windows += _pending_seq - _taken_seq - 1; // fenêtres jamais calculées
+      _taken_seq = _pending_seq;
+      SpectrumResult r;
+      r.seq       = _taken_seq;
+      r.n_samples = _n_samples;
+      r.fs        = _fs;
+      _ring.snapshot(window);
+      const uint64_t gen = _gen;
+
+      lk.unlock();
+      r.bands = _compute(window, r.fs, scratch);
+      lk.lock();
+
+      if (gen != _gen) continue; // reconfiguré pendant le calcul
+      _results.push_back(std::move(r));
+      if (_results.size() > _result_cap) { _results.pop_front(); _dropped_results++; }
+    }
+  }
+
+  std::mutex _mx;
+  std::condition_variable _cv;
+  std::vector<std::thread> _workers;
+  Compute  _compute;
+  SampleRing _ring;
+  std::deque<SpectrumResult> _results;
+  size_t   _hop{1}, _result_cap{4};
+  double   _fs{0.0};
+  bool     _stop{false}, _async{false};
+  uint64_t _gen{0};
+  uint64_t _n_samples{0};
+  size_t   _since_hop{0};
+  uint64_t _pending_seq{0}, _taken_seq{0}, _last_seq_out{0};
+  std::atomic<uint64_t> _dropped_windows{0}, _dropped_results{0}, _stale_results{0};
+};
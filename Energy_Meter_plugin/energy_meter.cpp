@@ -0,0 +1,571 @@
+// Filter MADS : comptage d'énergie incrémental (P_W -> kWh) par machine, par
+// poste et par opération détectée, avec points de reprise sur disque
+#include <filter.hpp>
+#include <nlohmann/json.hpp>
+#include <pugg/Kernel.h>
+
+#include <vector>
+#include <cmath>
+#include <string>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using json   = nlohmann::json;
+using std::string;
+using std::vector;
+
+#ifndef PLUGIN_NAME
+#define PLUGIN_NAME "energy_meter"
+#endif
+
+// ----------- Outils horaires ---------------------------------------------------
+// "HH:MM" ou "HH:MM:SS" -> secondes depuis minuit (-1 si invalide)
+static double parse_clock(const string &s) {
+  int h = 0, m = 0, sec = 0;
+  const int n = std::sscanf(s.c_str(), "%d:%d:%d", &h, &m, &sec);
+  if (n < 2 || h < 0 || h > 23 || m < 0 || m > 59 || sec < 0 || sec > 59) return -1.0;
+  return h * 3600.0 + m * 60.0 + sec;
+}
+
+// secondes depuis minuit -> "HH:MM:SS"
+static string clock_of_day(double s) {
+  const long t = std::lround(std::fmod(std::max(0.0, s), 86400.0));
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "%02ld:%02ld:%02ld", t / 3600, (t / 60) % 60, t % 60);
+  return buf;
+}
+
+// date locale d'un instant du jour, décalée de day_shift jours -> "AAAA-MM-JJ"
+static string local_date(std::time_t day, int day_shift) {
+  std::time_t t = day + std::time_t(day_shift) * 86400;
+  std::tm tm{};
+  localtime_r(&t, &tm);
+  char buf[16];
+  std::strftime(buf, sizeof(buf), "%Y-%m-%d", &tm);
+  return buf;
+}
+
+// ----------- Postes de travail ---------------------------------------------------
+// Liste triée de débuts de poste ; un poste dure jusqu'au début du suivant, le
+// dernier déborde sur le lendemain jusqu'au premier (poste de nuit).
+struct ShiftTable {
+  vector<std::pair<double, string>> starts;
+
+  void configure(const json &cfg) {
+    starts.clear();
+    if (cfg.is_array()) {
+      for (const auto &s : cfg) {
+        if (!s.is_object() || !s.contains("name") || !s.contains("start")) continue;
+        const double t = parse_clock(s["start"].get<string>());
+        if (t >= 0) starts.emplace_back(t, s["name"].get<string>());
+      }
+    }
+    if (starts.empty()) starts.emplace_back(0.0, "jour");
+    std::sort(starts.begin(), starts.end());
+  }
+
+  // indice du poste à l'heure tod ; day_shift = -1 si le poste a commencé la veille
+  size_t at(double tod, int &day_shift) const {
+    day_shift = 0;
+    if (tod < starts.front().first) { day_shift = -1; return starts.size() - 1; }
+    size_t i = 0;
+    while (i + 1 < starts.size() && tod >= starts[i + 1].first) ++i;
+    return i;
+  }
+};
+
+// ----------- Compteur d'une machine -------------------------------------------------
+// Intégration trapèze entre deux échantillons successifs : O(1) par échantillon.
+struct MachineMeter {
+  string id;
+
+  // dernier échantillon intégré (instant source en s, puissance en W)
+  double last_t{NAN}, last_p{NAN};
+
+  // totaux (J et s)
+  double total_J{0}, idle_J{0}, ops_J{0};
+  double metered_s{0}, gap_s{0};                   // gap_s : trous vers l'avant seulement
+  uint64_t samples{0}, gaps{0}, rejected{0};
+  uint64_t clock_resets{0};                        // horloge source revenue en arrière
+
+  // poste courant ; shift_idx / last_clock / day (non sauvegardés) : le jour
+  // avance quand l'horloge source repasse par minuit
+  int    shift_idx{-1};
+  double last_clock{NAN};
+  std::time_t day{0};
+  string shift_name, shift_date;
+  double shift_J{0}, shift_s{0};
+  uint64_t shift_ops{0};
+
+  // opération courante (hystérésis op_on_W / op_off_W)
+  bool   in_op{false};
+  uint64_t op_seq{0};
+  double op_start{0}, op_J{0}, op_s{0}, op_peak{0}, op_below_s{0};
+
+  json to_json() const {
+    return {
+      {"last_t", std::isnan(last_t) ? json(nullptr) : json(last_t)},
+      {"last_p", std::isnan(last_p) ? json(nullptr) : json(last_p)},
+      {"total_J", total_J}, {"idle_J", idle_J}, {"ops_J", ops_J},
+      {"metered_s", metered_s}, {"gap_s", gap_s},
+      {"samples", samples}, {"gaps", gaps}, {"rejected", rejected},
+      {"clock_resets", clock_resets},
+      {"shift_name", shift_name}, {"shift_date", shift_date},
+      {"shift_J", shift_J}, {"shift_s", shift_s}, {"shift_ops", shift_ops},
+      {"in_op", in_op}, {"op_seq", op_seq}, {"op_start", op_start},
+      {"op_J", op_J}, {"op_s", op_s}, {"op_peak", op_peak}, {"op_below_s", op_below_s}
+    };
+  }
+
+  void from_json(const json &j) {
+    auto num = [&](const char *k) {
+      auto it = j.find(k);
+      return (it != j.end() && it->is_number()) ? it->get<double>() : NAN;
+    };
+    auto nz = [&](const char *k) { const double v = num(k); return std::isnan(v) ? 0.0 : v; };
+    last_t = num("last_t");       last_p = num("last_p");
+    total_J = nz("total_J");      idle_J = nz("idle_J");   ops_J = nz("ops_J");
+    metered_s = nz("metered_s");  gap_s = nz("gap_s");
+    samples = uint64_t(nz("samples")); gaps = uint64_t(nz("gaps")); rejected = uint64_t(nz("rejected"));
+    clock_resets = uint64_t(nz("clock_resets"));
+    shift_name = j.value("shift_name", string(""));
+    shift_date = j.value("shift_date", string(""));
+    shift_J = nz("shift_J");      shift_s = nz("shift_s");  shift_ops = uint64_t(nz("shift_ops"));
+    in_op = j.value("in_op", false);
+    op_seq = uint64_t(nz("op_seq"));
+    op_start = nz("op_start");    op_J = nz("op_J");        op_s = nz("op_s");
+    op_peak = nz("op_peak");      op_below_s = nz("op_below_s");
+  }
+};
+
+static double kwh(double joules) { return joules / 3.6e6; }
+
+// ----------- Filter class -----------------------------------------------------
+class EnergyMeter : public Filter<json, json> {
+public:
+  // Nom du plugin pour MADS
+  string kind() override { return PLUGIN_NAME; }
+
+  // Lecture & application des paramètres (depuis mads.ini)
+  void set_params(void const *params) override {
+    Filter::set_params(params);
+    _params.merge_patch(*(json*)params);
+
+    // Entrée : lot buffered_sp (message.data = [[t_rel, ch0, ch1, ...]]) ou champs isolés
+    _batch_key     = _params.value("batch_key", string("data"));
+    _power_channel = std::max(0, _params.value("power_channel", 1)); // P_W sur l'Arduino 2
+    _power_key     = _params.value("power_key", string("P_W"));   // message non groupé
+    _ts_key        = _params.value("ts_key", string("millis"));
+    _ts_scale      = _params.value("ts_scale", 1.0e-3);           // millis -> s
+    _machine_name  = _params.value("machine_name", string("machine"));
+
+    // Intégration : au-delà de max_gap_s entre deux échantillons, rien n'est
+    // intégré (capteur muet, redémarrage) ; l'écart est compté à part
+    _max_gap_s     = _params.value("max_gap_s", 2.0);
+
+    // Détection d'opération : P >= op_on_W ouvre, P < op_off_W pendant op_off_s ferme ;
+    // une opération plus courte que op_min_s reste comptée mais n'est pas rapportée
+    _op_on_W       = _params.value("op_on_W", 20.0);
+    _op_off_W      = std::min(_op_on_W, _params.value("op_off_W", 0.8 * _op_on_W));
+    _op_off_s      = std::max(0.0, _params.value("op_off_s", 1.0));
+    _op_min_s      = std::max(0.0, _params.value("op_min_s", 5.0));
+
+    // Postes : [{name = "matin", start = "06:00"}, ...] ; par défaut un seul poste "jour"
+    _shifts.configure(_params.value("shifts", json::array()));
+    _shift_clock   = _params.value("shift_clock", string("source")); // "source" (t_rel) | "local"
+
+    _publish_s     = std::max(0.1, _params.value("publish_s", 10.0));
+    _max_reports   = std::max(1, _params.value("max_reports", 256));
+    _max_machines  = std::max(1, _params.value("max_machines", 256));
+
+    // Point de reprise : JSON réécrit toutes les checkpoint_s (tmp + rename)
+    _ckpt_path     = _params.value("checkpoint_path", string(""));
+    _ckpt_s        = std::max(1.0, _params.value("checkpoint_s", 60.0));
+    if (_machines.empty() && !_ckpt_path.empty()) load_checkpoint();
+
+    _last_publish = _last_ckpt = steady_now();
+  }
+
+  // On reçoit un lot de buffered_sp ou un message isolé de l'Arduino 2
+  return_type load_data(json const &data, string topic = "") override {
+    try {
+      const json* root = &data;
+      if (data.contains("message") && data["message"].is_object()) {
+        root = &data["message"];
+      }
+
+      // Commande : {"energy_cmd": "reset"|"checkpoint"}
+      if (root->contains("energy_cmd") && (*root)["energy_cmd"].is_string()) {
+        energy_command((*root)["energy_cmd"].get<string>());
+        return return_type::success;
+      }
+
+      MachineMeter *m = meter(machine_id(data, *root));
+      if (!m) {
+        _error = "trop de machines (max_machines)";
+        return return_type::error;
+      }
+
+      // 1) lot : [t_rel, ch0, ch1, ...], t_rel en s depuis minuit (horloge source)
+      auto bit = root->find(_batch_key);
+      if (bit != root->end() && bit->is_array()) {
+        for (const auto &r : *bit) {
+          if (!r.is_array() || r.size() <= size_t(_power_channel) + 1 ||
+              !r[0].is_number() || !r[_power_channel + 1].is_number()) {
+            m->rejected++;
+            continue;
+          }
+          const double t = r[0].get<double>();
+          push(*m, t, r[_power_channel + 1].get<double>(), t);
+        }
+        return return_type::success;
+      }
+
+      // 2) message isolé : P_W + horodatage ts_key (sinon horloge de réception)
+      auto pit = root->find(_power_key);
+      if (pit == root->end() || !pit->is_number()) {
+        _error = _power_key + " manquant";
+        return return_type::error;
+      }
+      auto ts = root->find(_ts_key);
+      const double t = (ts != root->end() && ts->is_number())
+                     ? ts->get<double>() * _ts_scale
+                     : std::chrono::duration<double>(steady_now().time_since_epoch()).count();
+      push(*m, t, pit->get<double>(), NAN);
+      return return_type::success;
+
+    } catch (const std::exception &e) {
+      _error = e.what();
+      return return_type::error;
+    }
+  }
+
+  // Totaux toutes les publish_s (ou dès qu'un rapport d'opération/poste est prêt)
+  return_type process(json &out) override {
+    out.clear();
+    const auto now = steady_now();
+    if (!_ckpt_path.empty() && now - _last_ckpt >= seconds_d(_ckpt_s)) {
+      save_checkpoint();
+      _last_ckpt = now;
+    }
+    if (_machines.empty() ||
+        (_ops_done.empty() && _shifts_done.empty() && now - _last_publish < seconds_d(_publish_s)))
+      return return_type::retry;
+    _last_publish = now;
+
+    json machines = json::object();
+    for (const auto &kv : _machines) {
+      const MachineMeter &m = kv.second;
+      json entry = {
+        {"total_kWh", kwh(m.total_J)},
+        {"idle_kWh", kwh(m.idle_J)},
+        {"ops_kWh", kwh(m.ops_J)},
+        {"power_W", std::isnan(m.last_p) ? json(nullptr) : json(m.last_p)},
+        {"metered_s", m.metered_s},
+        {"gaps", m.gaps},
+        {"gap_s", m.gap_s},
+        {"clock_resets", m.clock_resets},
+        {"samples", m.samples},
+        {"shift", {
+          {"name", m.shift_name}, {"date", m.shift_date},
+          {"kWh", kwh(m.shift_J)}, {"duration_s", m.shift_s}, {"operations", m.shift_ops}
+        }}
+      };
+      if (m.in_op)
+        entry["operation"] = {
+          {"id", m.op_seq}, {"start", clock_of_day(m.op_start)},
+          {"kWh", kwh(m.op_J)}, {"duration_s", m.op_s}, {"peak_W", m.op_peak}
+        };
+      machines[kv.first] = std::move(entry);
+    }
+    out["energy"] = std::move(machines);
+    if (!_ops_done.empty())    out["operations"] = json(vector<json>(_ops_done.begin(), _ops_done.end()));
+    if (!_shifts_done.empty()) out["shifts"]     = json(vector<json>(_shifts_done.begin(), _shifts_done.end()));
+    _ops_done.clear();
+    _shifts_done.clear();
+    return return_type::success;
+  }
+
+  ~EnergyMeter() override {
+    if (!_ckpt_path.empty() && !_machines.empty()) save_checkpoint();
+  }
+
+  // reset : remet tous les compteurs à zéro ; checkpoint : écrit l'état tout de suite
+  void energy_command(const string &cmd) {
+    if (cmd == "reset") { _machines.clear(); _ops_done.clear(); _shifts_done.clear(); }
+    else if (cmd == "checkpoint" && !_ckpt_path.empty()) save_checkpoint();
+  }
+
+  std::map<string,string> info() override {
+    double total = 0;
+    uint64_t gaps = 0, rejected = 0, resets = 0;
+    for (const auto &kv : _machines) {
+      total += kv.second.total_J;
+      gaps += kv.second.gaps;
+      rejected += kv.second.rejected;
+      resets += kv.second.clock_resets;
+    }
+    return {
+      {"machines", std::to_string(_machines.size())},
+      {"total_kWh", std::to_string(kwh(total))},
+      {"max_gap_s", std::to_string(_max_gap_s)},
+      {"op_on_W", std::to_string(_op_on_W)},
+      {"op_off_W", std::to_string(_op_off_W)},
+      {"shifts", std::to_string(_shifts.starts.size())},
+      {"gaps", std::to_string(gaps)},
+      {"rejected", std::to_string(rejected)},
+      {"clock_resets", std::to_string(resets)},
+      {"checkpoint_path", _ckpt_path},
+      {"checkpoint_failed", std::to_string(_ckpt_failed)}
+    };
+  }
+
+private:
+  using steady = std::chrono::steady_clock;
+  using seconds_d = std::chrono::duration<double>;
+  static steady::time_point steady_now() { return steady::now(); }
+
+  // identifiant de la source : agent_id, machine_name ou hostname (message, sinon racine)
+  string machine_id(const json &input, const json &root) const {
+    for (const char *k : {"agent_id", "machine_name", "hostname"}) {
+      const json *node = root.contains(k) ? &root : &input;
+      if (node->contains(k) && (*node)[k].is_string()) return (*node)[k].get<string>();
+    }
+    return _machine_name;
+  }
+
+  MachineMeter *meter(const string &id) {
+    auto it = _machines.find(id);
+    if (it != _machines.end()) return &it->second;
+    if (_machines.size() >= size_t(_max_machines)) return nullptr;
+    MachineMeter &m = _machines[id];
+    m.id = id;
+    return &m;
+  }
+
+  // Un échantillon : trapèze depuis le précédent, puis poste et opération.
+  // tod = heure source (t_rel) pour les postes, NaN si la source n'en donne pas.
+  void push(MachineMeter &m, double t, double p, double tod) {
+    if (!std::isfinite(p) || !std::isfinite(t)) { m.rejected++; return; }
+    m.samples++;
+
+    double dt = std::isnan(m.last_t) ? NAN : t - m.last_t;
+    if (!std::isnan(tod) && dt < -43200.0) dt += 86400.0;   // t_rel repasse par minuit
+    if (!std::isnan(dt) && dt <= 0.0 && dt > -_max_gap_s) {
+      m.rejected++;                                         // doublon / désordre
+      return;
+    }
+
+    const double clock = (_shift_clock == "local" || std::isnan(tod)) ? local_clock() : tod;
+    update_shift(m, clock);
+
+    if (!std::isnan(dt) && dt > 0.0 && dt <= _max_gap_s) {
+      const double e = 0.5 * (m.last_p + p) * dt;
+      m.total_J   += e;
+      m.shift_J   += e;
+      m.metered_s += dt;
+      m.shift_s   += dt;
+      if (m.in_op) { m.ops_J += e; m.op_J += e; m.op_s += dt; }
+      else         m.idle_J += e;
+      update_operation(m, p, dt, clock);
+    } else {
+      // trou vers l'avant : durée non mesurée ; retour en arrière (reset de millis,
+      // horloge de repli après redémarrage) : rien de perdu à compter, on repart de t
+      if (!std::isnan(dt) && dt > 0.0)      { m.gaps++; m.gap_s += dt; }
+      else if (!std::isnan(dt) && dt < 0.0) m.clock_resets++;
+      // une opération ne survit pas à un trou : on la clôt à son dernier échantillon
+      if (m.in_op) close_operation(m);
+      update_operation(m, p, 0.0, clock);
+    }
+    m.last_t = t;
+    m.last_p = p;
+  }
+
+  // Hystérésis : ouverture au-dessus de op_on_W, fermeture après op_off_s sous op_off_W
+  void update_operation(MachineMeter &m, double p, double dt, double clock) {
+    if (!m.in_op) {
+      if (p < _op_on_W) return;
+      m.in_op = true;
+      m.op_seq++;
+      m.op_start = clock;
+      m.op_J = m.op_s = m.op_below_s = 0.0;
+      m.op_peak = p;
+      return;
+    }
+    m.op_peak = std::max(m.op_peak, p);
+    if (p >= _op_off_W) { m.op_below_s = 0.0; return; }
+    m.op_below_s += dt;
+    if (m.op_below_s >= _op_off_s) close_operation(m);
+  }
+
+  void close_operation(MachineMeter &m) {
+    m.in_op = false;
+    if (m.op_s < _op_min_s) return;
+    m.shift_ops++;
+    push_report(_ops_done, {
+      {"machine", m.id},
+      {"id", m.op_seq},
+      {"shift", m.shift_name},
+      {"date", m.shift_date},
+      {"start", clock_of_day(m.op_start)},
+      {"duration_s", m.op_s},
+      {"kWh", kwh(m.op_J)},
+      {"mean_W", m.op_s > 0 ? m.op_J / m.op_s : 0.0},
+      {"peak_W", m.op_peak}
+    });
+  }
+
+  // Changement de poste : on rapporte le poste écoulé et on repart de zéro.
+  // La date n'est relue qu'au franchissement d'un début de poste (ou de minuit).
+  void update_shift(MachineMeter &m, double clock) {
+    int day_shift = 0;
+    const size_t i = _shifts.at(clock, day_shift);
+    const double start = _shifts.starts[i].first;
+    bool crossed = false;
+    if (std::isnan(m.last_clock)) {
+      m.day = std::time(nullptr);
+    } else {
+      const bool wrapped = clock + 43200.0 < m.last_clock;
+      if (wrapped) m.day += 86400;
+      crossed = wrapped ? (clock >= start || m.last_clock < start)
+                        : (m.last_clock < start && clock >= start);
+    }
+    m.last_clock = clock;
+    if (int(i) == m.shift_idx && !crossed) return;
+    m.shift_idx = int(i);
+    const string &name = _shifts.starts[i].second;
+    const string date  = local_date(m.day, day_shift);
+    if (name == m.shift_name && date == m.shift_date) return;
+    if (!m.shift_name.empty() && m.shift_s > 0.0) {
+      push_report(_shifts_done, {
+        {"machine", m.id},
+        {"shift", m.shift_name},
+        {"date", m.shift_date},
+        {"kWh", kwh(m.shift_J)},
+        {"duration_s", m.shift_s},
+        {"operations", m.shift_ops}
+      });
+    }
+    m.shift_name = name;
+    m.shift_date = date;
+    m.shift_J = m.shift_s = 0.0;
+    m.shift_ops = 0;
+  }
+
+  // heure locale (s depuis minuit) : horloge des postes quand la source n'en
+  // donne pas ; localtime_r n'est rappelé qu'une fois par heure
+  double local_clock() {
+    const std::time_t t = std::time(nullptr);
+    if (t < _lc_base || t - _lc_base >= 3600) {
+      std::tm tm{};
+      localtime_r(&t, &tm);
+      _lc_base = t;
+      _lc_tod  = tm.tm_hour * 3600.0 + tm.tm_min * 60.0 + tm.tm_sec;
+    }
+    return std::fmod(_lc_tod + double(t - _lc_base), 86400.0);
+  }
+
+  void push_report(std::deque<json> &q, json r) {
+    if (q.size() >= size_t(_max_reports)) q.pop_front();
+    q.push_back(std::move(r));
+  }
+
+  // ----------- Point de reprise -----------------------------------------------
+  // Écriture durable : fichier temporaire + fsync, l'ancien point gardé en .bak,
+  // rename, puis fsync du dossier. Une coupure laisse toujours un fichier
+  // complet (le nouveau, ou le précédent en .bak).
+  void save_checkpoint() {
+    json j = {{"version", 1}, {"machines", json::object()}};
+    for (const auto &kv : _machines) j["machines"][kv.first] = kv.second.to_json();
+    const string body = j.dump();
+    const string tmp = _ckpt_path + ".tmp", bak = _ckpt_path + ".bak";
+
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) { _ckpt_failed++; return; }
+    bool ok = true;
+    for (size_t off = 0; ok && off < body.size();) {
+      const ssize_t n = ::write(fd, body.data() + off, body.size() - off);
+      ok = n > 0;
+      if (ok) off += size_t(n);
+    }
+    ok = ok && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok) { std::remove(tmp.c_str()); _ckpt_failed++; return; }
+
+    if (::access(_ckpt_path.c_str(), F_OK) == 0 && std::rename(_ckpt_path.c_str(), bak.c_str()) != 0) {
+      _ckpt_failed++;
+      return;
+    }
+    if (std::rename(tmp.c_str(), _ckpt_path.c_str()) != 0) { _ckpt_failed++; return; }
+
+    const size_t slash = _ckpt_path.find_last_of('/');
+    const string dir = slash == string::npos ? "." : (slash == 0 ? "/" : _ckpt_path.substr(0, slash));
+    const int dfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0) { ::fsync(dfd); ::close(dfd); }
+  }
+
+  // Point de reprise, sinon le précédent (.bak) ; aucun lisible : compteurs à zéro
+  void load_checkpoint() {
+    for (const string &path : {_ckpt_path, _ckpt_path + ".bak"}) {
+      std::ifstream f(path);
+      if (!f) continue;
+      try {
+        const json j = json::parse(f);
+        if (j.value("version", 0) != 1 || !j.contains("machines") || !j["machines"].is_object())
+          throw std::runtime_error("format inconnu");
+        std::map<string, MachineMeter> machines;
+        for (const auto &kv : j["machines"].items()) {
+          MachineMeter &m = machines[kv.key()];
+          m.from_json(kv.value());
+          m.id = kv.key();
+        }
+        _machines = std::move(machines);
+        std::cerr << "[" << PLUGIN_NAME << "] reprise de " << _machines.size()
+                  << " compteur(s) depuis " << path << std::endl;
+        return;
+      } catch (const std::exception &e) {
+        std::cerr << "[" << PLUGIN_NAME << "] point de reprise illisible (" << path << ") : "
+                  << e.what() << std::endl;
+      }
+    }
+  }
+
+  // Paramètres
+  json   _params;
+  string _batch_key{"data"};
+  int    _power_channel{1};
+  string _power_key{"P_W"};
+  string _ts_key{"millis"};
+  double _ts_scale{1.0e-3};
+  string _machine_name{"machine"};
+  double _max_gap_s{2.0};
+  double _op_on_W{20.0}, _op_off_W{16.0}, _op_off_s{1.0}, _op_min_s{5.0};
+  ShiftTable _shifts;
+  string _shift_clock{"source"};
+  double _publish_s{10.0};
+  int    _max_reports{256};
+  int    _max_machines{256};
+  string _ckpt_path;
+  double _ckpt_s{60.0};
+
+  // État
+  std::map<string, MachineMeter> _machines;
+  std::deque<json> _ops_done, _shifts_done;
+  steady::time_point _last_publish{}, _last_ckpt{};
+  uint64_t _ckpt_failed{0};
+  std::time_t _lc_base{0};
+  double _lc_tod{0};
+};
+
+// Enregistre ce filtre auprès de MADS
+INSTALL_FILTER_DRIVER(EnergyMeter, json, json)
@@ -10,6 +10,11 @@
 #include <string>
 #include <map>
 #include <algorithm>
+#include <cstdint>
+#include <complex>
+#include <iostream>
+
+#include "spectrum_common.hpp"
 
 using std::size_t;
 using std::string;
@@ -42,6 +47,103 @@ static void dft_real(const vector<double> &x, double fs,
   }
 }
 
+// FFT radix-2 itérative : plan (bit-reverse + twiddles) calculé une fois pour
+// N et réutilisé pour toutes les transformées directes et inverses.
+struct FftPlan {
+  size_t n{0};
+  vector<size_t> rev;
+  vector<std::complex<double>> tw;  // exp(-2iπk/N), k < N/2
+
+  static bool is_pow2(size_t v) { return v >= 2 && (v & (v - 1)) == 0; }
+
+  void init(size_t N) {
+    if (N == n) return;
+    n = N;
+    rev.assign(n, 0);
+    size_t bits = 0;
+    while ((size_t(1) << bits) < n) bits++;
+    for (size_t i = 0; i < n; ++i) {
+      size_t r = 0;
+      for (size_t b = 0; b < bits; ++b) if (i & (size_t(1) << b)) r |= size_t(1) << (bits - 1 - b);
+      rev[i] = r;
+    }
+    tw.resize(n / 2);
+    for (size_t k = 0; k < n / 2; ++k)
+      tw[k] = std::polar(1.0, -2.0 * M_PI * double(k) / double(n));
+  }
+
+  // Transformée en place ; l'inverse n'est pas normalisée (diviser par N)
+  void run(vector<std::complex<double>> &a, bool inverse = false) const {
+    for (size_t i = 0; i < n; ++i) if (i < rev[i]) std::swap(a[i], a[rev[i]]);
+    for (size_t len = 2; len <= n; len <<= 1) {
+      const size_t half = len / 2, step = n / len;
+      for (size_t i = 0; i < n; i += len) {
+        for (size_t j = 0; j < half; ++j) {
+          const std::complex<double> w = inverse ? std::conj(tw[j * step]) : tw[j * step];
+          const std::complex<double> u = a[i + j], v = a[i + j + half] * w;
+          a[i + j]        = u + v;
+          a[i + j + half] = u - v;
+        }
+      }
+    }
+  }
+};
+
+// Spectre d'amplitude mono-latéral d'un signal complexe déjà transformé
+static void fft_magnitudes(const vector<std::complex<double>> &X, size_t N, double fs,
+                           vector<double> &freqs, vector<double> &mag) {
+  const size_t K = N / 2 + 1;
+  freqs.resize(K);
+  mag.resize(K);
+  for (size_t k = 0; k < K; ++k) {
+    double amp = std::abs(X[k]) / double(N);
+    if (k != 0 && k != (K - 1)) amp *= 2.0; // mono-sided
+    mag[k]   = amp;
+    freqs[k] = (fs * k) / double(N);
+  }
+}
+
+// Même résultat que dft_real, en O(N log N) si N est une puissance de 2
+static void spectrum_real(const FftPlan &plan, const vector<double> &x, double fs,
+                          vector<double> &freqs, vector<double> &mag, SpectrumScratch &w) {
+  const size_t N = x.size();
+  if (plan.n != N) { dft_real(x, fs, freqs, mag); return; }
+  w.a.resize(N);
+  for (size_t i = 0; i < N; ++i) w.a[i] = x[i];
+  plan.run(w.a);
+  fft_magnitudes(w.a, N, fs, freqs, mag);
+}
+
+// Analyse d'enveloppe : passe-bande [f_lo, f_hi] autour de la résonance +
+// signal analytique (Hilbert par FFT) dans la même opération, |z(t)|, puis
+// spectre de l'enveloppe. 3 FFT de taille N avec le même plan.
+static void envelope_spectrum(const FftPlan &plan, const vector<double> &x, double fs,
+                              double f_lo, double f_hi,
+                              vector<double> &freqs, vector<double> &mag, SpectrumScratch &w) {
+  const size_t N = plan.n;
+  w.a.resize(N);
+  for (size_t i = 0; i < N; ++i) w.a[i] = x[i];
+  plan.run(w.a);
+
+  // Fréquences négatives à 0, positives dans la bande x2 (Nyquist x1)
+  for (size_t k = 0; k < N; ++k) {
+    const double f = (fs * k) / double(N);
+    if (k == 0 || k > N / 2 || f < f_lo || f > f_hi) w.a[k] = 0.0;
+    else if (k < N / 2) w.a[k] *= 2.0;
+  }
+  plan.run(w.a, true);
+
+  // Enveloppe |z|/N, centrée (on retire la composante continue)
+  w.b.resize(N);
+  double mean = 0.0;
+  for (size_t i = 0; i < N; ++i) { const double e = std::abs(w.a[i]) / double(N); w.b[i] = e; mean += e; }
+  mean /= double(N);
+  for (size_t i = 0; i < N; ++i) w.b[i] -= mean;
+
+  plan.run(w.b);
+  fft_magnitudes(w.b, N, fs, freqs, mag);
+}
+
 //Agrégation en bandes fixes
 static json bands_aggregate(const vector<double> &freqs,
                             const vector<double> &mag,
@@ -70,6 +172,7 @@ public:
   void set_params(void const *params) override {
     Filter::set_params(params);
     _params.merge_patch(*(json*)params);
+    _pipe.stop();
 
     _axis         = _params.value("axis", string("x")); // "x"|"y"|"z"
     _fs           = _params.value("fs", 2000.0);        // Hz
@@ -79,10 +182,49 @@ public:
     _band_w       = 10.0;                               // bandes 10 Hz
     _thresh       = _params.value("threshold", 0.5);   // seuil d’alarme
     _confirm_wins = _params.value("confirm_windows", 2);// nb fenêtres > seuil
+    _hop_size     = std::max(1, _params.value("hop_size", 1)); // échantillons entre 2 spectres
 
-    _buf.clear();
-    _buf.reserve(_win_size);
+    // Mode d'analyse : "fft" (spectre complet) | "goertzel" (fréquences ciblées)
+    //                  | "envelope" (démodulation autour d'une résonance)
+    _mode  = _params.value("mode", string("fft"));
+    _tones = goertzel_tones(_params, _fs, _thresh, _bank);
+
+    // Mode enveloppe : bande de la résonance à démoduler
+    _env_f_low  = _params.value("env_f_low", _fs / 4.0);
+    _env_f_high = _params.value("env_f_high", _fs / 2.0);
+    if (_mode == "envelope" && !FftPlan::is_pow2(_win_size)) {
+      size_t n = 2;
+      while (n < _win_size) n <<= 1;
+      std::cerr << "[" << PLUGIN_NAME << "] envelope: win_size " << _win_size
+                << " -> " << n << " (puissance de 2)" << std::endl;
+      _win_size = n;
+    }
+    // Plan FFT réutilisé (FFT directe + inverse) si win_size est une puissance de 2
+    _plan = FftPlan{};
+    if (FftPlan::is_pow2(_win_size)) _plan.init(_win_size);
+
+    // Baseline par bande + alarme z-score avec hystérésis (remplace le seuil global)
+    _baseline.configure(_params, _confirm_wins, _fmin, _fmax, PLUGIN_NAME);
+
+    // Historique spectrogramme (waterfall) : "none" | "rows" | "tiles"
+    _history.configure(_params);
+
+    // Calcul asynchrone : load_data n'attend jamais la transformée
+    _async      = _params.value("async", false);
+    _n_workers  = std::max(1, _params.value("workers", 1));
+    _result_cap = std::max(1, _params.value("result_queue", 4));
+
+    _pipe.configure(_win_size, _hop_size, _fs);
     _over_count = 0;
+
+    // Anneau borné : history_s à la cadence des spectres (fs / hop_size)
+    _history.reset(_fs / double(_hop_size), band_count(_fmin, _fmax, _band_w));
+
+    if (_async && _mode != "goertzel")
+      _pipe.start(_n_workers, _result_cap,
+                  [this](const vector<double> &x, double fs, SpectrumScratch &w) {
+                    return compute_bands(x, fs, w);
+                  });
   }
 
   string kind() override { return PLUGIN_NAME; }
@@ -95,6 +237,11 @@ public:
         return return_type::error;
       }
       const auto &msg = data["message"];
+      // Pilotage de la baseline : {"baseline_cmd": "freeze"|"resume"|"relearn"|"save"}
+      if (msg.contains("baseline_cmd") && msg["baseline_cmd"].is_string()) {
+        _baseline.command(msg["baseline_cmd"].get<string>());
+        return return_type::success;
+      }
       if (!msg.contains("acceleration") || !msg["acceleration"].is_object()) {
         _error = "message JSON incomplet (acceleration manquante)";
         return return_type::error;
@@ -110,8 +257,14 @@ public:
 
       double a_sel = (_axis == "x") ? ax : (_axis == "y" ? ay : az);
 
-      _buf.push_back(a_sel);
-      if (_buf.size() > _win_size) _buf.erase(_buf.begin()); // fenêtre glissante
+      if (_mode == "goertzel") {
+        _bank.update(a_sel);
+        return return_type::success;
+      }
+
+      // fenêtre glissante O(1) ; en asynchrone un worker est réveillé
+      // tous les hop_size échantillons une fois la fenêtre pleine
+      _pipe.push(a_sel);
       return return_type::success;
 
     } catch (const std::exception &e) {
@@ -120,30 +273,57 @@ public:
     }
   }
 
+  ~AccelFft() override {
+    _pipe.stop();
+    _baseline.save_on_exit();
+  }
+
+  // Spectre (FFT si win_size = 2^k) ou spectre de l'enveloppe, puis bandes.
+  // Le plan est partagé en lecture seule, les tampons sont propres à l'appelant.
+  json compute_bands(const vector<double> &x, double fs, SpectrumScratch &w) const {
+    if (_mode == "envelope")
+      envelope_spectrum(_plan, x, fs, _env_f_low, _env_f_high, w.freqs, w.mag, w);
+    else
+      spectrum_real(_plan, x, fs, w.freqs, w.mag, w);
+    return bands_aggregate(w.freqs, w.mag, _fmin, _fmax, _band_w);
+  }
+
   // Quand la fenêtre est pleine : DFT -> bandes -> max -> alarme
   return_type process(json &out) override {
     out.clear();
-    if (_buf.size() < _win_size) {
-      out["status"] = "buffering";
-      out["filled"] = _buf.size();
-      out["need"]   = _win_size;
-      return return_type::retry;
-    }
+    if (_mode == "goertzel") return process_goertzel(out);
 
-    vector<double> freqs, mag;
-    dft_real(_buf, _fs, freqs, mag);
+    // Asynchrone : dernier spectre terminé par un worker
+    SpectrumResult r;
+    if (_async) {
+      if (!_pipe.take_result(r, out)) return return_type::retry;
+      return publish(r, out);
+    }
 
-    json bands = bands_aggregate(freqs, mag, _fmin, _fmax, _band_w);
+    if (!_pipe.take_window(_window, r, out)) return return_type::retry;
+    r.bands = compute_bands(_window, r.fs, _scratch);
+    return publish(r, out);
+  }
 
+  // Détection, baseline, historique et sortie JSON pour un spectre en bandes
+  return_type publish(SpectrumResult &r, json &out) {
+    json &bands = r.bands;
+    _band_vals.resize(bands.size());
     double max_band = 0.0;
-    for (auto &b : bands) {
-      max_band = std::max(max_band, b["mean_mag"].get<double>());
+    for (size_t i = 0; i < bands.size(); ++i) {
+      _band_vals[i] = bands[i]["mean_mag"].get<double>();
+      max_band = std::max(max_band, _band_vals[i]);
     }
     const bool over = (max_band > _thresh);
     if (over) _over_count++; else _over_count = 0;
-    const bool alarm = (_over_count >= _confirm_wins);
+    bool alarm = (_over_count >= _confirm_wins);
+
+    // Baseline apprise : alarme sur z-score par bande avec hystérésis
+    json baseline;
+    if (_baseline.enabled) alarm = _baseline.step(_band_vals, bands, baseline);
 
     out["accel_fft"] = {
+      {"mode",       _mode},
       {"axis",       _axis},
       {"fs",         _fs},
       {"win_size",   _win_size},
@@ -156,6 +336,49 @@ public:
       {"alarm", alarm},
       {"bands", bands}
     };
+    if (_baseline.enabled) out["accel_fft"]["baseline"] = baseline;
+    if (_mode == "envelope") out["accel_fft"]["envelope_band"] = {_env_f_low, _env_f_high};
+    if (_async) out["accel_fft"]["pipeline"] = _pipe.stats();
+
+    // Historique : ligne O(bandes) + export waterfall (lignes ou tuiles)
+    _history.push(_band_vals, double(r.n_samples) / r.fs, out["accel_fft"]);
+    return return_type::success;
+  }
+
+  // Mode Goertzel : un résultat par bloc de win_size échantillons, alarme par ton
+  return_type process_goertzel(json &out) {
+    if (_bank.n < _win_size) {
+      out["status"] = "buffering";
+      out["filled"] = _bank.n;
+      out["need"]   = _win_size;
+      return return_type::retry;
+    }
+
+    json tones = json::array();
+    double max_mag = 0.0;
+    bool any_alarm = false;
+    for (auto &t : _tones) {
+      double mag = 0.0;
+      for (size_t m = t.bin_lo; m < t.bin_hi; ++m) mag = std::max(mag, _bank.magnitude(m));
+      if (mag > t.threshold) t.over_count++; else t.over_count = 0;
+      const bool alarm = (t.over_count >= _confirm_wins);
+      any_alarm = any_alarm || alarm;
+      max_mag = std::max(max_mag, mag);
+      tones.push_back({ {"label", t.label}, {"f_hz", t.f_hz}, {"mag", mag},
+                        {"threshold", t.threshold}, {"alarm", alarm} });
+    }
+    _bank.reset();
+
+    out["accel_fft"] = {
+      {"mode", "goertzel"},
+      {"axis", _axis},
+      {"fs", _fs},
+      {"win_size", _win_size},
+      {"confirm_windows", _confirm_wins},
+      {"max_tone_mag", max_mag},
+      {"alarm", any_alarm},
+      {"tones", tones}
+    };
     return return_type::success;
   }
 
@@ -168,21 +391,59 @@ public:
       {"f_max", std::to_string(_fmax)},
       {"band_width", std::to_string(_band_w)},
       {"threshold", std::to_string(_thresh)},
-      {"confirm_windows", std::to_string(_confirm_wins)}
+      {"confirm_windows", std::to_string(_confirm_wins)},
+      {"hop_size", std::to_string(_hop_size)},
+      {"mode", _mode},
+      {"async", _async ? std::to_string(_n_workers) + " worker(s)" : "off"},
+      {"dropped_windows", std::to_string(_pipe.dropped_windows())},
+      {"dropped_results", std::to_string(_pipe.dropped_results())},
+      {"fft", _plan.n == _win_size ? "radix-2" : "dft"},
+      {"env_f_low", std::to_string(_env_f_low)},
+      {"env_f_high", std::to_string(_env_f_high)},
+      {"baseline", _baseline.enabled ? (_baseline.model.frozen ? "frozen" : "on") : "off"},
+      {"baseline_windows", std::to_string(_baseline.model.n)},
+      {"tones", std::to_string(_tones.size())},
+      {"waterfall", _history.mode},
+      {"history_rows", std::to_string(_history.ring.rows)},
+      {"history_bytes", std::to_string(_history.ring.data.size() * sizeof(float))}
     };
   }
 
 private:
+  json   _params;
+
   string _axis{"x"};
-  double _fs{2000.0);
+  double _fs{2000.0};
   size_t _win_size{256};
-  double _fmin{10.0},max{1000.0};
+  double _fmin{10.0}, _fmax{1000.0};
   double _band_w{10.0};
-  double _thresh{0.5);
+  double _thresh{0.5};
   int    _confirm_wins{2};
+  int    _hop_size{1};
+  string _mode{"fft"};
+
+  // Enveloppe + FFT
+  double _env_f_low{500.0}, _env_f_high{1000.0};
+  FftPlan        _plan;
+
+  // Baseline
+  BaselineAlarm  _baseline;
+  vector<double> _band_vals;
+
+  // Waterfall
+  SpectrumHistory _history;
+
+  // Pipeline asynchrone (fenêtre glissante, workers, résultats)
+  bool   _async{false};
+  int    _n_workers{1};
+  int    _result_cap{4};
+  SpectrumPipeline _pipe;
+  vector<double>   _window;
+  SpectrumScratch  _scratch;
 
-  vector<double> _buf;
   int _over_count{0};
+  GoertzelBank         _bank;
+  vector<GoertzelTone> _tones;
 };
 
 INSTALL_FILTER_DRIVER(AccelFft, json, json)
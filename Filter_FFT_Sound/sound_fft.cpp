@@ -8,6 +8,12 @@
 #include <string>
 #include <map>
 #include <algorithm>
+#include <cstdint>
+#include <complex>
+#include <numeric>
+#include <iostream>
+
+#include "spectrum_common.hpp"
 
 using json   = nlohmann::json;
 using std::string;
@@ -59,6 +65,305 @@ static json bands_aggregate(const vector<double> &freqs,
   return out;
 }
 
+// ----------- Front-end multirate : rééchantillonnage polyphase L/M ------------
+// Filtre FIR prototype (sinc fenêtré Blackman) à la cadence L*fs_in, rangé par
+// phases : chaque sortie ne coûte que `taps` multiplications. Couvre
+// l'interpolation (L>M), la décimation anti-repliement (L<M) et le cas rationnel.
+struct PolyphaseResampler {
+  int    L{1}, M{1};
+  size_t taps{0};               // coefficients par phase
+  vector<double> h;             // h[p*taps + j] = L * proto[p + j*L]
+  vector<double> hist;          // ligne à retard doublée (2*taps) -> lecture contiguë
+  size_t pos{0};
+  int    phase{0};
+
+  bool passthrough() const { return L == 1 && M == 1; }
+
+  // cutoff_hz : fréquence de coupure (≤ min(fs_in, fs_out)/2)
+  void design(int L_, int M_, size_t taps_per_phase, double fs_in, double cutoff_hz) {
+    L = std::max(1, L_); M = std::max(1, M_);
+    pos = 0; phase = 0;
+    if (passthrough()) { taps = 0; h.clear(); hist.clear(); return; }
+
+    // en décimation la bande de transition rétrécit d'un facteur M/L
+    taps = std::max<size_t>(2, taps_per_phase) * size_t(std::max(1, (M + L - 1) / L));
+    const size_t N = taps * size_t(L);
+    const double fc = cutoff_hz / (double(L) * fs_in); // cycles / échantillon suréchantillonné
+    const double c  = 0.5 * double(N - 1);
+    vector<double> proto(N);
+    for (size_t i = 0; i < N; ++i) {
+      const double x = double(i) - c;
+      const double sinc = (x == 0.0) ? 2.0 * fc : std::sin(2.0 * M_PI * fc * x) / (M_PI * x);
+      const double w = 0.42 - 0.5 * std::cos(2.0 * M_PI * i / (N - 1))
+                            + 0.08 * std::cos(4.0 * M_PI * i / (N - 1));
+      proto[i] = sinc * w;
+    }
+    // gain DC unitaire par phase (≈ L au total)
+    double sum = 0.0;
+    for (double v : proto) sum += v;
+    h.assign(N, 0.0);
+    for (int p = 0; p < L; ++p)
+      for (size_t j = 0; j < taps; ++j)
+        h[size_t(p) * taps + j] = proto[size_t(p) + j * size_t(L)] * double(L) / sum;
+    hist.assign(2 * taps, 0.0);
+  }
+
+  // Pousse un échantillon d'entrée, appelle emit(y) pour chaque sortie produite
+  template <class Emit>
+  void push(double x, Emit &&emit) {
+    if (passthrough()) { emit(x); return; }
+    pos = (pos + taps - 1) % taps;
+    hist[pos] = hist[pos + taps] = x;
+    const double *w = &hist[pos];           // w[j] = x[n-j]
+    while (phase < L) {
+      const double *hp = &h[size_t(phase) * taps];
+      double acc = 0.0;
+      for (size_t j = 0; j < taps; ++j) acc += hp[j] * w[j];
+      emit(acc);
+      phase += M;
+    }
+    phase -= L;
+  }
+};
+
+// Meilleure fraction L/M ≈ fs_out/fs_in avec L, M ≤ max_lm
+static void rational_ratio(double fs_in, double fs_out, int max_lm, int &L, int &M) {
+  const long a = std::lround(fs_out), b = std::lround(fs_in);
+  if (a > 0 && b > 0) {
+    long g = std::gcd(a, b);
+    if (a / g <= max_lm && b / g <= max_lm) { L = int(a / g); M = int(b / g); return; }
+  }
+  const double r = fs_out / fs_in;
+  double best = 1e300;
+  L = M = 1;
+  for (int m = 1; m <= max_lm; ++m) {
+    const long l = std::lround(r * m);
+    if (l < 1 || l > max_lm) continue;
+    const double err = std::fabs(double(l) / m - r);
+    if (err < best - 1e-12) { best = err; L = int(l); M = m; }
+  }
+}
+
+// Estimation de la cadence réelle à partir des horodatages (ex. "millis")
+struct RateEstimator {
+  size_t block{256};            // nb d'échantillons par mesure
+  double fs_est{0.0};           // cadence estimée (EMA), 0 = pas encore
+  double t0{0.0};
+  size_t n{0};
+  bool   started{false};
+
+  void reset(size_t blk) { block = std::max<size_t>(8, blk); fs_est = 0.0; n = 0; started = false; }
+
+  // Retourne true quand une nouvelle estimation est disponible
+  bool add(double t_s) {
+    if (!started || t_s <= t0) { t0 = t_s; n = 0; started = true; return false; } // départ ou reset horloge
+    if (++n < block) return false;
+    const double fs = double(n) / (t_s - t0);
+    fs_est = (fs_est <= 0.0) ? fs : 0.8 * fs_est + 0.2 * fs;
+    t0 = t_s; n = 0;
+    return true;
+  }
+};
+
+// ----------- Sonomètre : pondérations A/C, Leq, Lmax, octaves ----------------
+// Tout est incrémental par blocs d'échantillons : chaque bloc traverse les
+// cascades de biquads (A, C, octaves), on accumule les énergies et on publie
+// un rapport à chaque fin de période Leq, sans jamais recalculer de fenêtre.
+struct Biquad {
+  double b0{1}, b1{0}, b2{0}, a1{0}, a2{0};
+  double z1{0}, z2{0};
+
+  // Forme transposée directe II, en place sur un bloc
+  void run(double *x, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      const double in = x[i];
+      const double y  = b0 * in + z1;
+      z1 = b1 * in - a1 * y + z2;
+      z2 = b2 * in - a2 * y;
+      x[i] = y;
+    }
+  }
+
+  std::complex<double> response(double f, double fs) const {
+    const std::complex<double> z1c = std::polar(1.0, -2.0 * M_PI * f / fs), z2c = z1c * z1c;
+    return (b0 + b1 * z1c + b2 * z2c) / (1.0 + a1 * z1c + a2 * z2c);
+  }
+};
+
+// Section analogique (b2 s² + b1 s + b0)/(a2 s² + a1 s + a0) -> biquad par
+// transformation bilinéaire (K = 2 fs)
+static Biquad bilinear(double b2, double b1, double b0, double a2, double a1, double a0, double fs) {
+  const double K = 2.0 * fs, K2 = K * K;
+  const double A0 = a2 * K2 + a1 * K + a0;
+  Biquad q;
+  q.b0 = (b2 * K2 + b1 * K + b0) / A0;
+  q.b1 = (2.0 * b0 - 2.0 * b2 * K2) / A0;
+  q.b2 = (b2 * K2 - b1 * K + b0) / A0;
+  q.a1 = (2.0 * a0 - 2.0 * a2 * K2) / A0;
+  q.a2 = (a2 * K2 - a1 * K + a0) / A0;
+  return q;
+}
+
+// Module de la pondération analogique (IEC 61672), normalisée à 1 kHz
+static double weighting_analog(char kind, double f) {
+  const double f1 = 20.598997, f2 = 107.65265, f3 = 737.86223, f4 = 12194.217;
+  auto raw = [&](double x) {
+    const double x2 = x * x;
+    if (kind == 'C') return (f4 * f4 * x2) / ((x2 + f1 * f1) * (x2 + f4 * f4));
+    return (f4 * f4 * x2 * x2) /
+           ((x2 + f1 * f1) * std::sqrt((x2 + f2 * f2) * (x2 + f3 * f3)) * (x2 + f4 * f4));
+  };
+  return raw(f) / raw(1000.0);
+}
+
+// Cascade de biquads A ou C. Le gain est ajusté pour coller à la courbe
+// analogique à f_ref = min(1 kHz, fs/8) (1 kHz peut dépasser Nyquist à 500 Hz).
+static vector<Biquad> weighting_filter(char kind, double fs) {
+  const double w1 = 2 * M_PI * 20.598997, w2 = 2 * M_PI * 107.65265,
+               w3 = 2 * M_PI * 737.86223, w4 = 2 * M_PI * 12194.217;
+  vector<Biquad> c;
+  c.push_back(bilinear(1, 0, 0, 1, 2 * w1, w1 * w1, fs));            // s²/(s+w1)²
+  if (kind == 'A') c.push_back(bilinear(1, 0, 0, 1, w2 + w3, w2 * w3, fs)); // s²/((s+w2)(s+w3))
+  c.push_back(bilinear(0, 0, 1, 1, 2 * w4, w4 * w4, fs));            // 1/(s+w4)²
+
+  const double f_ref = std::min(1000.0, fs / 8.0);
+  std::complex<double> h = 1.0;
+  for (auto &q : c) h *= q.response(f_ref, fs);
+  const double g = weighting_analog(kind, f_ref) / std::abs(h);
+  c[0].b0 *= g; c[0].b1 *= g; c[0].b2 *= g;
+  return c;
+}
+
+// Banc d'octaves : un passe-bande RBJ (Q = √2) appliqué deux fois par bande,
+// stocké en structure de tableaux -> la boucle sur les bandes est vectorisable.
+// Fréquences médianes exactes en base 2 (1000 · 2^k, IEC 61260), publiées avec
+// leur libellé nominal. Le filtre lui-même n'est PAS conforme à une classe
+// IEC 61260 (gabarit non vérifié) : niveaux d'octave indicatifs.
+struct OctaveBank {
+  vector<double> fc;                             // fréquences médianes exactes
+  vector<double> nominal;                        // libellés nominaux (31.5, 63, 125...)
+  vector<double> b0, b2, a1, a2;                 // b1 = 0 pour un BPF RBJ
+  vector<double> s1z1, s1z2, s2z1, s2z2, energy; // états des 2 étages + énergie
+
+  void configure(double fs) {
+    static const double kNominal[] = {31.5, 63, 125, 250, 500, 1000, 2000, 4000, 8000, 16000, 31500};
+    fc.clear(); nominal.clear();
+    for (int k = -5; k <= 5; ++k) {
+      const double f = 1000.0 * std::pow(2.0, k);
+      if (f * std::sqrt(2.0) >= 0.45 * fs) break;
+      fc.push_back(f);
+      nominal.push_back(kNominal[k + 5]);
+    }
+    const size_t B = fc.size();
+    b0.resize(B); b2.resize(B); a1.resize(B); a2.resize(B);
+    for (size_t i = 0; i < B; ++i) {
+      const double w = 2.0 * M_PI * fc[i] / fs, alpha = std::sin(w) / (2.0 * std::sqrt(2.0));
+      const double a0 = 1.0 + alpha;
+      b0[i] = alpha / a0; b2[i] = -alpha / a0;
+      a1[i] = -2.0 * std::cos(w) / a0; a2[i] = (1.0 - alpha) / a0;
+    }
+    s1z1.assign(B, 0.0); s1z2.assign(B, 0.0); s2z1.assign(B, 0.0); s2z2.assign(B, 0.0);
+    energy.assign(B, 0.0);
+  }
+
+  void run(const double *x, size_t n) {
+    const size_t B = fc.size();
+    for (size_t k = 0; k < n; ++k) {
+      const double in = x[k];
+      for (size_t i = 0; i < B; ++i) {
+        const double y1 = b0[i] * in + s1z1[i];
+        s1z1[i] = -a1[i] * y1 + s1z2[i];
+        s1z2[i] = b2[i] * in - a2[i] * y1;
+        const double y2 = b0[i] * y1 + s2z1[i];
+        s2z1[i] = -a1[i] * y2 + s2z2[i];
+        s2z2[i] = b2[i] * y1 - a2[i] * y2;
+        energy[i] += y2 * y2;
+      }
+    }
+  }
+};
+
+struct SoundLevelMeter {
+  static constexpr double p0 = 20e-6;  // Pa
+
+  double fs{500.0};
+  size_t block{64};
+  size_t period{500};                  // échantillons par période Leq
+  bool   octaves{true};
+  vector<Biquad> wa, wc;
+  OctaveBank bank;
+  vector<double> blk, ya, yc;
+
+  // accumulateurs de la période courante
+  double ea{0}, ec{0}, ez{0};
+  double fast_a{0}, fast_k{0}, lmax_fast_a{0}, peak_pa{0};
+  size_t n{0};
+  uint64_t periods{0};
+
+  bool ready{false};
+  json report;
+
+  void configure(double fs_, size_t block_, double period_s, bool oct) {
+    fs = fs_; block = std::max<size_t>(1, block_); octaves = oct;
+    period = std::max<size_t>(1, size_t(std::llround(period_s * fs)));
+    wa = weighting_filter('A', fs);
+    wc = weighting_filter('C', fs);
+    if (octaves) bank.configure(fs); else bank = OctaveBank{};
+    fast_k = 1.0 - std::exp(-1.0 / (0.125 * fs));   // constante "Fast" 125 ms
+    blk.clear(); blk.reserve(block);
+    ea = ec = ez = 0.0; fast_a = lmax_fast_a = peak_pa = 0.0; n = 0; periods = 0;
+    ready = false;
+  }
+
+  void push(double pa) {
+    blk.push_back(pa);
+    if (blk.size() >= block) flush();
+  }
+
+  void flush() {
+    const size_t m = blk.size();
+    if (m == 0) return;
+    ya = blk; yc = blk;
+    for (auto &q : wa) q.run(ya.data(), m);
+    for (auto &q : wc) q.run(yc.data(), m);
+    if (octaves) bank.run(blk.data(), m);
+    for (size_t i = 0; i < m; ++i) {
+      ez += blk[i] * blk[i];
+      ec += yc[i] * yc[i];
+      const double a2 = ya[i] * ya[i];
+      ea += a2;
+      fast_a += fast_k * (a2 - fast_a);
+      lmax_fast_a = std::max(lmax_fast_a, fast_a);
+      peak_pa = std::max(peak_pa, std::fabs(blk[i]));
+      if (++n >= period) close_period();
+    }
+    blk.clear();
+  }
+
+  static double db(double ms) { return 10.0 * std::log10(std::max(ms, 1e-30) / (p0 * p0)); }
+
+  void close_period() {
+    const double N = double(n);
+    json oct = json::array();
+    for (size_t i = 0; i < bank.fc.size(); ++i) {
+      oct.push_back({ {"fc", bank.nominal[i]}, {"fm", bank.fc[i]}, {"L", db(bank.energy[i] / N)} });
+      bank.energy[i] = 0.0;
+    }
+    report = {
+      {"period_s", N / fs},
+      {"LAeq", db(ea / N)},
+      {"LCeq", db(ec / N)},
+      {"LZeq", db(ez / N)},
+      {"LAFmax", db(lmax_fast_a)},
+      {"LZpeak", db(peak_pa * peak_pa)},
+      {"octaves", oct},
+      {"periods", ++periods}
+    };
+    ready = true;
+    ea = ec = ez = 0.0; lmax_fast_a = 0.0; peak_pa = 0.0; n = 0;
+  }
+};
+
 // ----------- Filter class -----------------------------------------------------
 class SoundFft : public Filter<json, json> {
 public:
@@ -69,6 +374,7 @@ public:
   void set_params(void const *params) override {
     Filter::set_params(params);
     _params.merge_patch(*(json*)params);
+    _pipe.stop();
 
     _fs           = _params.value("fs", 8000.0);      // Hz (son → kHz typiquement)
     _win_size     = _params.value("win_size", 256);  // taille fenêtre
@@ -76,11 +382,78 @@ public:
     _fmax         = _params.value("f_max", _fs/2.0);  // ≤ Nyquist
     _threshold    = _params.value("threshold", 0.25);  // seuil d’alarme (mag bande)
     _confirm_wins = _params.value("confirm_windows", 2);
+    _hop_size     = std::max(1, _params.value("hop_size", 1)); // nb d'échantillons entre 2 spectres
+
+    // Mode d'analyse : "fft" (spectre complet) | "goertzel" (fréquences ciblées)
+    _mode  = _params.value("mode", string("fft"));
+
+    // Front-end multirate
+    _analysis_fs   = _params.value("analysis_fs", 0.0);     // 0 = cadence d'entrée (ou auto)
+    _decimate_auto = _params.value("decimate_auto", true);  // fs analyse = min(fs entrée, 2.5 * f_max)
+    _estimate_fs   = _params.value("estimate_fs", true);    // cadence réelle via horodatages
+    _fs_tolerance  = _params.value("fs_tolerance", 0.05);   // écart relatif avant reconfig
+    _ts_key        = _params.value("ts_key", string("millis"));
+    _ts_scale      = _params.value("ts_scale", 1.0e-3);     // millis -> s
+    _rs_taps       = _params.value("resampler_taps", 16);   // coefficients par phase
+    _rs_max_lm     = _params.value("resampler_max_lm", 64);
+    _rate.reset(_params.value("fs_estimate_samples", 256));
+
+    // Sonomètre calibré (sur le signal brut, à la cadence d'entrée)
+    _metering      = _params.value("metering", false);
+    _cal_pa        = _params.value("cal_pa_per_count", 0.01);   // Pa par pas ADC
+    _cal_offset    = _params.value("cal_offset_counts", 512.0); // zéro acoustique (ADC)
+    _leq_period_s  = _params.value("leq_period_s", 1.0);
+    _meter_block   = _params.value("meter_block", 64);
+    _meter_octaves = _params.value("octave_bands", true);
+
+    // Calcul asynchrone : load_data n'attend jamais la transformée
+    _async       = _params.value("async", false);
+    _n_workers   = std::max(1, _params.value("workers", 1));
+    _result_cap  = std::max(1, _params.value("result_queue", 4));
+
+    // Baseline par bande + alarme z-score avec hystérésis (remplace le seuil global)
+    _baseline.configure(_params, _confirm_wins, _fmin, _fmax, PLUGIN_NAME);
 
-    // Buffer circulaire
-    _buf.clear();
-    _buf.reserve(_win_size);
+    // Historique spectrogramme (waterfall) : "none" | "rows" | "tiles"
+    _history.configure(_params);
+
+    configure_rates(_fs);
+    if (_async && _mode != "goertzel")
+      _pipe.start(_n_workers, _result_cap,
+                  [this](const vector<double> &x, double fs, SpectrumScratch &w) {
+                    return compute_bands(x, fs, w);
+                  });
+  }
+
+  // Dimensionne tout ce qui dépend des cadences : rééchantillonneur, banc de
+  // Goertzel, historique. Appelé au set_params puis si la cadence mesurée
+  // s'écarte de plus de fs_tolerance de la cadence supposée.
+  void configure_rates(double fs_in) {
+    _fs_in = fs_in;
+    // Sans analysis_fs on reste à la cadence d'entrée (jamais de suréchantillonnage),
+    // décimée jusqu'à 2.5 * f_max si decimate_auto ; seul analysis_fs peut l'augmenter
+    double fs_an = (_analysis_fs > 0.0) ? _analysis_fs : fs_in;
+    if (_analysis_fs <= 0.0 && _decimate_auto)
+      fs_an = std::min(fs_in, std::ceil(2.5 * _fmax));
+    if (std::fabs(fs_an - fs_in) <= 1e-9 * fs_in) {
+      _rs_L = _rs_M = 1;
+    } else {
+      rational_ratio(fs_in, fs_an, _rs_max_lm, _rs_L, _rs_M);
+    }
+    fs_an = fs_in * double(_rs_L) / double(_rs_M);
+    _resampler.design(_rs_L, _rs_M, size_t(_rs_taps), fs_in, 0.45 * std::min(fs_in, fs_an));
+    if (_metering) _meter.configure(fs_in, size_t(_meter_block), _leq_period_s, _meter_octaves);
+
+    _tones = goertzel_tones(_params, fs_an, _threshold, _bank);
+
+    // Buffer circulaire et cadence d'analyse (les workers éventuels les lisent
+    // sous le verrou du pipeline)
+    _fs_an = fs_an;
+    _pipe.configure(_win_size, _hop_size, _fs_an);
     _over_count = 0;
+
+    // Anneau borné : history_s à la cadence des spectres (fs / hop_size)
+    _history.reset(_fs_an / double(_hop_size), band_count(_fmin, _fmax, 10.0));
   }
 
   // On reçoit un JSON du topic (Ampere)
@@ -92,6 +465,12 @@ public:
         root = &data["message"];
       }
 
+      // Commande de pilotage de la baseline : {"baseline_cmd": "freeze"|"resume"|"relearn"|"save"}
+      if (root->contains("baseline_cmd") && (*root)["baseline_cmd"].is_string()) {
+        _baseline.command((*root)["baseline_cmd"].get<string>());
+        return return_type::success;
+      }
+
       // sound_level doit être un nombre (0..1023 typique)
       if (!root->contains("sound_level") || !(*root)["sound_level"].is_number()) {
         _error = "sound_level manquant";
@@ -102,10 +481,22 @@ public:
       const double raw = (*root)["sound_level"].get<double>();
       const double s   = std::clamp(raw / 1023.0, 0.0, 1.0);
 
-      // Empile dans le buffer glissant
-      _buf.push_back(s);
-      if (_buf.size() > _win_size) _buf.erase(_buf.begin());
+      // Cadence réelle : horodatage du message (ts_key, ex. "millis" Arduino)
+      auto ts = root->find(_ts_key);
+      if (_estimate_fs && ts != root->end() && ts->is_number()) {
+        if (_rate.add(ts->get<double>() * _ts_scale) &&
+            std::fabs(_rate.fs_est - _fs_in) > _fs_tolerance * _fs_in) {
+          std::cerr << "[" << PLUGIN_NAME << "] cadence mesurée " << _rate.fs_est
+                    << " Hz (supposée " << _fs_in << " Hz) -> reconfiguration" << std::endl;
+          configure_rates(std::round(_rate.fs_est));
+        }
+      }
+
+      // Sonomètre : ADC -> Pa, traité par blocs
+      if (_metering) _meter.push((raw - _cal_offset) * _cal_pa);
 
+      // Rééchantillonnage vers fs d'analyse (0, 1 ou plusieurs sorties)
+      _resampler.push(s, [this](double y) { push_analysis_sample(y); });
       return return_type::success;
 
     } catch (const std::exception &e) {
@@ -114,36 +505,85 @@ public:
     }
   }
 
-  // Quand la fenêtre est pleine : DFT -> bandes -> alarme
+  ~SoundFft() override {
+    _pipe.stop();
+    _baseline.save_on_exit();
+  }
+
+  // Échantillon à la cadence d'analyse (sortie du front-end multirate)
+  void push_analysis_sample(double s) {
+    // Mode Goertzel : mise à jour du banc, pas de buffer de fenêtre
+    if (_mode == "goertzel") {
+      _bank.update(s);
+      return;
+    }
+
+    // Buffer glissant O(1) ; en asynchrone un worker est réveillé tous les
+    // hop_size échantillons une fois la fenêtre pleine
+    _pipe.push(s);
+  }
+
+  // Spectre + agrégation en bandes d'une fenêtre (workers ou chemin synchrone)
+  json compute_bands(const vector<double> &x, double fs, SpectrumScratch &w) const {
+    dft_real(x, fs, w.freqs, w.mag);
+    return bands_aggregate(w.freqs, w.mag, _fmin, _fmax);
+  }
+
+  // Spectre (ou Goertzel) + rapport du sonomètre quand une période Leq se termine
   return_type process(json &out) override {
+    return_type rc = process_spectrum(out);
+    if (_metering && _meter.ready) {
+      if (rc == return_type::retry) { out = json::object(); rc = return_type::success; }
+      out["sound_level_meter"] = _meter.report;
+      _meter.ready = false;
+    }
+    return rc;
+  }
+
+  // Quand la fenêtre est pleine : DFT -> bandes -> alarme
+  return_type process_spectrum(json &out) {
     out.clear();
 
-    if (_buf.size() < _win_size) {
-      out["status"] = "buffering";
-      out["filled"] = _buf.size();
-      out["need"]   = _win_size;
-      return return_type::retry;
+    if (_mode == "goertzel") return process_goertzel(out);
+
+    // Asynchrone : on publie le dernier spectre terminé par un worker
+    SpectrumResult r;
+    if (_async) {
+      if (!_pipe.take_result(r, out)) return return_type::retry;
+      return publish(r, out);
     }
 
-    // 1) FFT (DFT simple)
-    vector<double> freqs, mag;
-    dft_real(_buf, _fs, freqs, mag);
+    // Un spectre tous les hop_size échantillons, fenêtre pleine
+    if (!_pipe.take_window(_window, r, out)) return return_type::retry;
 
-    // 2) Agrégation 10 Hz entre f_min et f_max
-    json bands = bands_aggregate(freqs, mag, _fmin, _fmax);
+    // 1) FFT (DFT simple) + 2) agrégation 10 Hz entre f_min et f_max
+    r.bands = compute_bands(_window, r.fs, _scratch);
+    return publish(r, out);
+  }
 
+  // Détection, baseline, historique et sortie JSON pour un spectre en bandes
+  return_type publish(SpectrumResult &r, json &out) {
+    json &bands = r.bands;
     // 3) Détection : bande maximale vs seuil
+    _band_vals.resize(bands.size());
     double max_band = 0.0;
-    for (auto &b : bands) {
-      max_band = std::max(max_band, b["mean_mag"].get<double>());
+    for (size_t i = 0; i < bands.size(); ++i) {
+      _band_vals[i] = bands[i]["mean_mag"].get<double>();
+      max_band = std::max(max_band, _band_vals[i]);
     }
     const bool over = (max_band > _threshold);
     if (over) _over_count++; else _over_count = 0;
-    const bool alarm = (_over_count >= _confirm_wins);
+    bool alarm = (_over_count >= _confirm_wins);
+
+    // 3b) Baseline apprise : l'alarme devient z-score par bande + hystérésis
+    json baseline;
+    if (_baseline.enabled) alarm = _baseline.step(_band_vals, bands, baseline);
 
     // 4) Sortie JSON (consommée par sink GUI)
     out["sound_fft"] = {
-      {"fs", _fs},
+      {"fs", _fs_an},
+      {"fs_in", _fs_in},
+      {"resample", {_rs_L, _rs_M}},
       {"win_size", _win_size},
       {"f_min", _fmin},
       {"f_max", _fmax},
@@ -154,6 +594,48 @@ public:
       {"alarm", alarm},
       {"bands", bands}
     };
+    if (_baseline.enabled) out["sound_fft"]["baseline"] = baseline;
+    if (_async) out["sound_fft"]["pipeline"] = _pipe.stats();
+
+    // 5) Historique : ajout de la ligne O(bandes) + export waterfall
+    _history.push(_band_vals, double(r.n_samples) / r.fs, out["sound_fft"]);
+    return return_type::success;
+  }
+
+  // Mode Goertzel : un résultat par bloc de win_size échantillons, alarme par ton
+  return_type process_goertzel(json &out) {
+    if (_bank.n < _win_size) {
+      out["status"] = "buffering";
+      out["filled"] = _bank.n;
+      out["need"]   = _win_size;
+      return return_type::retry;
+    }
+
+    json tones = json::array();
+    double max_mag = 0.0;
+    bool any_alarm = false;
+    for (auto &t : _tones) {
+      double mag = 0.0;
+      for (size_t m = t.bin_lo; m < t.bin_hi; ++m) mag = std::max(mag, _bank.magnitude(m));
+      if (mag > t.threshold) t.over_count++; else t.over_count = 0;
+      const bool alarm = (t.over_count >= _confirm_wins);
+      any_alarm = any_alarm || alarm;
+      max_mag = std::max(max_mag, mag);
+      tones.push_back({ {"label", t.label}, {"f_hz", t.f_hz}, {"mag", mag},
+                        {"threshold", t.threshold}, {"alarm", alarm} });
+    }
+    _bank.reset();
+
+    out["sound_fft"] = {
+      {"mode", "goertzel"},
+      {"fs", _fs_an},
+      {"fs_in", _fs_in},
+      {"win_size", _win_size},
+      {"confirm_windows", _confirm_wins},
+      {"max_tone_mag", max_mag},
+      {"alarm", any_alarm},
+      {"tones", tones}
+    };
     return return_type::success;
   }
 
@@ -161,12 +643,29 @@ public:
   std::map<string,string> info() override {
     return {
       {"fs", std::to_string(_fs)},
+      {"fs_in", std::to_string(_fs_in)},
+      {"fs_analysis", std::to_string(_fs_an)},
+      {"resample", std::to_string(_rs_L) + "/" + std::to_string(_rs_M)},
       {"win_size", std::to_string(_win_size)},
       {"f_min", std::to_string(_fmin)},
       {"f_max", std::to_string(_fmax)},
       {"band_width", "10"},
       {"threshold", std::to_string(_threshold)},
-      {"confirm_windows", std::to_string(_confirm_wins)}
+      {"confirm_windows", std::to_string(_confirm_wins)},
+      {"hop_size", std::to_string(_hop_size)},
+      {"mode", _mode},
+      {"metering", _metering ? "on" : "off"},
+      {"cal_pa_per_count", std::to_string(_cal_pa)},
+      {"leq_period_s", std::to_string(_leq_period_s)},
+      {"async", _async ? std::to_string(_n_workers) + " worker(s)" : "off"},
+      {"dropped_windows", std::to_string(_pipe.dropped_windows())},
+      {"dropped_results", std::to_string(_pipe.dropped_results())},
+      {"baseline", _baseline.enabled ? (_baseline.model.frozen ? "frozen" : "on") : "off"},
+      {"baseline_windows", std::to_string(_baseline.model.n)},
+      {"tones", std::to_string(_tones.size())},
+      {"waterfall", _history.mode},
+      {"history_rows", std::to_string(_history.ring.rows)},
+      {"history_bytes", std::to_string(_history.ring.data.size() * sizeof(float))}
     };
   }
 
@@ -179,10 +678,52 @@ private:
   double _fmin{0.0}, _fmax{4000.0};
   double _threshold{0.25};
   int    _confirm_wins{2};
+  int    _hop_size{1};
+  string _mode{"fft"};
+
+  // Front-end multirate
+  double _analysis_fs{0.0};
+  bool   _decimate_auto{false};
+  bool   _estimate_fs{true};
+  double _fs_tolerance{0.05};
+  string _ts_key{"millis"};
+  double _ts_scale{1.0e-3};
+  int    _rs_taps{16};
+  int    _rs_max_lm{64};
+  double _fs_in{8000.0};   // cadence d'entrée (supposée puis mesurée)
+  double _fs_an{8000.0};   // cadence d'analyse (après rééchantillonnage)
+  int    _rs_L{1}, _rs_M{1};
+  PolyphaseResampler _resampler;
+  RateEstimator      _rate;
+
+  // Baseline
+  BaselineAlarm  _baseline;
+  vector<double> _band_vals;
+
+  // Waterfall
+  SpectrumHistory _history;
+
+  // Sonomètre
+  bool   _metering{false};
+  double _cal_pa{0.01};
+  double _cal_offset{512.0};
+  double _leq_period_s{1.0};
+  int    _meter_block{64};
+  bool   _meter_octaves{true};
+  SoundLevelMeter _meter;
+
+  // Pipeline asynchrone (fenêtre glissante, workers, résultats)
+  bool   _async{false};
+  int    _n_workers{1};
+  int    _result_cap{4};
+  SpectrumPipeline _pipe;
+  vector<double>   _window;
+  SpectrumScratch  _scratch;
 
   // État
-  vector<double> _buf;
   int _over_count{0};
+  GoertzelBank         _bank;
+  vector<GoertzelTone> _tones;
 };
 
 // Enregistre ce filtre auprès de MADS
@@ -0,0 +1,443 @@
+/*
+  Règles d'alerte d'overpower_email, compilées une fois (set_params) en un
+  programme plat : un tableau d'opérations évaluées dans l'ordre, chacune
+  avec un petit état incrémental (fenêtre glissante, hystérésis, maintien).
+  Coût par échantillon : O(nombre de règles), amorti.
+
+  mads.ini :
+    rules = [
+      { name = "surcharge", field = "power_W", above = 20, for_s = 2 },
+      { name = "pic",       field = "power_W", above = 35, clear_below = 28 },
+      { name = "rampe",     field = "power_W", rate_above = 50, window_s = 1 },
+      { name = "energie",   field = "power_W", energy_above = 50, window_s = 600 },
+      { name = "courant",   field = "current_A", above = 8, notify = false },
+      { name = "combo",     all = ["courant", "surcharge"] },
+    ]
+
+  Types (une seule condition par règle) :
+    above / below           niveau de la valeur
+    rate_above / rate_below dérivée (unité/s) sur window_s (défaut 1 s)
+    energy_above            intégrale (unité·h, ex. Wh pour power_W) sur window_s (défaut 3600 s)
+    all / any               combinaison de règles déclarées AVANT
+  Modificateurs :
+    clear_below / clear_above  seuil de retour (hystérésis), défaut = seuil
+    for_s                      la condition doit tenir for_s secondes
+    notify = false             règle intermédiaire (pas d'alerte, utilisable dans all/any)
+    unit                       affichée dans les messages
+
+  Lots buffered_sp (eval_batch) : une passe par colonne (scan_column) donne
+  pic, premier dépassement, durée au-delà du seuil et intégrale ; un niveau
+  compare le pic du lot et for_s porte sur la durée cumulée au-delà du seuil,
+  une dérivée utilise la moyenne du lot, une énergie l'intégrale exacte du lot.
+
+  Dérivées et énergies suivent l'horloge de la source quand l'appelant la
+  fournit (t_src / BatchView::src_shift), sinon l'instant de réception.
+  L'énergie est sommée dans kEnergyBuckets tranches de window_s / kEnergyBuckets :
+  état borné quelle que soit la cadence, la tranche la plus ancienne comptée au prorata.
+*/
+
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace alert_rules {
+
+using nlohmann::json;
+
+enum class Kind : uint8_t { Level, Rate, Energy, All, Any };
+
+struct Op {
+  Kind     kind{Kind::Level};
+  bool     above{true};     // sens du seuil
+  bool     notify{true};
+  int      field{-1};       // index dans Program::fields (Level / Rate / Energy)
+  double   on{0}, off{0};   // seuil de déclenchement / de retour
+  double   window_s{0};
+  double   for_s{0};
+  uint32_t ref_begin{0}, ref_count{0};   // All / Any : tranche de Program::refs
+};
+
+struct State {
+  bool   raw{false};        // condition (après hystérésis)
+  bool   active{false};     // condition tenue depuis for_s
+  double since{NAN};        // début de la condition
+  double metric{NAN};       // dernière grandeur comparée au seuil
+  double last_t{NAN}, last_v{NAN};
+  double sum{0};            // Energy : intégrale de la fenêtre
+  double held{0};           // Level sur lots : durée cumulée au-delà du seuil
+  std::deque<std::pair<double, double>> win;   // Rate : (t, v) ; Energy : (début de tranche, intégrale)
+};
+
+constexpr size_t kEnergyBuckets = 64;   // tranches d'une fenêtre d'énergie
+
+// Résumé d'une colonne de lot ; thr/above : seuil dont on mesure le dépassement
+struct ColumnScan {
+  uint32_t n{0};
+  double   min{NAN}, max{NAN}, mean{NAN}, last{NAN};
+  double   t_first{NAN}, t_last{NAN};
+  double   integral{0};       // trapèzes, unité·s
+  double   first_cross{NAN};  // instant du premier échantillon au-delà de thr
+  size_t   first_idx{0};      // son indice (n si aucun)
+  double   time_beyond{0};    // durée au-delà de thr (s)
+  bool     last_beyond{false};
+};
+
+// Une passe sur (t, x) ; quatre voies indépendantes et sans branche pour que le
+// compilateur vectorise (mêmes principes que column_stats de web_dashboard)
+inline ColumnScan scan_column(const double *t, const double *x, size_t n, double thr, bool above) {
+  ColumnScan c;
+  c.n = (uint32_t)n;
+  if (n == 0) return c;
+  const double sgn = above ? 1.0 : -1.0;   // x > thr  <=>  sgn*x > sgn*thr
+  const double sthr = sgn * thr;
+  double mn[4] = {x[0], x[0], x[0], x[0]}, mx[4] = {x[0], x[0], x[0], x[0]};
+  double sm[4] = {0, 0, 0, 0}, in[4] = {0, 0, 0, 0}, tb[4] = {0, 0, 0, 0};
+  size_t first[4] = {n, n, n, n};
+  // intervalles [i, i+1] : l'échantillon i compte pour dt = t[i+1] - t[i]
+  const size_t m = n - 1;
+  size_t i = 0;
+  for (; i + 4 <= m; i += 4) {
+    for (size_t k = 0; k < 4; ++k) {
+      const size_t j = i + k;
+      const double v = x[j], dt = t[j + 1] - t[j];
+      const bool b = sgn * v > sthr;
+      mn[k] = v < mn[k] ? v : mn[k];
+      mx[k] = v > mx[k] ? v : mx[k];
+      sm[k] += v;
+      in[k] += 0.5 * (v + x[j + 1]) * dt;
+      tb[k] += b ? dt : 0.0;
+      first[k] = (b && j < first[k]) ? j : first[k];
+    }
+  }
+  for (; i < m; ++i) {
+    const double v = x[i], dt = t[i + 1] - t[i];
+    const bool b = sgn * v > sthr;
+    mn[0] = v < mn[0] ? v : mn[0];
+    mx[0] = v > mx[0] ? v : mx[0];
+    sm[0] += v;
+    in[0] += 0.5 * (v + x[i + 1]) * dt;
+    tb[0] += b ? dt : 0.0;
+    first[0] = (b && i < first[0]) ? i : first[0];
+  }
+  // dernier échantillon : pas d'intervalle suivant, on lui donne le pas moyen
+  const double v = x[m];
+  const double dt_last = m > 0 ? (t[m] - t[0]) / double(m) : 0.0;
+  c.last_beyond = sgn * v > sthr;
+  c.min  = std::min(std::min(std::min(mn[0], mn[1]), std::min(mn[2], mn[3])), v);
+  c.max  = std::max(std::max(std::max(mx[0], mx[1]), std::max(mx[2], mx[3])), v);
+  c.mean = (sm[0] + sm[1] + sm[2] + sm[3] + v) / double(n);
+  c.last = v;
+  c.integral    = in[0] + in[1] + in[2] + in[3];
+  c.time_beyond = tb[0] + tb[1] + tb[2] + tb[3] + (c.last_beyond ? dt_last : 0.0);
+  size_t f = std::min(std::min(first[0], first[1]), std::min(first[2], first[3]));
+  if (f == n && c.last_beyond) f = m;
+  if (f < n) c.first_cross = t[f];
+  c.first_idx = f;
+  c.t_first = t[0];
+  c.t_last  = t[m];
+  return c;
+}
+
+// Lot de n échantillons : t partagé, une colonne par champ du programme (nullptr si absente)
+struct BatchView {
+  const double              *t{nullptr};
+  std::vector<const double *> x;
+  size_t                     n{0};
+  double                     src_shift{NAN};   // horloge source = t + src_shift (NaN : pas de source)
+};
+
+struct Program {
+  std::vector<std::string> fields;    // champs lus dans le message
+  std::vector<Op>          ops;
+  std::vector<uint32_t>    refs;
+  std::vector<std::string> names;     // par op
+  std::vector<std::string> details;   // texte lisible, par op
+  std::vector<std::string> units;
+  double max_gap_s{5.0};              // Energy : trou plus long = pas d'intégration
+
+  bool empty() const { return ops.empty(); }
+  std::vector<State> make_state() const { return std::vector<State>(ops.size()); }
+
+  // Un échantillon (values[i] = fields[i], NaN si absent) reçu à l'instant t (s).
+  // t_src : horloge de la source (s), pour dérivées et énergies ; NaN = t.
+  // Ajoute à active les règles notifiantes actives (le cooldown de l'appelant
+  // décide du renvoi tant que la condition dure).
+  void eval(std::vector<State> &st, double t, const double *values, std::vector<uint32_t> &active,
+            double t_src = NAN) const {
+    const double ts = std::isnan(t_src) ? t : t_src;
+    for (uint32_t i = 0; i < ops.size(); ++i) {
+      const Op &op = ops[i];
+      State &s = st[i];
+      double m = NAN;
+      switch (op.kind) {
+        case Kind::Level:
+          m = values[op.field];
+          break;
+        case Kind::Rate:
+          if (!std::isnan(values[op.field])) m = rate_push(op, s, ts, values[op.field]);
+          break;
+        case Kind::Energy: {
+          const double v = values[op.field];
+          if (std::isnan(v)) break;
+          double slice = NAN;
+          if (!std::isnan(s.last_t) && ts > s.last_t && ts - s.last_t <= max_gap_s)
+            slice = 0.5 * (v + s.last_v) * (ts - s.last_t);
+          s.last_v = v;
+          m = energy_push(op, s, ts, slice);
+          break;
+        }
+        case Kind::All:
+        case Kind::Any:
+          combine(op, st, s);
+          break;
+      }
+      if (op.kind != Kind::All && op.kind != Kind::Any) {
+        if (std::isnan(m)) continue;   // pas de donnée : état inchangé
+        compare(op, s, m);
+      }
+      settle(op, s, t, i, active);
+    }
+  }
+
+  // Un lot entier : O(n) par champ et par règle de niveau, sans boucle
+  // échantillon par échantillon sur tout le programme
+  void eval_batch(std::vector<State> &st, const BatchView &b, std::vector<uint32_t> &active) const {
+    if (b.n == 0) return;
+    const double t_end = b.t[b.n - 1];
+    const double sh    = std::isnan(b.src_shift) ? 0.0 : b.src_shift;   // -> horloge source
+    std::vector<ColumnScan> base(fields.size());   // résumé par champ, calculé au besoin
+    auto column = [&](int f) -> const ColumnScan & {
+      if (base[f].n == 0 && b.x[f]) base[f] = scan_column(b.t, b.x[f], b.n, NAN, true);
+      return base[f];
+    };
+    for (uint32_t i = 0; i < ops.size(); ++i) {
+      const Op &op = ops[i];
+      State &s = st[i];
+      if (op.kind == Kind::All || op.kind == Kind::Any) {
+        combine(op, st, s);
+        settle(op, s, t_end, i, active);
+        continue;
+      }
+      if (!b.x[op.field]) continue;   // champ absent du lot : état inchangé
+
+      if (op.kind == Kind::Level) {
+        // Hors épisode, l'épisode commence au premier dépassement de on ; il se
+        // mesure ensuite (durée, fin) au seuil de retour off, comme compare()
+        // pour un échantillon isolé : il ne finit que si la fin du lot repasse off.
+        const double *x = b.x[op.field];
+        size_t from = 0;
+        if (!s.raw) {
+          const ColumnScan c = scan_column(b.t, x, b.n, op.on, op.above);
+          s.metric = op.above ? c.max : c.min;
+          if (std::isnan(c.first_cross)) {
+            s.active = false; s.held = 0; s.since = NAN;
+            continue;
+          }
+          s.raw = true; s.held = 0; s.since = c.first_cross;
+          from = c.first_idx;
+        }
+        const ColumnScan e = scan_column(b.t + from, x + from, b.n - from, op.off, op.above);
+        if (from == 0) s.metric = op.above ? e.max : e.min;
+        s.held  += e.time_beyond;
+        s.active = !std::isnan(e.first_cross) && s.held >= op.for_s;
+        if (op.notify && s.active) active.push_back(i);
+        if (!e.last_beyond) { s.raw = false; s.held = 0; s.since = NAN; }   // l'épisode finit dans le lot
+        continue;
+      }
+
+      const ColumnScan &c = column(op.field);
+      double m = NAN;
+      if (op.kind == Kind::Rate) {
+        m = rate_push(op, s, 0.5 * (c.t_first + c.t_last) + sh, c.mean);
+      } else {   // Energy : intégrale exacte du lot + raccord avec le lot précédent
+        const double t0 = c.t_first + sh;
+        double slice = c.integral;
+        if (!std::isnan(s.last_t) && t0 > s.last_t && t0 - s.last_t <= max_gap_s)
+          slice += 0.5 * (b.x[op.field][0] + s.last_v) * (t0 - s.last_t);
+        s.last_v = c.last;
+        m = energy_push(op, s, c.t_last + sh, slice);
+      }
+      if (std::isnan(m)) continue;
+      compare(op, s, m);
+      settle(op, s, t_end, i, active);
+    }
+  }
+
+private:
+  // Rate : garde le plus récent point qui couvre encore toute la fenêtre
+  // (horloge revenue en arrière de plus de max_gap_s : source redémarrée, fenêtre vidée)
+  double rate_push(const Op &op, State &s, double t, double v) const {
+    if (!s.win.empty() && t < s.win.back().first - max_gap_s) s.win.clear();
+    s.win.emplace_back(t, v);
+    while (s.win.size() > 2 && t - s.win[1].first >= op.window_s) s.win.pop_front();
+    const double dt = t - s.win.front().first;
+    return dt > 0 ? (v - s.win.front().second) / dt : NAN;
+  }
+
+  // Energy : ajoute l'intégrale slice (NaN = trou, rien à intégrer) à la tranche
+  // de t et renvoie l'intégrale de la fenêtre. Au plus kEnergyBuckets + 1 tranches ;
+  // une tranche sort quand elle est entièrement hors de [t - window_s, t], la plus
+  // ancienne compte au prorata de sa partie encore dans la fenêtre.
+  double energy_push(const Op &op, State &s, double t, double slice) const {
+    if (!std::isnan(s.last_t) && t < s.last_t - max_gap_s) { s.win.clear(); s.sum = 0; }   // source redémarrée
+    s.last_t = t;
+    if (op.window_s <= 0) return 0.0;
+    const double w = op.window_s / double(kEnergyBuckets);
+    if (!std::isnan(slice)) {
+      const double start = std::floor(t / w) * w;
+      if (s.win.empty() || s.win.back().first < start) s.win.emplace_back(start, slice);
+      else s.win.back().second += slice;
+      s.sum += slice;
+    }
+    while (!s.win.empty() && s.win.front().first + w <= t - op.window_s) {
+      s.sum -= s.win.front().second;
+      s.win.pop_front();
+    }
+    if (s.win.empty()) { s.sum = 0; return 0.0; }   // pas de dérive d'arrondi
+    const double out = (t - op.window_s - s.win.front().first) / w;
+    return s.sum - s.win.front().second * std::min(std::max(out, 0.0), 1.0);
+  }
+
+  void combine(const Op &op, const std::vector<State> &st, State &s) const {
+    bool all = true, any = false;
+    for (uint32_t k = op.ref_begin; k < op.ref_begin + op.ref_count; ++k) {
+      all &= st[refs[k]].active;
+      any |= st[refs[k]].active;
+    }
+    s.raw = op.kind == Kind::All ? all : any;
+  }
+
+  // seuil avec hystérésis
+  static void compare(const Op &op, State &s, double m) {
+    s.metric = m;
+    const double lim = s.raw ? op.off : op.on;
+    s.raw = op.above ? m > lim : m < lim;
+  }
+
+  // maintien (for_s) puis notification
+  static void settle(const Op &op, State &s, double t, uint32_t i, std::vector<uint32_t> &active) {
+    if (s.raw) {
+      if (std::isnan(s.since)) s.since = t;
+      s.active = t - s.since >= op.for_s;
+    } else {
+      s.since  = NAN;
+      s.active = false;
+    }
+    if (op.notify && s.active) active.push_back(i);
+  }
+};
+
+inline std::string fmt(double v) {
+  std::ostringstream o;
+  o << v;
+  return o.str();
+}
+
+// Compile la liste de règles ; une règle invalide est signalée et ignorée
+inline Program compile(const json &rules) {
+  Program p;
+  std::unordered_map<std::string, uint32_t> by_name;
+  auto field_index = [&p](const std::string &f) {
+    for (size_t i = 0; i < p.fields.size(); ++i)
+      if (p.fields[i] == f) return (int)i;
+    p.fields.push_back(f);
+    return (int)p.fields.size() - 1;
+  };
+  if (!rules.is_array()) return p;
+
+  for (size_t r = 0; r < rules.size(); ++r) {
+    const json &j = rules[r];
+    if (!j.is_object()) continue;
+    const std::string name = j.value("name", "rule" + std::to_string(r));
+    const std::string unit = j.value("unit", std::string());
+    auto bad = [&](const std::string &why) {
+      std::cerr << "[overpower_email] rule '" << name << "' ignored: " << why << std::endl;
+    };
+    Op op;
+    op.notify = j.value("notify", true);
+    op.for_s  = j.value("for_s", 0.0);
+    std::string detail;
+
+    if (j.contains("all") || j.contains("any")) {
+      const bool all = j.contains("all");
+      const json &list = all ? j["all"] : j["any"];
+      if (!list.is_array() || list.empty()) { bad("all/any must be a non-empty list"); continue; }
+      op.kind = all ? Kind::All : Kind::Any;
+      op.ref_begin = (uint32_t)p.refs.size();
+      bool ok = true;
+      for (const auto &n : list) {
+        auto it = n.is_string() ? by_name.find(n.get<std::string>()) : by_name.end();
+        if (it == by_name.end()) { ok = false; break; }
+        p.refs.push_back(it->second);
+        detail += (detail.empty() ? "" : (all ? " ET " : " OU ")) + p.names[it->second];
+      }
+      if (!ok) {
+        p.refs.resize(op.ref_begin);
+        bad("all/any must name rules declared before");
+        continue;
+      }
+      op.ref_count = (uint32_t)(p.refs.size() - op.ref_begin);
+    } else {
+      if (!j.contains("field") || !j["field"].is_string()) { bad("missing field"); continue; }
+      const std::string field = j["field"].get<std::string>();
+      std::string what = field, sfx = unit;
+      if (j.contains("above") || j.contains("below")) {
+        op.kind  = Kind::Level;
+        op.above = j.contains("above");
+        op.on    = j.value(op.above ? "above" : "below", 0.0);
+      } else if (j.contains("rate_above") || j.contains("rate_below")) {
+        op.kind     = Kind::Rate;
+        op.above    = j.contains("rate_above");
+        op.on       = j.value(op.above ? "rate_above" : "rate_below", 0.0);
+        op.window_s = j.value("window_s", 1.0);
+        what = "d(" + field + ")/dt";
+        sfx  = unit + "/s";
+      } else if (j.contains("energy_above")) {
+        op.kind     = Kind::Energy;
+        op.on       = j.value("energy_above", 0.0) * 3600.0;   // unité·h -> unité·s
+        op.window_s = j.value("window_s", 3600.0);
+        what = "énergie(" + field + ")";
+        sfx  = unit + "h";
+      } else {
+        bad("no condition (above, below, rate_above, rate_below, energy_above)");
+        continue;
+      }
+      if (op.window_s < 0) { bad("window_s < 0"); continue; }
+      const double shown = op.kind == Kind::Energy ? op.on / 3600.0 : op.on;
+      op.off = op.on;
+      const char *clear = op.above ? "clear_below" : "clear_above";
+      if (j.contains(clear)) {
+        op.off = j.value(clear, op.on) * (op.kind == Kind::Energy ? 3600.0 : 1.0);
+        if (op.above ? op.off > op.on : op.off < op.on) { bad(std::string(clear) + " on the wrong side"); continue; }
+      }
+      op.field = field_index(field);
+      detail = what + (op.above ? " > " : " < ") + fmt(shown) + (sfx.empty() ? "" : " " + sfx);
+      if (op.off != op.on)
+        detail += " (retour " + std::string(op.above ? "< " : "> ") +
+                  fmt(op.kind == Kind::Energy ? op.off / 3600.0 : op.off) + ")";
+      if (op.kind != Kind::Level) detail += " sur " + fmt(op.window_s) + " s";
+    }
+    if (op.for_s > 0) detail += " pendant " + fmt(op.for_s) + " s";
+
+    if (by_name.count(name)) { bad("duplicate name"); continue; }
+    by_name[name] = (uint32_t)p.ops.size();
+    p.ops.push_back(op);
+    p.names.push_back(name);
+    p.details.push_back(detail);
+    p.units.push_back(unit);
+  }
+  return p;
+}
+
+} // namespace alert_rules
@@ -1,7 +1,10 @@
 // === overpower_email.cpp =====================================================
 // Sink MADS : surveille power_W, envoie un e-mail (script Python Gmail OAuth2)
 // et ouvre une fenêtre GUI plein écran avec bip continu tant qu’elle est ouverte.
-// Ajout : historique JSONL des alertes (history_path dans mads.ini).
+// Ajout : historique JSONL des alertes (history_path dans mads.ini), avec
+// rotation et index temporel (voir alert_history.hpp).
+// Les notifications partent d'un worker dédié (file bornée, posix_spawn sans
+// shell, timeout + reprises) : load_data ne fait que mettre en file.
 
 #include <sink.hpp>
 #include <nlohmann/json.hpp>
@@ -15,8 +18,38 @@
 #include <ctime>
 
 // ---- AJOUTS POUR L’HISTORIQUE ----
-#include <fstream>
-#include <filesystem>
+#include <unordered_map>
+#include "alert_history.hpp"
+#include "alert_rules.hpp"
+
+// ---- worker de notification ----
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ---- transport SMTP natif ----
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#ifdef MADS_SMTP_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+extern char **environ;
 
 using json = nlohmann::json;
 using namespace std::chrono;
@@ -25,14 +58,320 @@ using namespace std::chrono;
 #define PLUGIN_NAME "overpower_email"
 #endif
 
+// ——— Client SMTP minimal (RFC 5321) : la session reste ouverte entre deux
+//     alertes ; STARTTLS si le plugin est compilé avec OpenSSL (MADS_SMTP_OPENSSL).
+//     Utilisé uniquement par le worker de notification (pas de verrou).
+struct SmtpConfig {
+  std::string host{"127.0.0.1"};
+  int         port{25};
+  std::string helo{"localhost"};
+  std::string from{"mads@localhost"};
+  std::string user, password;     // AUTH PLAIN si user non vide
+  bool        starttls{false};
+  bool        tls_verify{true};
+  int         timeout_s{10};
+  int         idle_s{60};         // session fermée après idle_s sans envoi
+};
+
+class SmtpClient {
+public:
+  SmtpClient() = default;
+  SmtpClient(const SmtpClient &) = delete;
+  SmtpClient &operator=(const SmtpClient &) = delete;
+  ~SmtpClient() {
+    close();
+#ifdef MADS_SMTP_OPENSSL
+    if (_ctx) SSL_CTX_free(_ctx);
+#endif
+  }
+
+  void configure(const SmtpConfig &cfg) {
+    close();
+    _cfg = cfg;
+  }
+
+  // Envoie un message texte UTF-8 ; réouvre la session une fois si elle était périmée
+  bool send(const std::vector<std::string> &to, const std::string &subject,
+            const std::string &body, std::string &err) {
+    if (to.empty()) { err = "no recipient"; return false; }
+    for (int pass = 0; pass < 2; ++pass) {
+      const bool reused = _fd >= 0;
+      if (!reused && !open(err)) return false;
+      if (transaction(to, subject, body, err)) {
+        _last_used = steady_clock::now();
+        return true;
+      }
+      close(false);
+      if (!reused) return false;
+    }
+    return false;
+  }
+
+  void close_if_idle() {
+    if (_fd >= 0 && steady_clock::now() - _last_used > seconds(_cfg.idle_s)) close();
+  }
+
+  void close(bool polite = true) {
+    if (_fd < 0) return;
+    if (polite) {
+      std::string ignored;
+      command("QUIT", 221, ignored);
+    }
+#ifdef MADS_SMTP_OPENSSL
+    if (_ssl) { SSL_shutdown(_ssl); SSL_free(_ssl); _ssl = nullptr; }
+#endif
+    ::close(_fd);
+    _fd = -1;
+    _rbuf.clear();
+  }
+
+private:
+  bool open(std::string &err) {
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(_cfg.host.c_str(), std::to_string(_cfg.port).c_str(), &hints, &res);
+    if (rc != 0) { err = std::string("getaddrinfo: ") + gai_strerror(rc); return false; }
+    for (addrinfo *ai = res; ai && _fd < 0; ai = ai->ai_next) {
+      int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+      if (fd < 0) continue;
+      if (connect_with_timeout(fd, ai->ai_addr, ai->ai_addrlen)) _fd = fd;
+      else ::close(fd);
+    }
+    freeaddrinfo(res);
+    if (_fd < 0) { err = "cannot connect to " + _cfg.host + ":" + std::to_string(_cfg.port); return false; }
+
+    timeval tv{_cfg.timeout_s, 0};
+    setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    std::string caps;
+    int code = 0;
+    if (!read_reply(code, caps) || code != 220) { err = "bad greeting: " + caps; close(false); return false; }
+    if (!command("EHLO " + _cfg.helo, 250, err, &caps)) { close(false); return false; }
+
+    if (_cfg.starttls) {
+#ifdef MADS_SMTP_OPENSSL
+      if (caps.find("STARTTLS") == std::string::npos) { err = "server does not offer STARTTLS"; close(); return false; }
+      if (!command("STARTTLS", 220, err) || !start_tls(err) ||
+          !command("EHLO " + _cfg.helo, 250, err, &caps)) {
+        close(false);
+        return false;
+      }
+#else
+      err = "smtp_starttls needs a build with MADS_SMTP_OPENSSL";
+      close();
+      return false;
+#endif
+    }
+    _8bitmime = caps.find("8BITMIME") != std::string::npos;
+
+    if (!_cfg.user.empty()) {
+      const std::string token = std::string(1, '\0') + _cfg.user + std::string(1, '\0') + _cfg.password;
+      if (!command("AUTH PLAIN " + base64(token), 235, err)) { close(); return false; }
+    }
+    _last_used = steady_clock::now();
+    return true;
+  }
+
+  bool connect_with_timeout(int fd, const sockaddr *addr, socklen_t len) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = ::connect(fd, addr, len);
+    if (rc < 0 && errno == EINPROGRESS) {
+      pollfd pfd{fd, POLLOUT, 0};
+      int soerr = 0;
+      socklen_t sl = sizeof(soerr);
+      rc = (poll(&pfd, 1, _cfg.timeout_s * 1000) == 1 &&
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &soerr, &sl) == 0 && soerr == 0) ? 0 : -1;
+    }
+    fcntl(fd, F_SETFL, flags);
+    return rc == 0;
+  }
+
+  bool transaction(const std::vector<std::string> &to, const std::string &subject,
+                   const std::string &body, std::string &err) {
+    if (!command("MAIL FROM:<" + _cfg.from + ">" + (_8bitmime ? " BODY=8BITMIME" : ""), 250, err)) return false;
+    for (const auto &r : to)
+      if (!command("RCPT TO:<" + r + ">", 250, err)) return false;
+    if (!command("DATA", 354, err)) return false;
+
+    std::string msg;
+    msg.reserve(body.size() + 512);
+    msg += "From: " + _cfg.from + "\r\n";
+    msg += "To: ";
+    for (size_t i = 0; i < to.size(); ++i) msg += (i ? ", " : "") + to[i];
+    msg += "\r\nSubject: =?UTF-8?B?" + base64(subject) + "?=\r\n";
+    msg += "Date: " + rfc5322_date() + "\r\n";
+    msg += "Message-ID: <" + std::to_string(system_clock::now().time_since_epoch().count()) + "." +
+           std::to_string(++_msg_seq) + "@" + _cfg.helo + ">\r\n";
+    msg += "MIME-Version: 1.0\r\nContent-Type: text/plain; charset=UTF-8\r\n";
+    msg += "Content-Transfer-Encoding: 8bit\r\n\r\n";
+    // lignes en CRLF, « . » en début de ligne doublé (RFC 5321 §4.5.2)
+    size_t pos = 0;
+    while (pos <= body.size()) {
+      size_t nl = body.find('\n', pos);
+      std::string line = body.substr(pos, nl == std::string::npos ? std::string::npos : nl - pos);
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (!line.empty() && line[0] == '.') msg += '.';
+      msg += line + "\r\n";
+      if (nl == std::string::npos) break;
+      pos = nl + 1;
+    }
+    msg += ".";
+    return command(msg, 250, err);
+  }
+
+  // Envoie une ligne (sans CRLF) et vérifie le code de réponse
+  bool command(const std::string &line, int expect, std::string &err, std::string *reply = nullptr) {
+    std::string text;
+    int code = 0;
+    if (!write_all(line + "\r\n") || !read_reply(code, text)) {
+      err = "connection lost";
+      return false;
+    }
+    if (reply) *reply = text;
+    // 251 (utilisateur non local, transmis) vaut 250
+    if (code == expect || (expect == 250 && code == 251)) return true;
+    err = std::to_string(code) + " " + text;
+    return false;
+  }
+
+  // Réponse éventuellement multi-lignes : « 250-... » jusqu'à « 250 ... »
+  bool read_reply(int &code, std::string &text) {
+    text.clear();
+    while (true) {
+      size_t nl;
+      while ((nl = _rbuf.find("\r\n")) == std::string::npos) {
+        char buf[1024];
+        ssize_t n = read_some(buf, sizeof(buf));
+        if (n <= 0) return false;
+        _rbuf.append(buf, (size_t)n);
+      }
+      std::string line = _rbuf.substr(0, nl);
+      _rbuf.erase(0, nl + 2);
+      if (line.size() < 3) return false;
+      code = std::atoi(line.substr(0, 3).c_str());
+      if (!text.empty()) text += '\n';
+      text += line.size() > 4 ? line.substr(4) : std::string();
+      if (line.size() == 3 || line[3] == ' ') return true;
+    }
+  }
+
+  bool write_all(const std::string &data) {
+    size_t off = 0;
+    while (off < data.size()) {
+      ssize_t n;
+#ifdef MADS_SMTP_OPENSSL
+      if (_ssl) n = SSL_write(_ssl, data.data() + off, (int)(data.size() - off));
+      else
+#endif
+      n = ::send(_fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+      if (n <= 0) return false;
+      off += (size_t)n;
+    }
+    return true;
+  }
+
+  ssize_t read_some(char *buf, size_t len) {
+#ifdef MADS_SMTP_OPENSSL
+    if (_ssl) return SSL_read(_ssl, buf, (int)len);
+#endif
+    return ::recv(_fd, buf, len, 0);
+  }
+
+#ifdef MADS_SMTP_OPENSSL
+  bool start_tls(std::string &err) {
+    if (!_ctx) {
+      _ctx = SSL_CTX_new(TLS_client_method());
+      SSL_CTX_set_min_proto_version(_ctx, TLS1_2_VERSION);
+      SSL_CTX_set_default_verify_paths(_ctx);
+    }
+    SSL_CTX_set_verify(_ctx, _cfg.tls_verify ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr);
+    _ssl = SSL_new(_ctx);
+    SSL_set_fd(_ssl, _fd);
+    SSL_set_tlsext_host_name(_ssl, _cfg.host.c_str());
+    if (_cfg.tls_verify) SSL_set1_host(_ssl, _cfg.host.c_str());
+    if (SSL_connect(_ssl) != 1) {
+      char buf[256];
+      ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+      err = std::string("TLS handshake: ") + buf;
+      SSL_free(_ssl);
+      _ssl = nullptr;
+      return false;
+    }
+    _rbuf.clear();
+    return true;
+  }
+#endif
+
+  static std::string base64(const std::string &in) {
+    static const char *tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((in.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < in.size(); i += 3) {
+      uint32_t v = (uint8_t)in[i] << 16 | (uint8_t)in[i + 1] << 8 | (uint8_t)in[i + 2];
+      out += tbl[v >> 18]; out += tbl[(v >> 12) & 63]; out += tbl[(v >> 6) & 63]; out += tbl[v & 63];
+    }
+    if (i < in.size()) {
+      uint32_t v = (uint8_t)in[i] << 16 | (i + 1 < in.size() ? (uint8_t)in[i + 1] << 8 : 0);
+      out += tbl[v >> 18]; out += tbl[(v >> 12) & 63];
+      out += i + 1 < in.size() ? tbl[(v >> 6) & 63] : '=';
+      out += '=';
+    }
+    return out;
+  }
+
+  static std::string rfc5322_date() {
+    std::time_t t = std::time(nullptr);
+    std::tm tm{};
+    localtime_r(&t, &tm);
+    char buf[64];
+    std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S %z", &tm);
+    return buf;
+  }
+
+  SmtpConfig  _cfg;
+  int         _fd{-1};
+  std::string _rbuf;
+  bool        _8bitmime{false};
+  uint64_t    _msg_seq{0};
+  steady_clock::time_point _last_used{};
+#ifdef MADS_SMTP_OPENSSL
+  SSL_CTX *_ctx{nullptr};
+  SSL     *_ssl{nullptr};
+#endif
+};
+
 class OverpowerEmailPlugin : public Sink<json> {
 public:
+  ~OverpowerEmailPlugin() {
+    {
+      std::lock_guard<std::mutex> lk(_q_mx);
+      _q_stop = true;
+    }
+    _q_cv.notify_all();
+    if (_worker.joinable()) _worker.join();
+    if (!_pending.empty())
+      std::cerr << "[overpower_email] " << _pending.size() << " alerte(s) non envoyée(s) à l'arrêt" << std::endl;
+  }
+
   std::string kind() override { return PLUGIN_NAME; }
 
   void set_params(void const *params) override {
     Sink::set_params(params);
     _params.merge_patch(*(json*)params);
 
+    if (_worker.joinable()) {
+      // le worker lit la configuration et possède la session SMTP :
+      // on l'arrête le temps de la reconfigurer
+      { std::lock_guard<std::mutex> lk(_q_mx); _q_stop = true; }
+      _q_cv.notify_all();
+      _worker.join();
+      _q_stop = false;
+    }
+
     // --- Email -------------------------
     _threshold_W           = _params.value("threshold_W", 20.0);
     _min_alert_interval_s  = _params.value("min_alert_interval_s", 300); // 5 min
@@ -57,108 +396,189 @@ public:
     // --- Historique (ajout) ------------
     _history_path    = _params.value<std::string>("history_path", "");
     _history_enabled = !_history_path.empty();
+    alert_history::AlertHistoryWriter::Config hist;
+    hist.path             = _history_path;
+    hist.max_bytes        = (uint64_t)(std::max(0.0, _params.value("history_max_mb", 16.0)) * 1024 * 1024);
+    hist.rotate_s         = _params.value("history_rotate_s", (int64_t)86400);
+    hist.max_segments     = _params.value("history_max_segments", 0);
+    hist.fsync            = alert_history::parse_fsync(_params.value<std::string>("history_fsync", "batch"));
+    hist.fsync_interval_s = _params.value("history_fsync_interval_s", 5.0);
+
+    // --- Worker de notification --------
+    _notify_queue    = std::max(1, _params.value("notify_queue", 64));
+    _email_timeout_s = _params.value("email_timeout_s", 60);
+    _email_retries   = std::max(0, _params.value("email_retries", 3));
+    _email_backoff_s = _params.value("email_backoff_s", 5.0);
+    _digest_window_ms = std::max(0, _params.value("digest_window_ms", 0));
 
-    _last_alert_tp = steady_clock::time_point::min();
-    _last_notification.clear();
+    // --- Transport SMTP natif ----------
+    _email_transport      = _params.value<std::string>("email_transport", "python"); // python|smtp
+    _smtp_fallback_python = _params.value("smtp_fallback_python", true);
+    SmtpConfig smtp;
+    smtp.host       = _params.value<std::string>("smtp_host", smtp.host);
+    smtp.port       = _params.value("smtp_port", smtp.port);
+    smtp.helo       = _params.value<std::string>("smtp_helo", smtp.helo);
+    smtp.from       = _params.value<std::string>("smtp_from", smtp.from);
+    smtp.user       = _params.value<std::string>("smtp_user", "");
+    smtp.password   = _params.value<std::string>("smtp_password", "");
+    smtp.starttls   = _params.value("smtp_starttls", false);
+    smtp.tls_verify = _params.value("smtp_tls_verify", true);
+    smtp.timeout_s  = _params.value("smtp_timeout_s", smtp.timeout_s);
+    smtp.idle_s     = _params.value("smtp_idle_s", smtp.idle_s);
+    // to_email peut lister plusieurs adresses séparées par des virgules
+    _recipients.clear();
+    std::istringstream rcpt(_to_email);
+    for (std::string r; std::getline(rcpt, r, ',');) {
+      r.erase(0, r.find_first_not_of(" \t"));
+      r.erase(r.find_last_not_of(" \t") + 1);
+      if (!r.empty()) _recipients.push_back(r);
+    }
+
+    // --- Règles (compilées une fois) ----
+    // sans "rules" : la règle historique power_W > threshold_W
+    const json def_rules = json::array({{{"name", "overpower"}, {"field", "power_W"},
+                                         {"above", _threshold_W}, {"unit", "W"}}});
+    _rules = alert_rules::compile(_params.contains("rules") ? _params["rules"] : def_rules);
+    if (_rules.empty()) {
+      std::cerr << "[overpower_email] no valid rule, using power_W > threshold_W" << std::endl;
+      _rules = alert_rules::compile(def_rules);
+    }
+    _rules.max_gap_s = _params.value("rules_max_gap_s", 5.0);
+    // horloge source des messages isolés (dérivées / énergies), comme energy_meter
+    _rules_ts_key   = _params.value<std::string>("rules_ts_key", "millis");
+    _rules_ts_scale = _params.value("rules_ts_scale", 1.0e-3);   // millis -> s
+    _field_values.assign(_rules.fields.size(), NAN);
+
+    // --- Lots buffered_sp --------------
+    // batch_channels : champ des règles -> canal ("to" du map buffered_sp)
+    _batch_key = _params.value<std::string>("batch_key", "data");
+    const json chans = _params.value("batch_channels", json{{"current_A", 0}, {"power_W", 1}});
+    std::vector<std::pair<std::string, int>> chan_of;
+    for (auto it = chans.begin(); chans.is_object() && it != chans.end(); ++it)
+      if (it.value().is_number_integer() && it.value().get<int>() >= 0)
+        chan_of.emplace_back(it.key(), it.value().get<int>() + 1);   // colonne 0 = t_rel
+    auto column_of = [&chan_of](const std::string &f) {
+      for (const auto &c : chan_of) if (c.first == f) return c.second;
+      return -1;
+    };
+    _batch_cols_idx.assign(_rules.fields.size(), -1);
+    _batch_any = false;
+    for (size_t f = 0; f < _rules.fields.size(); ++f) {
+      _batch_cols_idx[f] = column_of(_rules.fields[f]);
+      _batch_any |= _batch_cols_idx[f] >= 0;
+    }
+    // power_W (pic, 1er dépassement, durée au-dessus de threshold_W) même si aucune règle ne le lit
+    _batch_power = -1;
+    if (column_of("power_W") >= 0) {
+      for (size_t f = 0; f < _rules.fields.size(); ++f)
+        if (_rules.fields[f] == "power_W") _batch_power = (int)f;
+      if (_batch_power < 0) {
+        _batch_power = (int)_batch_cols_idx.size();
+        _batch_cols_idx.push_back(column_of("power_W"));
+      }
+    }
+    _batch_cols.assign(_batch_cols_idx.size(), {});
+    _batch.x.assign(_batch_cols_idx.size(), nullptr);
+    _rule_state.clear();
+
+    _last_alert_by_machine.clear();
+    {
+      std::lock_guard<std::mutex> lk(_q_mx);
+      _last_notification.clear();
+    }
+    _smtp.configure(smtp);
+    _history.configure(hist);
+    _worker = std::thread(&OverpowerEmailPlugin::notify_loop, this);
   }
 
   return_type load_data(json const &input, std::string topic = "") override {
     try {
-      // 1) récupérer power_W (racine ou message.power_W)
-      double power_W = 0.0;
-      if (input.contains("power_W") && input["power_W"].is_number()) {
-        power_W = input["power_W"].get<double>();
-      } else if (input.contains("message") &&
-                 input["message"].contains("power_W") &&
-                 input["message"]["power_W"].is_number()) {
-        power_W = input["message"]["power_W"].get<double>();
+      const json *root = &input;
+      if (input.contains("message") && input["message"].is_object())
+        root = &input["message"];
+
+      // 1) lot buffered_sp (message.data = [[t_rel, ch0, ch1, ...], ...]) ou
+      //    champs isolés lus par les règles (message, sinon racine)
+      auto now = steady_clock::now();
+      const double now_s = duration<double>(now.time_since_epoch()).count();
+      double power_W = NAN, first_cross = NAN, time_above = NAN;
+      auto bit = root->find(_batch_key);
+      const bool batch = _batch_any && bit != root->end() && bit->is_array();
+      if (batch) {
+        double &shift = _batch_shift;
+        if (!load_batch(*bit, now_s, shift)) return return_type::success; // aucune ligne exploitable
+        if (_batch_power >= 0) {
+          // pic, premier dépassement et durée au-dessus de threshold_W : une passe
+          const auto pw = alert_rules::scan_column(_batch_t.data(), _batch.x[_batch_power], _batch.n,
+                                                   _threshold_W, true);
+          power_W     = pw.max;
+          first_cross = pw.first_cross - shift;   // t_rel de la source
+          time_above  = pw.time_beyond;
+        }
       } else {
-        return return_type::success; // pas de donnée puissance -> ignorer
+        bool any = false;
+        for (size_t i = 0; i < _rules.fields.size(); ++i) {
+          _field_values[i] = field_value(input, *root, _rules.fields[i]);
+          any |= !std::isnan(_field_values[i]);
+        }
+        if (!any) return return_type::success; // pas de donnée utile -> ignorer
+        power_W = field_value(input, *root, "power_W");
       }
 
       // 2) nom machine
       std::string machine = _machine_name_cfg;
       // si tu veux prioriser un champ remonté par la source :
       if (machine == "Machine CNC") {
-        const json *root = &input;
-        if (input.contains("message") && input["message"].is_object())
-          root = &input["message"];
         if (root->contains("machine_name") && (*root)["machine_name"].is_string())
           machine = (*root)["machine_name"].get<std::string>();
         else if (root->contains("hostname") && (*root)["hostname"].is_string())
           machine = (*root)["hostname"].get<std::string>();
+        else if (input.contains("agent_id") && input["agent_id"].is_string())
+          machine = input["agent_id"].get<std::string>();
+      }
+      // clé du cooldown : l'identifiant de la source, pour que plusieurs
+      // machines derrière le même sink ne se masquent pas les unes les autres
+      std::string machine_key = machine;
+      for (const char *k : {"agent_id", "machine_name", "hostname"}) {
+        const json *node = root->contains(k) ? root : &input;
+        if (node->contains(k) && (*node)[k].is_string()) {
+          machine_key = (*node)[k].get<std::string>();
+          break;
+        }
       }
 
       // 3) horodatage ISO (si présent dans le message)
       std::string ts_iso = extract_iso_timestamp(input);
 
-      // 4) comparaison seuil + cooldown
-      if (power_W > _threshold_W) {
-        auto now = steady_clock::now();
-        auto elapsed = duration_cast<seconds>(now - _last_alert_tp).count();
-        if (_last_alert_tp == steady_clock::time_point::min() ||
-            elapsed >= _min_alert_interval_s) {
-
-          // ---- Email --------------------------------------------------------
-          std::string subject = "ALERTE MADS – Puissance élevée";
-          std::ostringstream body;
-          body << "Bonjour,\n\n"
-               << "Une alerte de dépassement de puissance a été détectée sur la machine : " << machine << ".\n\n"
-               << "Détails :\n"
-               << "- Puissance mesurée : " << power_W << " W\n"
-               << "- Seuil configuré  : " << _threshold_W << " W\n"
-               << "- Topic            : " << (topic.empty() ? "inconnu" : topic) << "\n";
-          if (!ts_iso.empty())
-            body << "- Horodatage       : " << ts_iso << "\n";
-          body << "\nCordialement,\nMADS Monitoring\n";
-
-          std::ostringstream cmd_mail;
-          cmd_mail << _python_path << " "
-                   << _script_path  << " "
-                   << quote(subject) << " "
-                   << quote(body.str()) << " "
-                   << quote(_to_email);
-
-          int rc_mail = std::system(cmd_mail.str().c_str());
-          if (rc_mail != 0) {
-            _error = "Python email script failed with code " + std::to_string(rc_mail);
-            return return_type::error;
-          }
-
-          _last_alert_tp = now;
-          _last_notification = "email envoyé à " + _to_email + (ts_iso.empty() ? "" : " (" + ts_iso + ")");
-          std::cerr << "[overpower_email] " << _last_notification << std::endl;
-
-          // ---- GUI plein écran + bip continu --------------------------------
-          std::ostringstream cmd_gui;
-          cmd_gui << _gui_python_path << " " << _gui_script_path
-                  << " --machine "   << quote(machine)
-                  << " --power "     << power_W
-                  << " --threshold " << _threshold_W
-                  << " --topic "     << quote(topic.empty() ? "Ampere" : topic)
-                  << " --timeout "   << _gui_timeout_s;
-
-          if (_gui_fullscreen) cmd_gui << " --fullscreen";
-          if (_gui_beep) {
-            cmd_gui << " --beep"
-                    << " --beep-interval " << _gui_beep_interval;
-            if (!_gui_beep_backend.empty())
-              cmd_gui << " --beep-backend " << _gui_beep_backend;
-          }
-
-          // lancer en tâche de fond pour ne pas bloquer le sink
-          cmd_gui << " &";
-          std::cerr << "[overpower_email] Launch GUI: " << cmd_gui.str() << std::endl;
-          std::system(cmd_gui.str().c_str());
-
-          // ---- AJOUT : écrire l'historique JSONL ----------------------------
-          append_history_jsonl(
-            machine,
-            power_W,
-            _threshold_W,
-            topic,
-            ts_iso  // si vide, now_iso_local() sera utilisé
-          );
+      // 4) règles (état incrémental par machine) + cooldown par machine et par règle
+      auto &mr = machine_rules(machine_key, now);
+      _active_rules.clear();
+      if (batch) {
+        // horloge source : t_rel (s depuis minuit), déplié au passage de minuit
+        const double t_rel0 = _batch_t.front() - _batch_shift;
+        if (!std::isnan(mr.src_last) && t_rel0 < mr.src_last - 43200.0) mr.src_wrap += 86400.0;
+        mr.src_last = _batch_t.back() - _batch_shift;
+        _batch.src_shift = mr.src_wrap - _batch_shift;
+        _rules.eval_batch(mr.state, _batch, _active_rules);
+      } else {
+        const double ts = field_value(input, *root, _rules_ts_key);
+        _rules.eval(mr.state, now_s, _field_values.data(), _active_rules, ts * _rules_ts_scale);
+      }
+      for (uint32_t r : _active_rules) {
+        const std::string key = machine_key + "|" + _rules.names[r];
+        // alerte encore en file ou en cours d'envoi : on la regroupe avant le cooldown
+        // (armé à la mise en file, il masquerait sinon toutes les répétitions)
+        if (coalesce_alert(key, mr.state[r].metric, power_W, time_above, ts_iso)) continue;
+        auto last = _last_alert_by_machine.find(key);
+        if (last != _last_alert_by_machine.end() &&
+            duration_cast<seconds>(now - last->second).count() < _min_alert_interval_s)
+          continue;
+
+        // ---- Notification : mise en file, le worker envoie -------------
+        // (e-mail, GUI et historique ne bloquent plus le fil des messages)
+        if (enqueue_alert(key, machine, r, mr.state[r].metric, power_W, first_cross, time_above, topic, ts_iso)) {
+          if (_last_alert_by_machine.size() >= kMaxTrackedMachines) prune_cooldowns(now);
+          _last_alert_by_machine[key] = now;
         }
       }
 
@@ -171,15 +591,28 @@ public:
   }
 
   std::map<std::string, std::string> info() override {
+    std::string last_notification;
+    size_t queued = 0;
+    uint64_t dropped = 0, coalesced = 0, failed = 0;
+    {
+      std::lock_guard<std::mutex> lk(_q_mx);
+      last_notification = _last_notification;
+      queued    = _pending.size();
+      dropped   = _dropped;
+      coalesced = _coalesced;
+      failed    = _failed;
+    }
     return {
       // Email
       {"threshold_W", std::to_string(_threshold_W)},
+      {"rules", std::to_string(_rules.ops.size())},
       {"min_alert_interval_s", std::to_string(_min_alert_interval_s)},
       {"to_email", _to_email},
       {"python_path", _python_path},
       {"script_path", _script_path},
       {"machine_name", _machine_name_cfg},
-      {"last_notification", _last_notification},
+      {"last_notification", last_notification},
+      {"machines_in_cooldown", std::to_string(_last_alert_by_machine.size())},
 
       // GUI
       {"gui_python_path", _gui_python_path},
@@ -190,6 +623,14 @@ public:
       {"gui_beep_interval_ms", std::to_string(_gui_beep_interval)},
       {"gui_timeout_s", std::to_string(_gui_timeout_s)},
 
+      // Worker de notification
+      {"notify_queued", std::to_string(queued)},
+      {"notify_dropped", std::to_string(dropped)},
+      {"notify_coalesced", std::to_string(coalesced)},
+      {"email_failed", std::to_string(failed)},
+      {"email_transport", _email_transport},
+      {"digest_window_ms", std::to_string(_digest_window_ms)},
+
       // Historique (ajout)
       {"history_path", _history_path},
       {"history_enabled", _history_enabled ? "true" : "false"}
@@ -197,12 +638,270 @@ public:
   }
 
 private:
-  static std::string quote(const std::string &s) {
-    std::ostringstream q;
-    q << "\"";
-    for (char c : s) { if (c == '\"') q << "\\\""; else q << c; }
-    q << "\"";
-    return q.str();
+  // Une alerte en attente ; les alertes d'une même machine arrivées pendant
+  // qu'elle attend sont fusionnées (compteur + puissance max)
+  struct Alert {
+    std::string machine;
+    std::string topic;
+    std::string ts_iso;
+    std::string rule;       // nom de la règle déclenchée
+    std::string detail;     // condition lisible
+    double      value{};    // grandeur comparée au seuil
+    double      threshold{};
+    double      power_W{};  // NaN si le message n'a pas de power_W
+    double      peak_W{};
+    double      first_cross{NAN};  // lot : t_rel (s depuis minuit, horloge source) du 1er dépassement
+    double      time_above{NAN};   // lot(s) : durée au-dessus de threshold_W (s)
+    int         count{1};
+    int64_t     t_ms{};   // première alerte du groupe (epoch ms)
+  };
+
+  // Regroupe une répétition dans l'alerte de même clé machine|règle encore en file.
+  // Retourne false si aucune alerte de cette clé n'attend (déjà prise par le worker).
+  bool coalesce_alert(const std::string &key, double value, double power_W, double time_above,
+                      const std::string &ts_iso) {
+    std::lock_guard<std::mutex> lk(_q_mx);
+    auto it = _pending.find(key);
+    if (it == _pending.end()) return false;
+    Alert &a = it->second;
+    a.count++;
+    a.value   = value;
+    a.power_W = power_W;
+    a.peak_W  = std::fmax(a.peak_W, power_W);
+    if (!std::isnan(time_above))
+      a.time_above = std::isnan(a.time_above) ? time_above : a.time_above + time_above;
+    if (!ts_iso.empty()) a.ts_iso = ts_iso;
+    _coalesced++;
+    return true;
+  }
+
+  // Appelé par load_data : O(1), ne bloque jamais sur un envoi.
+  // Retourne false si la file est pleine (alerte perdue, cooldown non armé).
+  bool enqueue_alert(const std::string &key, const std::string &machine, uint32_t rule, double value,
+                     double power_W, double first_cross, double time_above,
+                     const std::string &topic, const std::string &ts_iso) {
+    {
+      std::lock_guard<std::mutex> lk(_q_mx);
+      if (_pending.find(key) != _pending.end()) return true;  // regroupée entre-temps (cf. coalesce_alert)
+      if (_pending.size() >= (size_t)_notify_queue) {
+        _dropped++;
+        return false;
+      }
+      const alert_rules::Op &op = _rules.ops[rule];
+      const double threshold = op.kind == alert_rules::Kind::All || op.kind == alert_rules::Kind::Any ? NAN
+                             : op.kind == alert_rules::Kind::Energy ? op.on / 3600.0 : op.on;
+      _pending.emplace(key, Alert{machine, topic, ts_iso, _rules.names[rule], _rules.details[rule], value,
+                                  threshold, power_W, power_W, first_cross, time_above, 1,
+                                  alert_history::now_ms()});
+      _order.push_back(key);
+    }
+    _q_cv.notify_one();
+    return true;
+  }
+
+  void notify_loop() {
+    std::unique_lock<std::mutex> lk(_q_mx);
+    while (!_q_stop) {
+      // réveil périodique pour récupérer les GUI terminées et fermer la session SMTP inactive
+      _q_cv.wait_for(lk, seconds(1), [this] { return _q_stop || !_order.empty(); });
+      reap_gui();
+      if (_q_stop) break;
+      if (_order.empty()) {
+        lk.unlock();
+        _smtp.close_if_idle();
+        lk.lock();
+        continue;
+      }
+
+      // digest : on laisse digest_window_ms aux autres machines pour rejoindre l'envoi
+      if (_digest_window_ms > 0)
+        _q_cv.wait_for(lk, milliseconds(_digest_window_ms), [this] { return _q_stop; });
+
+      std::vector<Alert> batch;
+      do {
+        std::string key = std::move(_order.front());
+        _order.pop_front();
+        batch.push_back(std::move(_pending[key]));
+        _pending.erase(key);
+      } while (_digest_window_ms > 0 && !_order.empty());
+
+      lk.unlock();
+      deliver(batch);
+      lk.lock();
+    }
+  }
+
+  // GUI d'abord (alarme locale immédiate), puis e-mail avec reprises, puis historique
+  void deliver(const std::vector<Alert> &batch) {
+    for (const auto &a : batch) launch_gui(a);
+
+    // ---- Email (un seul message pour tout le lot) -------------------------
+    std::string subject = "ALERTE MADS – Puissance élevée";
+    std::ostringstream body;
+    body << "Bonjour,\n\n";
+    if (batch.size() == 1) {
+      body << "Une alerte de dépassement de puissance a été détectée sur la machine : " << batch[0].machine << ".\n\n";
+    } else {
+      subject += " (" + std::to_string(batch.size()) + " machines)";
+      body << "Des dépassements de puissance ont été détectés sur " << batch.size() << " machines.\n\n";
+    }
+    for (const auto &a : batch) {
+      if (batch.size() > 1) body << "Machine : " << a.machine << "\n";
+      body << "Détails :\n"
+           << "- Règle            : " << a.rule << " (" << a.detail << ")\n";
+      if (std::isfinite(a.peak_W))
+        body << "- Puissance mesurée : " << a.peak_W << " W\n";
+      else
+        body << "- Valeur mesurée   : " << a.value << "\n";
+      if (std::isfinite(a.threshold))
+        body << "- Seuil configuré  : " << a.threshold << "\n";
+      body << "- Topic            : " << (a.topic.empty() ? "inconnu" : a.topic) << "\n";
+      if (std::isfinite(a.first_cross))
+        body << "- 1er dépassement  : " << clock_of_day(a.first_cross) << " (horloge capteur)\n";
+      if (std::isfinite(a.time_above) && a.time_above > 0)
+        body << "- Durée > seuil    : " << a.time_above << " s\n";
+      if (a.count > 1)
+        body << "- Alertes groupées  : " << a.count << " (dernière mesure " << a.value << ")\n";
+      if (!a.ts_iso.empty())
+        body << "- Horodatage       : " << a.ts_iso << "\n";
+      body << "\n";
+    }
+    body << "Cordialement,\nMADS Monitoring\n";
+
+    bool sent = false;
+    double backoff = _email_backoff_s;
+    for (int attempt = 0; attempt <= _email_retries; ++attempt) {
+      std::string why;
+      if (send_email(subject, body.str(), why)) { sent = true; break; }
+      std::cerr << "[overpower_email] WARN: email failed (" << why << "), attempt "
+                << attempt + 1 << "/" << _email_retries + 1 << std::endl;
+      if (attempt == _email_retries) break;
+      // attente interrompue par l'arrêt du plugin
+      std::unique_lock<std::mutex> lk(_q_mx);
+      if (_q_cv.wait_for(lk, duration<double>(backoff), [this] { return _q_stop; })) break;
+      backoff = std::min(backoff * 2, 300.0);
+    }
+
+    {
+      std::lock_guard<std::mutex> lk(_q_mx);
+      const std::string &ts_iso = batch.back().ts_iso;
+      if (sent) {
+        _last_notification = "email envoyé à " + _to_email + (ts_iso.empty() ? "" : " (" + ts_iso + ")");
+      } else {
+        _failed += batch.size();
+        _last_notification = "échec email (" + batch.back().machine + ")";
+      }
+      std::cerr << "[overpower_email] " << _last_notification << std::endl;
+    }
+
+    // ---- AJOUT : écrire l'historique JSONL (un seul commit pour le lot) ----
+    if (_history.enabled()) {
+      std::vector<alert_history::Record> records;
+      records.reserve(batch.size());
+      for (const auto &a : batch) {
+        json rec = {
+          {"event", "overpower"},
+          {"machine", a.machine},
+          {"rule", a.rule},
+          {"value", a.value},
+          {"threshold", a.threshold},
+          {"power_W", a.peak_W},
+          {"timestamp", a.ts_iso.empty() ? now_iso_local() : a.ts_iso},
+          {"topic", a.topic.empty() ? std::string("Ampere") : a.topic},
+          {"t_ms", a.t_ms}};
+        if (a.count > 1) rec["count"] = a.count;
+        if (std::isfinite(a.time_above)) rec["time_above_s"] = a.time_above;
+        records.push_back({a.t_ms, a.machine, rec.dump()});
+      }
+      _history.append(records);
+    }
+  }
+
+  // ---- GUI plein écran + bip continu (processus détaché) ------------------
+  void launch_gui(const Alert &a) {
+    std::vector<std::string> gui = {
+      _gui_python_path, _gui_script_path,
+      "--machine",   a.machine,
+      "--power",     std::to_string(std::isfinite(a.peak_W) ? a.peak_W : a.value),
+      "--threshold", std::to_string(std::isfinite(a.threshold) ? a.threshold : _threshold_W),
+      "--topic",     a.topic.empty() ? std::string("Ampere") : a.topic,
+      "--timeout",   std::to_string(_gui_timeout_s)};
+    if (_gui_fullscreen) gui.push_back("--fullscreen");
+    if (_gui_beep) {
+      gui.insert(gui.end(), {"--beep", "--beep-interval", std::to_string(_gui_beep_interval)});
+      if (!_gui_beep_backend.empty())
+        gui.insert(gui.end(), {"--beep-backend", _gui_beep_backend});
+    }
+    pid_t gpid = spawn(gui);
+    if (gpid > 0) {
+      std::cerr << "[overpower_email] Launch GUI: pid " << gpid << std::endl;
+      _gui_pids.push_back(gpid);
+    }
+  }
+
+  // SMTP natif (session réutilisée) ; script Python si demandé ou en secours
+  bool send_email(const std::string &subject, const std::string &body, std::string &why) {
+    if (_email_transport == "smtp") {
+      if (_smtp.send(_recipients, subject, body, why)) return true;
+      if (!_smtp_fallback_python) return false;
+      std::cerr << "[overpower_email] WARN: SMTP failed (" << why << "), falling back to Python" << std::endl;
+    }
+    int rc = run_with_timeout({_python_path, _script_path, subject, body, _to_email}, _email_timeout_s);
+    if (rc == 0) return true;
+    why = describe_rc(rc);
+    return false;
+  }
+
+  // posix_spawnp avec un vecteur d'arguments : pas de shell, pas de quoting
+  static pid_t spawn(const std::vector<std::string> &args) {
+    std::vector<char *> argv;
+    for (const auto &a : args) argv.push_back(const_cast<char *>(a.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid = -1;
+    int err = posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+    if (err != 0) {
+      std::cerr << "[overpower_email] WARN: cannot start " << args[0] << ": " << std::strerror(err) << std::endl;
+      return -1;
+    }
+    return pid;
+  }
+
+  // Code de sortie du processus, -1 si lancement impossible, -2 si timeout
+  static int run_with_timeout(const std::vector<std::string> &args, int timeout_s) {
+    pid_t pid = spawn(args);
+    if (pid < 0) return -1;
+    auto deadline = steady_clock::now() + seconds(timeout_s);
+    int status = 0;
+    while (true) {
+      pid_t r = waitpid(pid, &status, WNOHANG);
+      if (r == pid) break;
+      if (r < 0) return -1;
+      if (timeout_s > 0 && steady_clock::now() >= deadline) {
+        kill(pid, SIGTERM);
+        for (int i = 0; i < 20 && waitpid(pid, &status, WNOHANG) == 0; ++i)
+          std::this_thread::sleep_for(milliseconds(50));
+        if (waitpid(pid, &status, WNOHANG) == 0) {
+          kill(pid, SIGKILL);
+          waitpid(pid, &status, 0);
+        }
+        return -2;
+      }
+      std::this_thread::sleep_for(milliseconds(50));
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  }
+
+  static std::string describe_rc(int rc) {
+    if (rc == -1) return "lancement impossible";
+    if (rc == -2) return "timeout";
+    return "code " + std::to_string(rc);
+  }
+
+  // évite les zombies des GUI lancées en tâche de fond
+  void reap_gui() {
+    _gui_pids.erase(std::remove_if(_gui_pids.begin(), _gui_pids.end(),
+                                   [](pid_t p) { return waitpid(p, nullptr, WNOHANG) != 0; }),
+                    _gui_pids.end());
   }
 
   static std::string extract_iso_timestamp(const json &in) {
@@ -251,38 +950,85 @@ private:
     return oss.str();
   }
 
-  void append_history_jsonl(const std::string &machine,
-                            double power_W,
-                            double threshold_W,
-                            const std::string &topic,
-                            const std::string &ts_iso_msg) {
-    if (!_history_enabled) return;
+  // Remplit _batch_t / _batch_cols depuis les lignes [t_rel, ch0, ch1, ...] ; une
+  // ligne à laquelle il manque une colonne utile est ignorée. Les instants sont
+  // recalés sur l'horloge du plugin (dernier échantillon = réception), shift = écart.
+  bool load_batch(const json &rows, double now_s, double &shift) {
+    const size_t nf = _batch_cols_idx.size();
+    _batch_t.clear();
+    for (auto &c : _batch_cols) c.clear();
+    for (const auto &r : rows) {
+      if (!r.is_array() || r.empty() || !r[0].is_number()) continue;
+      bool ok = true;
+      for (size_t f = 0; f < nf && ok; ++f) {
+        const int c = _batch_cols_idx[f];
+        ok = c < 0 || (size_t(c) < r.size() && r[c].is_number());
+      }
+      if (!ok) continue;
+      _batch_t.push_back(r[0].get<double>());
+      for (size_t f = 0; f < nf; ++f)
+        if (_batch_cols_idx[f] >= 0) _batch_cols[f].push_back(r[_batch_cols_idx[f]].get<double>());
+    }
+    _batch.n = _batch_t.size();
+    if (_batch.n == 0) return false;
+    shift = now_s - _batch_t.back();
+    for (auto &t : _batch_t) t += shift;
+    _batch.t = _batch_t.data();
+    for (size_t f = 0; f < nf; ++f)
+      _batch.x[f] = _batch_cols_idx[f] >= 0 ? _batch_cols[f].data() : nullptr;
+    return true;
+  }
 
-    try {
-      const std::string ts = ts_iso_msg.empty() ? now_iso_local() : ts_iso_msg;
+  // t_rel buffered_sp (s depuis minuit) -> "HH:MM:SS.mmm"
+  static std::string clock_of_day(double s) {
+    const long ms = std::lround(std::fmod(std::max(0.0, s), 86400.0) * 1000.0);
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%02ld:%02ld:%02ld.%03ld",
+                  ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000);
+    return buf;
+  }
 
-      std::filesystem::path p(_history_path);
-      if (p.has_parent_path()) {
-        std::error_code ec;
-        std::filesystem::create_directories(p.parent_path(), ec);
-      }
+  // valeur numérique d'un champ : dans le message, sinon à la racine ; NaN si absent
+  static double field_value(const json &input, const json &root, const std::string &key) {
+    for (const json *node : {&root, &input}) {
+      auto it = node->find(key);
+      if (it != node->end() && it->is_number()) return it->get<double>();
+    }
+    return NAN;
+  }
 
-      std::ofstream ofs(_history_path, std::ios::app);
-      if (!ofs) {
-        std::cerr << "[overpower_email] WARN: cannot open history_path=" << _history_path << std::endl;
-        return;
+  // état des règles d'une machine (load_data seulement)
+  struct MachineRules {
+    std::vector<alert_rules::State> state;
+    steady_clock::time_point        seen;
+    double                          src_last{NAN};   // dernier t_rel des lots (s)
+    double                          src_wrap{0};     // jours ajoutés au passage de minuit
+  };
+
+  // état des règles d'une machine ; les machines muettes depuis 10 min sont
+  // oubliées quand la table dépasse kMaxTrackedMachines
+  MachineRules &machine_rules(const std::string &key, steady_clock::time_point now) {
+    auto it = _rule_state.find(key);
+    if (it == _rule_state.end()) {
+      if (_rule_state.size() >= kMaxTrackedMachines) {
+        for (auto m = _rule_state.begin(); m != _rule_state.end();) {
+          if (now - m->second.seen > minutes(10)) m = _rule_state.erase(m);
+          else ++m;
+        }
       }
+      it = _rule_state.emplace(key, MachineRules{_rules.make_state(), now}).first;
+    }
+    it->second.seen = now;
+    return it->second;
+  }
 
-      ofs << "{\"event\":\"overpower\","
-          << "\"machine\":"    << quote(machine) << ","
-          << "\"power_W\":"    << power_W << ","
-          << "\"threshold_W\":"<< threshold_W << ","
-          << "\"timestamp\":"  << quote(ts) << ","
-          << "\"topic\":"      << quote(topic.empty() ? std::string("Ampere") : topic)
-          << "}\n";
-      ofs.flush();
-    } catch (const std::exception &e) {
-      std::cerr << "[overpower_email] WARN: history append failed: " << e.what() << std::endl;
+  // oublie les machines dont le cooldown est écoulé (table bornée)
+  void prune_cooldowns(steady_clock::time_point now) {
+    for (auto it = _last_alert_by_machine.begin(); it != _last_alert_by_machine.end();) {
+      if (duration_cast<seconds>(now - it->second).count() >= _min_alert_interval_s)
+        it = _last_alert_by_machine.erase(it);
+      else
+        ++it;
     }
   }
 
@@ -306,10 +1052,53 @@ private:
   // --- Historique (ajout) ---
   std::string _history_path;
   bool        _history_enabled{false};
+  alert_history::AlertHistoryWriter _history;   // worker seulement
+
+  // --- Worker de notification ---
+  int    _notify_queue{64};
+  int    _email_timeout_s{60};
+  int    _email_retries{3};
+  double _email_backoff_s{5.0};
+  int    _digest_window_ms{0};
+
+  // --- Transport SMTP natif (utilisé par le worker seulement) ---
+  std::string              _email_transport{"python"};
+  bool                     _smtp_fallback_python{true};
+  std::vector<std::string> _recipients;
+  SmtpClient               _smtp;
+
+  std::mutex                             _q_mx;   // protège tout ce bloc
+  std::condition_variable                _q_cv;
+  std::deque<std::string>                _order;    // ordre d'arrivée (clés machine)
+  std::unordered_map<std::string, Alert> _pending;  // une alerte en attente par machine
+  bool                                   _q_stop{false};
+  uint64_t                               _dropped{0}, _coalesced{0}, _failed{0};
+  std::string                            _last_notification;
+  std::vector<pid_t>                     _gui_pids;  // seul le worker y touche
+  std::thread                            _worker;
 
   // --- État ---
-  std::chrono::steady_clock::time_point _last_alert_tp;
-  std::string _last_notification;
+  // --- Règles : programme compilé + état par machine (load_data seulement) ---
+  alert_rules::Program                          _rules;
+  std::string                                   _rules_ts_key{"millis"};
+  double                                        _rules_ts_scale{1.0e-3};
+  std::vector<double>                           _field_values;
+  std::vector<uint32_t>                         _active_rules;
+  std::unordered_map<std::string, MachineRules> _rule_state;
+
+  // --- Lots buffered_sp (load_data seulement) ---
+  std::string                      _batch_key{"data"};
+  bool                             _batch_any{false};
+  std::vector<int>                 _batch_cols_idx;   // par champ : colonne de la ligne, -1 = absent
+  int                              _batch_power{-1};  // index de power_W dans _batch.x
+  std::vector<double>              _batch_t;
+  double                           _batch_shift{0};   // réception - t_rel du dernier échantillon
+  std::vector<std::vector<double>> _batch_cols;
+  alert_rules::BatchView           _batch;
+
+  // dernière alerte par machine et par règle ; seul load_data y touche (pas de verrou)
+  static constexpr size_t kMaxTrackedMachines = 1024;
+  std::unordered_map<std::string, std::chrono::steady_clock::time_point> _last_alert_by_machine;
   json _params;
 };
 
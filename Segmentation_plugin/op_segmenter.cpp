@@ -0,0 +1,591 @@
+// Filter MADS : segmentation en ligne des opérations d'usinage à partir de la
+// puissance (Arduino 2) et des vibrations (Arduino 1) -> événements de segment
+#include <filter.hpp>
+#include <nlohmann/json.hpp>
+#include <pugg/Kernel.h>
+
+#include <vector>
+#include <cmath>
+#include <string>
+#include <map>
+#include <deque>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <iostream>
+
+using json   = nlohmann::json;
+using std::string;
+using std::vector;
+
+#ifndef PLUGIN_NAME
+#define PLUGIN_NAME "op_segmenter"
+#endif
+
+// secondes depuis minuit (t_rel buffered_sp) -> "HH:MM:SS.mmm"
+static string clock_of_day(double s) {
+  const long ms = std::lround(std::fmod(std::max(0.0, s), 86400.0) * 1000.0);
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%02ld:%02ld:%02ld.%03ld",
+                ms / 3600000, (ms / 60000) % 60, (ms / 1000) % 60, ms % 1000);
+  return buf;
+}
+
+// ----------- Résumé d'une trame (frame_s) ou d'un segment ----------------------
+struct FrameStats {
+  double   t0{NAN}, t1{NAN};             // horloge de cadence (s)
+  uint32_t frames{0};
+  uint64_t n_p{0}, n_v{0};
+  double   sum_p{0}, sq_p{0}, max_p{-INFINITY}, energy_J{0};
+  double   sq_v{0}, peak_v{0};
+
+  void add(const FrameStats &o) {
+    if (std::isnan(t0) || o.t0 < t0) t0 = o.t0;
+    if (std::isnan(t1) || o.t1 > t1) t1 = o.t1;
+    frames += o.frames;
+    n_p += o.n_p;  sum_p += o.sum_p;  sq_p += o.sq_p;  energy_J += o.energy_J;
+    max_p = std::max(max_p, o.max_p);
+    n_v += o.n_v;  sq_v += o.sq_v;    peak_v = std::max(peak_v, o.peak_v);
+  }
+  double mean_p() const { return n_p ? sum_p / double(n_p) : NAN; }
+  double std_p() const {
+    if (n_p < 2) return 0.0;
+    const double m = mean_p();
+    return std::sqrt(std::max(0.0, sq_p / double(n_p) - m * m));
+  }
+  double rms_v() const { return n_v ? std::sqrt(sq_v / double(n_v)) : NAN; }
+};
+
+// ----------- Détection de ruptures bayésienne en ligne (Adams & MacKay) --------
+// Une loi Normale-Gamma par dimension et par longueur de run ; la prédictive
+// est une Student-t. Le run length est borné à max_run : le dernier seau
+// absorbe les runs plus longs, la mémoire et le coût par pas sont O(max_run).
+class Bocpd {
+public:
+  void configure(size_t max_run, size_t dims, double hazard, vector<double> noise) {
+    _R = std::max<size_t>(2, max_run);
+    _D = dims;
+    _H = std::clamp(hazard, 1e-9, 0.5);
+    _noise = std::move(noise);
+    _p.assign(_R, 0.0);
+    _w.assign(_R, 0.0);
+    _lp.assign(_R, 0.0);
+    _mu.assign(_R * _D, 0.0);
+    _kappa.assign(_R * _D, 0.0);
+    _alpha.assign(_R * _D, 0.0);
+    _beta.assign(_R * _D, 0.0);
+    _c.assign(_R * _D, 0.0);
+    _inv.assign(_R * _D, 0.0);
+    // alpha = 1 + n/2 après n observations : lgamma tabulé pour n < 2 max_run
+    _lg.resize(2 * _R);
+    for (size_t n = 0; n < _lg.size(); ++n) _lg[n] = lg_ratio(2.0 + double(n));
+    reset();
+  }
+
+  void reset() { _n = 0; }
+  size_t active() const { return _n; }
+
+  // Un pas : x = dims valeurs (NaN = dimension absente pour cette trame)
+  void update(const double *x) {
+    if (_n == 0) {
+      _p[0] = 1.0;
+      set_prior(0, x);
+      _n = 1;
+      return;
+    }
+    // 1) prédictive de x sous chaque run en cours
+    double lmax = -INFINITY;
+    for (size_t r = 0; r < _n; ++r) {
+      double lp = 0.0;
+      for (size_t d = 0; d < _D; ++d)
+        if (!std::isnan(x[d])) lp += log_student(r * _D + d, x[d]);
+      _lp[r] = lp;
+      lmax = std::max(lmax, lp);
+    }
+    // 2) croissance (1 - H) ou rupture (H) ; le dernier seau absorbe les runs longs
+    double cp = 0.0;
+    for (size_t r = 0; r < _n; ++r) {
+      _w[r] = _p[r] * std::exp(_lp[r] - lmax);
+      cp += _w[r];
+    }
+    const bool capped = _n == _R;
+    const size_t n_new = capped ? _R : _n + 1;
+    // statistiques : seau r+1 <- seau r mis à jour par x (du haut vers le bas)
+    if (capped) {
+      const size_t top = _R - 1;
+      if (_w[top] < _w[top - 1]) copy_stats(top - 1, top);
+      observe(top, x);
+    }
+    for (size_t r = capped ? _R - 2 : _n; r-- > 0;) {
+      copy_stats(r, r + 1);
+      observe(r + 1, x);
+    }
+    if (capped) {
+      const double tail = _w[_R - 1] + _w[_R - 2];
+      for (size_t r = _R - 2; r-- > 0;) _p[r + 1] = _w[r] * (1.0 - _H);
+      _p[_R - 1] = tail * (1.0 - _H);
+    } else {
+      for (size_t r = _n; r-- > 0;) _p[r + 1] = _w[r] * (1.0 - _H);
+    }
+    _p[0] = cp * _H;
+    set_prior(0, x);
+    _n = n_new;
+
+    double z = 0.0;
+    for (size_t r = 0; r < _n; ++r) z += _p[r];
+    if (!(z > 0.0) || !std::isfinite(z)) { reset(); return; }
+    for (size_t r = 0; r < _n; ++r) _p[r] /= z;
+  }
+
+  // masse des runs de longueur <= k et run le plus probable parmi eux
+  double mass_upto(size_t k, size_t &argmax) const {
+    double m = 0.0, best = -1.0;
+    argmax = 0;
+    for (size_t r = 0; r <= k && r < _n; ++r) {
+      m += _p[r];
+      if (_p[r] > best) { best = _p[r]; argmax = r; }
+    }
+    return m;
+  }
+
+  // run le plus probable
+  size_t map_run() const {
+    size_t best = 0;
+    for (size_t r = 1; r < _n; ++r) if (_p[r] > _p[best]) best = r;
+    return best;
+  }
+
+private:
+  // a priori : moyenne sur la dernière trame, variance ~ noise²
+  void set_prior(size_t r, const double *x) {
+    for (size_t d = 0; d < _D; ++d) {
+      const size_t i = r * _D + d;
+      _mu[i]    = std::isnan(x[d]) ? 0.0 : x[d];
+      _kappa[i] = std::isnan(x[d]) ? 1e-6 : 1.0;
+      _alpha[i] = 1.0;
+      _beta[i]  = _noise[d] * _noise[d];
+      refresh(i);
+    }
+  }
+
+  void copy_stats(size_t from, size_t to) {
+    for (size_t d = 0; d < _D; ++d) {
+      _mu[to * _D + d]    = _mu[from * _D + d];
+      _kappa[to * _D + d] = _kappa[from * _D + d];
+      _alpha[to * _D + d] = _alpha[from * _D + d];
+      _beta[to * _D + d]  = _beta[from * _D + d];
+      _c[to * _D + d]     = _c[from * _D + d];
+      _inv[to * _D + d]   = _inv[from * _D + d];
+    }
+  }
+
+  // mise à jour conjuguée Normale-Gamma par une observation
+  void observe(size_t r, const double *x) {
+    for (size_t d = 0; d < _D; ++d) {
+      if (std::isnan(x[d])) continue;
+      const size_t i = r * _D + d;
+      const double k = _kappa[i], dx = x[d] - _mu[i];
+      _beta[i]  += 0.5 * k * dx * dx / (k + 1.0);
+      _mu[i]    += dx / (k + 1.0);
+      _kappa[i]  = k + 1.0;
+      _alpha[i] += 0.5;
+      refresh(i);
+    }
+  }
+
+  // constantes de la Student-t, recalculées seulement quand le seau change
+  void refresh(size_t i) {
+    const double nu = 2.0 * _alpha[i];
+    const double s2 = _beta[i] * (_kappa[i] + 1.0) / (_alpha[i] * _kappa[i]);
+    const size_t n  = size_t(nu - 2.0 + 0.5);
+    _c[i]   = (n < _lg.size() ? _lg[n] : lg_ratio(nu)) - 0.5 * std::log(nu * M_PI * s2);
+    _inv[i] = 1.0 / (nu * s2);
+  }
+
+  static double lg_ratio(double nu) { return std::lgamma(0.5 * (nu + 1.0)) - std::lgamma(0.5 * nu); }
+
+  double log_student(size_t i, double x) const {
+    const double dx = x - _mu[i];
+    return _c[i] - (_alpha[i] + 0.5) * std::log1p(dx * dx * _inv[i]);
+  }
+
+  size_t _R{2}, _D{1}, _n{0};
+  double _H{0.01};
+  vector<double> _noise;
+  vector<double> _p, _w, _lp;
+  vector<double> _mu, _kappa, _alpha, _beta;
+  vector<double> _c, _inv, _lg;
+};
+
+// ----------- Filter class -----------------------------------------------------
+class OpSegmenter : public Filter<json, json> {
+public:
+  // Nom du plugin pour MADS
+  string kind() override { return PLUGIN_NAME; }
+
+  // Lecture & application des paramètres (depuis mads.ini)
+  void set_params(void const *params) override {
+    Filter::set_params(params);
+    _params.merge_patch(*(json*)params);
+
+    _machine_name = _params.value("machine_name", string("machine"));
+
+    // Flux : topics (lots buffered_sp) ; sans topic, reconnaissance par le contenu
+    _power_topic   = _params.value("power_topic", string("currents_full"));
+    _vib_topic     = _params.value("vibration_topic", string("accel_mic"));
+    _batch_key     = _params.value("batch_key", string("data"));
+    _power_channel = std::max(0, _params.value("power_channel", 1));  // P_W (Arduino 2)
+    _vib_channels  = _params.value("vibration_channels", vector<int>{0, 1, 2}); // x, y, z (Arduino 1)
+    _power_key     = _params.value("power_key", string("P_W"));
+    _vib_key       = _params.value("vibration_key", string("acceleration"));
+    _ts_key        = _params.value("ts_key", string("millis"));
+    _ts_scale      = _params.value("ts_scale", 1.0e-3);
+    _clock_vib     = _params.value("clock_stream", string("power")) == "vibration";
+
+    // Trames : une observation du détecteur toutes les frame_s (horloge source)
+    _frame_s   = std::max(1e-3, _params.value("frame_s", 0.1));
+    _max_gap_s = _params.value("max_gap_s", 2.0);
+    _vib_hp_s  = std::max(1e-3, _params.value("vibration_hp_s", 1.0)); // retrait de la gravité
+
+    // BOCPD : durée moyenne d'un segment (hazard), run length borné, bruit intra-segment
+    const double expected_s = std::max(_frame_s, _params.value("expected_segment_s", 30.0));
+    const size_t max_run    = std::max(8, _params.value("max_run", 512));
+    _detector.configure(max_run, 2, _frame_s / expected_s,
+                        {std::max(1e-6, _params.value("power_noise_W", 5.0)),
+                         std::max(1e-9, _params.value("vibration_noise_g", 0.02))});
+
+    // Décision : masse des runs courts > cp_threshold, segments d'au moins min_segment_s
+    _confirm    = size_t(std::max(1, _params.value("confirm_frames", 5)));
+    _cp_thr     = _params.value("cp_threshold", 0.6);
+    _min_frames = uint64_t(std::ceil(std::max(0.0, _params.value("min_segment_s", 2.0)) / _frame_s));
+
+    // Étiquettes : première règle qui correspond, sinon idle / operation selon idle_W
+    _idle_W = _params.value("idle_W", 20.0);
+    _labels.clear();
+    for (const auto &l : _params.value("labels", json::array())) {
+      if (!l.is_object() || !l.contains("name")) continue;
+      _labels.push_back({l["name"].get<string>(),
+                         l.value("min_W", -INFINITY), l.value("max_W", INFINITY),
+                         l.value("min_vib_g", -INFINITY), l.value("max_vib_g", INFINITY),
+                         l.value("min_s", 0.0)});
+    }
+    _max_events = std::max(1, _params.value("max_events", 256));
+
+    restart();
+  }
+
+  // On reçoit le flux puissance et/ou vibrations (lots buffered_sp ou messages isolés)
+  return_type load_data(json const &data, string topic = "") override {
+    try {
+      const json* root = &data;
+      if (data.contains("message") && data["message"].is_object()) {
+        root = &data["message"];
+      }
+
+      // 1) lots : [t_rel, ch0, ch1, ...], routés par topic
+      auto bit = root->find(_batch_key);
+      if (bit != root->end() && bit->is_array()) {
+        const bool pw = topic == _power_topic, vib = topic == _vib_topic;
+        if (!pw && !vib) return return_type::success;   // flux non suivi
+        _trel_in = true;
+        for (const auto &r : *bit) {
+          if (!r.is_array() || r.empty() || !r[0].is_number()) { _rejected++; continue; }
+          const double t = r[0].get<double>();
+          if (pw) {
+            const size_t c = size_t(_power_channel) + 1;
+            if (c < r.size() && r[c].is_number()) power_sample(t, r[c].get<double>());
+            else _rejected++;
+          } else {
+            double m2 = 0.0;
+            bool ok = true;
+            for (int ch : _vib_channels) {
+              const size_t c = size_t(std::max(0, ch)) + 1;
+              ok = ok && c < r.size() && r[c].is_number();
+              if (ok) { const double a = r[c].get<double>(); m2 += a * a; }
+            }
+            if (ok) vib_sample(t, std::sqrt(m2));
+            else _rejected++;
+          }
+        }
+        return return_type::success;
+      }
+
+      // 2) message isolé : P_W ou acceleration {x_g, y_g, z_g}, horodatage ts_key
+      auto ts = root->find(_ts_key);
+      if (ts == root->end() || !ts->is_number()) {
+        _error = _ts_key + " manquant";
+        return return_type::error;
+      }
+      const double t = ts->get<double>() * _ts_scale;
+      _trel_in = false;
+      auto pit = root->find(_power_key);
+      if (pit != root->end() && pit->is_number()) power_sample(t, pit->get<double>());
+      auto vit = root->find(_vib_key);
+      if (vit != root->end() && vit->is_object()) {
+        double m2 = 0.0;
+        for (const auto &a : vit->items())
+          if (a.value().is_number()) m2 += a.value().get<double>() * a.value().get<double>();
+        vib_sample(t, std::sqrt(m2));
+      }
+      return return_type::success;
+
+    } catch (const std::exception &e) {
+      _error = e.what();
+      return return_type::error;
+    }
+  }
+
+  // Publie les événements de segment en attente
+  return_type process(json &out) override {
+    out.clear();
+    if (_events.empty()) return return_type::retry;
+    out["machine"] = _machine_name;
+    out["events"]  = json(vector<json>(_events.begin(), _events.end()));
+    _events.clear();
+    return return_type::success;
+  }
+
+  std::map<string,string> info() override {
+    return {
+      {"machine_name", _machine_name},
+      {"power_topic", _power_topic},
+      {"vibration_topic", _vib_topic},
+      {"frame_s", std::to_string(_frame_s)},
+      {"frames", std::to_string(_frame_no)},
+      {"segments", std::to_string(_seg_id)},
+      {"segment_frames", std::to_string(_frame_no - _seg_start_frame)},
+      {"run_length", std::to_string(_detector.map_run())},
+      {"gaps", std::to_string(_gaps)},
+      {"rejected", std::to_string(_rejected)},
+      {"events_dropped", std::to_string(_events_dropped)}
+    };
+  }
+
+private:
+  struct Label {
+    string name;
+    double min_W, max_W, min_vib, max_vib, min_s;
+  };
+
+  void restart() {
+    _detector.reset();
+    _frame = FrameStats{};
+    _seg = FrameStats{};
+    _recent.clear();
+    _frame_end = NAN;
+    _frame_no = _seg_start_frame = 0;
+    _seg_open = false;
+    _last_tp = _last_tv = NAN;
+    _wrap_p = _wrap_v = 0.0;
+    _vib_mean = NAN;
+    _vib_hold = NAN;
+  }
+
+  // t_rel repasse par 0 à minuit : on garde une horloge croissante par flux
+  static double unwrap(double t, double last, double &wrap) {
+    if (!std::isnan(last) && t + wrap < last - 43200.0) wrap += 86400.0;
+    return t + wrap;
+  }
+
+  void power_sample(double t_src, double p) {
+    if (!std::isfinite(p) || !std::isfinite(t_src)) { _rejected++; return; }
+    const double t = unwrap(t_src, _last_tp, _wrap_p);
+    if (!_clock_vib && !tick(t, _last_tp)) return;
+    if (!std::isnan(_last_tp) && t > _last_tp && t - _last_tp <= _max_gap_s)
+      _frame.energy_J += 0.5 * (_last_p + p) * (t - _last_tp);
+    _frame.n_p++;
+    _frame.sum_p += p;
+    _frame.sq_p  += p * p;
+    _frame.max_p  = std::max(_frame.max_p, p);
+    _last_tp = t;
+    _last_p  = p;
+  }
+
+  // |a| sans sa moyenne lente (gravité, inclinaison du capteur)
+  void vib_sample(double t_src, double mag) {
+    if (!std::isfinite(mag) || !std::isfinite(t_src)) { _rejected++; return; }
+    const double t = unwrap(t_src, _last_tv, _wrap_v);
+    if (_clock_vib && !tick(t, _last_tv)) return;
+    const double dt = std::isnan(_last_tv) ? 0.0 : std::clamp(t - _last_tv, 0.0, _vib_hp_s);
+    _last_tv = t;
+    if (std::isnan(_vib_mean)) { _vib_mean = mag; return; }
+    _vib_mean += (mag - _vib_mean) * dt / (_vib_hp_s + dt);
+    const double a = mag - _vib_mean;
+    _frame.n_v++;
+    _frame.sq_v  += a * a;
+    _frame.peak_v = std::max(_frame.peak_v, std::fabs(a));
+  }
+
+  // Horloge de cadence : ferme la trame quand t la dépasse ; false = échantillon rejeté
+  bool tick(double t, double last) {
+    if (!std::isnan(last)) {
+      const double dt = t - last;
+      if (dt <= 0.0 && dt > -_max_gap_s) { _rejected++; return false; }
+      if (dt > _max_gap_s || dt <= -_max_gap_s) {
+        // trou (capteur muet, redémarrage) : le segment s'arrête au dernier échantillon
+        _gaps++;
+        close_frame(false);
+        close_segment("gap", 0);
+        _detector.reset();
+        _frame_end = NAN;
+        _last_tp = _last_tv = NAN;
+      }
+    }
+    _clock_trel = _trel_in;
+    if (std::isnan(_frame_end)) {
+      _frame_end = t + _frame_s;
+      _frame.t0 = t;
+      return true;
+    }
+    if (t >= _frame_end) {
+      close_frame(true);
+      _frame.t0 = t;
+      // trames vides sautées : la suivante commence sur la grille
+      _frame_end += _frame_s * std::max(1.0, std::floor((t - _frame_end) / _frame_s) + 1.0);
+    }
+    _frame.t1 = t;
+    return true;
+  }
+
+  // Une trame terminée (complete = à sa borne, sinon au dernier échantillon) :
+  // pas du détecteur puis décision de rupture
+  void close_frame(bool complete) {
+    if (std::isnan(_frame.t0) || (_frame.n_p == 0 && _frame.n_v == 0)) { _frame = FrameStats{}; return; }
+    if (complete) _frame.t1 = _frame_end;
+    else if (std::isnan(_frame.t1)) _frame.t1 = _frame.t0;
+    _frame.frames = 1;
+    if (_frame.n_v) _vib_hold = _frame.rms_v();
+    const double x[2] = {_frame.mean_p(), _vib_hold};
+    _detector.update(x);
+
+    if (!_seg_open) {
+      _seg_open = true;
+      _seg_start_frame = _frame_no;
+      emit_start(_frame.t0);
+    }
+    _recent.push_back(_frame);
+    if (_recent.size() > _confirm + 1) {
+      _seg.add(_recent.front());
+      _recent.pop_front();
+    }
+    _frame = FrameStats{};
+    _frame_no++;
+
+    // run r : r trames observées depuis la trame d'amorce, qui reste à l'ancien segment
+    size_t r = 0;
+    const double mass = _detector.mass_upto(_confirm, r);
+    const uint64_t boundary = _frame_no - std::clamp<uint64_t>(r, 1, _recent.size());
+    if (mass > _cp_thr && boundary >= _seg_start_frame + std::max<uint64_t>(1, _min_frames)) {
+      const size_t keep = size_t(_frame_no - boundary);
+      close_segment("change", keep);
+      _seg_open = true;
+      _seg_start_frame = boundary;
+      emit_start(_recent.front().t0);
+    }
+  }
+
+  // Clôt le segment courant ; les keep dernières trames ouvrent le suivant
+  void close_segment(const char *reason, size_t keep) {
+    if (!_seg_open) return;
+    FrameStats s = _seg;
+    while (_recent.size() > keep) {
+      s.add(_recent.front());
+      _recent.pop_front();
+    }
+    _seg = FrameStats{};
+    _seg_open = false;
+    if (s.frames == 0) return;
+
+    const double dur = std::max(0.0, s.t1 - s.t0);
+    const double vib = s.rms_v();
+    json ev = {
+      {"event", "end"},
+      {"id", _seg_id},
+      {"reason", reason},
+      {"label", label(s.mean_p(), vib, dur)},
+      {"t_start", s.t0},
+      {"t_end", s.t1},
+      {"start_ms", wall_ms(s.t0)},
+      {"end_ms", wall_ms(s.t1)},
+      {"duration_s", dur},
+      {"frames", s.frames},
+      {"mean_W", s.n_p ? json(s.mean_p()) : json(nullptr)},
+      {"std_W", s.std_p()},
+      {"max_W", s.n_p ? json(s.max_p) : json(nullptr)},
+      {"energy_Wh", s.energy_J / 3600.0},
+      {"vib_rms_g", s.n_v ? json(vib) : json(nullptr)},
+      {"vib_peak_g", s.peak_v}
+    };
+    if (_clock_trel) { ev["start"] = clock_of_day(s.t0); ev["end"] = clock_of_day(s.t1); }
+    push_event(std::move(ev));
+  }
+
+  void emit_start(double t0) {
+    json ev = {{"event", "start"}, {"id", ++_seg_id}, {"t_start", t0}, {"start_ms", wall_ms(t0)}};
+    if (_clock_trel) ev["start"] = clock_of_day(t0);
+    push_event(std::move(ev));
+  }
+
+  void push_event(json ev) {
+    if (_events.size() >= size_t(_max_events)) { _events.pop_front(); _events_dropped++; }
+    _events.push_back(std::move(ev));
+  }
+
+  string label(double mean_W, double vib, double dur) const {
+    for (const auto &l : _labels) {
+      if (!std::isnan(mean_W) && (mean_W < l.min_W || mean_W > l.max_W)) continue;
+      if (!std::isnan(vib) && (vib < l.min_vib || vib > l.max_vib)) continue;
+      if (dur < l.min_s) continue;
+      return l.name;
+    }
+    if (std::isnan(mean_W)) return "unknown";
+    return mean_W < _idle_W ? "idle" : "operation";
+  }
+
+  // instant source -> epoch ms, en recalant le dernier échantillon sur la réception
+  int64_t wall_ms(double t) const {
+    const double last = _clock_vib ? _last_tv : _last_tp;
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count();
+    if (std::isnan(last)) return now;
+    return now - int64_t(std::llround((last - t) * 1000.0));
+  }
+
+  // Paramètres
+  json   _params;
+  string _machine_name{"machine"};
+  string _power_topic{"currents_full"}, _vib_topic{"accel_mic"};
+  string _batch_key{"data"};
+  int    _power_channel{1};
+  vector<int> _vib_channels{0, 1, 2};
+  string _power_key{"P_W"}, _vib_key{"acceleration"};
+  string _ts_key{"millis"};
+  double _ts_scale{1.0e-3};
+  bool   _clock_vib{false};
+  double _frame_s{0.1}, _max_gap_s{2.0}, _vib_hp_s{1.0};
+  size_t _confirm{5};
+  double _cp_thr{0.6};
+  uint64_t _min_frames{20};
+  double _idle_W{20.0};
+  vector<Label> _labels;
+  int    _max_events{256};
+
+  // État
+  Bocpd _detector;
+  FrameStats _frame;                 // trame en cours
+  FrameStats _seg;                   // segment courant, hors trames récentes
+  std::deque<FrameStats> _recent;    // confirm_frames + 1 dernières trames
+  double   _frame_end{NAN};
+  uint64_t _frame_no{0}, _seg_start_frame{0}, _seg_id{0};
+  bool     _seg_open{false};
+  bool     _trel_in{false}, _clock_trel{false};   // horloge = t_rel (lots) ou ts_key
+  double   _last_tp{NAN}, _last_tv{NAN}, _last_p{0};
+  double   _wrap_p{0}, _wrap_v{0};
+  double   _vib_mean{NAN}, _vib_hold{NAN};
+  std::deque<json> _events;
+  uint64_t _gaps{0}, _rejected{0}, _events_dropped{0};
+};
+
+// Enregistre ce filtre auprès de MADS
+INSTALL_FILTER_DRIVER(OpSegmenter, json, json)
@@ -7,6 +7,13 @@
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+
+#include "gui_shm.hpp"
+#include "gui_sink_common.hpp"
 
 using json = nlohmann::json;
 using std::string;
@@ -19,6 +26,9 @@ class AccelFftAlarmGui : public Sink<json> {
 public:
   string kind() override { return PLUGIN_NAME; }
 
+  // le segment partagé ne survit pas au sink (une GUI ouverte se rattache au suivant)
+  ~AccelFftAlarmGui() override { _shm.remove(); }
+
   void set_params(void const *params) override {
     Sink::set_params(params);
     _params.merge_patch(*(json*)params);
@@ -31,28 +41,79 @@ public:
       string("/home/mads2025/Documents/Maryem/Devel/Accel_FFT_Alarm_Gui/src/gui_line_fft.py"));
     _title      = _params.value("title", string("FFT Accélération – Monitoring"));
     _state_path = _params.value("state_path", string("/tmp/accel_fft_gui_state.json"));
+    _wf_rows     = _params.value("waterfall_rows", 120);    // 0 = pas de waterfall
+    _wf_write_ms = _params.value("waterfall_write_ms", 500);
+
+    // Canal vers la GUI : "shm" (segment POSIX écrit en place) | "file" (JSON + rename)
+    _channel   = _params.value("gui_channel", string("shm"));
+    _shm_name  = _params.value("shm_name", string("/accel_fft_gui"));
+    _max_bands = std::max(1, _params.value("max_bands", 2048));
+    if (_shm.ok() && (_channel != "shm" || _shm.name() != _shm_name)) _shm.remove();   // ancien segment
+    else _shm.close();
+    if (_channel == "shm") {
+      string err;
+      if (!_shm.open(_shm_name, uint32_t(_max_bands), uint32_t(std::max(0, _wf_rows)), err)) {
+        std::cerr << "[accel_fft_alarm_gui] " << err << " -> fichier " << _state_path << std::endl;
+        _channel = "file";
+      }
+    }
+    // waterfall accumulé côté sink : canal fichier seulement (en shm, anneau du segment)
+    _waterfall.reset(_shm.ok() ? 0 : size_t(std::max(0, _wf_rows)));
 
-    // Lance UNE fois le GUI, il va boucler et lire _state_path en continu
+    // Lance UNE fois le GUI, il va boucler et lire le segment (ou _state_path) en continu
     std::ostringstream cmd;
     cmd << _python_path << " " << _script_path
-        << " --title "  << "\"" << _title      << "\""
-        << " --state "  << "\"" << _state_path << "\""
-        << " &";
+        << " --title "  << "\"" << _title      << "\"";
+    if (_shm.ok()) cmd << " --shm "   << "\"" << _shm_name   << "\"";
+    else           cmd << " --state " << "\"" << _state_path << "\"";
+    cmd << " &";
     std::system(cmd.str().c_str());
   }
 
-  // À chaque message du filter accel_fft, on écrit l'état dans un fichier JSON
+  // À chaque message du filter accel_fft, on publie l'état pour la GUI
   return_type load_data(json const &input, string topic = "") override {
     try {
       if (!input.contains("accel_fft")) return return_type::retry;
       const json &af = input["accel_fft"];
 
+      // mémoire partagée : bandes et lignes de waterfall écrites en place
+      if (_shm.ok()) {
+        const bool tones = af.contains("tones") && af["tones"].is_array();
+        if (!tones && (!af.contains("bands") || !af["bands"].is_array())) return return_type::retry;
+        const double max_mag = tones ? af.value("max_tone_mag", 0.0) : af.value("max_band_mag", 0.0);
+        const bool   alarm   = af.value("alarm", false);
+        _shm.begin();
+        const uint32_t n = gui_shm::write_bands(_shm, tones ? af["tones"] : af["bands"], tones, _truncated);
+        if (_wf_rows > 0 && af.contains("waterfall") && af["waterfall"].is_object())
+          gui_shm::write_waterfall(_shm, af["waterfall"]);
+        _shm.commit(n, float(max_mag), alarm);
+        _updates++;
+        return return_type::success;
+      }
+
       // Données minimales pour la GUI
       json state;
       state["title"]   = _title;
       state["alarm"]   = af.value("alarm", false);
-      state["max_mag"] = af.value("max_band_mag", 0.0);
-      state["bands"]   = af["bands"]; // tableau [{f_low,f_high,mean_mag}, ...]
+      if (af.contains("tones") && af["tones"].is_array()) {
+        // mode goertzel : un point par ton surveillé
+        state["max_mag"] = af.value("max_tone_mag", 0.0);
+        state["bands"]   = tones_as_bands(af["tones"]);
+      } else {
+        if (!af.contains("bands")) return return_type::retry;
+        state["max_mag"] = af.value("max_band_mag", 0.0);
+        state["bands"]   = af["bands"]; // tableau [{f_low,f_high,mean_mag}, ...]
+      }
+
+      // waterfall accumulé ici, écrit au plus toutes les waterfall_write_ms
+      if (_wf_rows > 0 && af.contains("waterfall") && af["waterfall"].is_object()) {
+        _waterfall.add(af["waterfall"]);
+        const auto now = std::chrono::steady_clock::now();
+        if (now - _wf_last_write >= std::chrono::milliseconds(_wf_write_ms)) {
+          state["waterfall"] = _waterfall.to_json();
+          _wf_last_write = now;
+        }
+      }
 
       // fichier temporaire puis rename()
       const string tmp = _state_path + ".tmp";
@@ -77,6 +138,10 @@ public:
       {"python_path", _python_path},
       {"script_path", _script_path},
       {"state_path",  _state_path},
+      {"gui_channel", _channel},
+      {"shm_name",    _shm_name},
+      {"updates",     std::to_string(_updates)},
+      {"bands_truncated", std::to_string(_truncated)},
       {"title",       _title}
     };
   }
@@ -84,6 +149,15 @@ public:
 private:
   json   _params;
   string _python_path, _script_path, _title, _state_path;
+
+  int    _wf_rows{120}, _wf_write_ms{500};
+  WaterfallBuffer _waterfall;
+  std::chrono::steady_clock::time_point _wf_last_write{};
+
+  string _channel{"shm"}, _shm_name{"/accel_fft_gui"};
+  int    _max_bands{2048};
+  gui_shm::Writer _shm;
+  uint64_t _updates{0}, _truncated{0};
 };
 
 INSTALL_SINK_DRIVER(AccelFftAlarmGui, json)
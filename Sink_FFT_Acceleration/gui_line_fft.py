@@ -1,9 +1,96 @@
 # src/gui_line_fft.py
-import argparse, json, os, time
+import argparse, json, mmap, os, struct, time
+import numpy as np
 import matplotlib
 matplotlib.use("TkAgg")         
 import matplotlib.pyplot as plt
 
+# === lecture du segment partagé écrit par le sink (Common/gui_shm.hpp) =======
+class ShmState:
+    # magic, version, header_size, seq, max_bands, wf_cap, n_bands, wf_rows,
+    # wf_cols, wf_head, max_mag, flags, wf_seq (64 octets)
+    HEADER = struct.Struct("<8sIIQIIIIIIfIQ")
+
+    def __init__(self, name):
+        self.path = "/dev/shm/" + name.lstrip("/")
+        self.mm = None
+        self.last_seq = None
+        self.last_wf_seq = None
+        self.checked = 0.0
+
+    def _open(self):
+        try:
+            fd = os.open(self.path, os.O_RDONLY)
+        except OSError:
+            return False
+        try:
+            st = os.fstat(fd)
+            if st.st_size < self.HEADER.size:
+                return False
+            mm = mmap.mmap(fd, st.st_size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        hdr = self.HEADER.unpack_from(mm, 0)
+        mb, cap = hdr[4], hdr[5]
+        if hdr[0] != b"MADSGUI1" or self.HEADER.size + 4 * mb * (3 + cap) > st.st_size:
+            mm.close()
+            return False
+        self.mm, self.ino = mm, st.st_ino
+        self.max_bands, self.wf_cap = mb, cap
+        buf = np.frombuffer(mm, dtype=np.float32, count=mb * (3 + cap), offset=self.HEADER.size)
+        self.f_low, self.f_high, self.mag = buf[:mb], buf[mb:2 * mb], buf[2 * mb:3 * mb]
+        self.wf = buf[3 * mb:].reshape(cap, mb)
+        self.seq = np.frombuffer(mm, dtype=np.uint64, count=1, offset=16)
+        self.last_seq = self.last_wf_seq = None
+        return True
+
+    def _close(self):
+        self.f_low = self.f_high = self.mag = self.wf = self.seq = None
+        if self.mm is not None:
+            self.mm.close()
+        self.mm = None
+
+    def poll(self):
+        """Nouvel état si le sink a publié depuis le dernier appel, sinon None."""
+        now = time.monotonic()
+        if self.mm is not None and now - self.checked > 1.0:
+            # segment recréé (sink relancé après suppression) : on se rattache
+            self.checked = now
+            try:
+                if os.stat(self.path).st_ino != self.ino:
+                    self._close()
+            except OSError:
+                pass
+        if self.mm is None and not self._open():
+            return None
+        for _ in range(100):
+            s0 = int(self.seq[0])
+            if s0 & 1:
+                continue                     # écriture en cours
+            if s0 == self.last_seq:
+                return None
+            h = self.HEADER.unpack_from(self.mm, 0)
+            if (h[4], h[5]) != (self.max_bands, self.wf_cap):
+                self._close()                # capacités changées : on remappe
+                return None
+            n = min(h[6], self.max_bands)
+            st = {"f_low": self.f_low[:n].copy(), "f_high": self.f_high[:n].copy(),
+                  "mag": self.mag[:n].copy(), "max_mag": h[10], "alarm": bool(h[11] & 1)}
+            wf_rows, wf_cols, wf_head, wf_seq = h[7], h[8], h[9], h[12]
+            if wf_seq != self.last_wf_seq and wf_rows and wf_cols:
+                ring = self.wf[:, :wf_cols]
+                if wf_rows < self.wf_cap:
+                    st["waterfall"] = ring[:wf_rows].copy()
+                else:                        # anneau plein : plus ancienne ligne en wf_head
+                    st["waterfall"] = np.concatenate((ring[wf_head:], ring[:wf_head]))
+            if int(self.seq[0]) != s0:
+                continue                     # réécrit pendant la copie : on recommence
+            self.last_seq = s0
+            if "waterfall" in st:
+                self.last_wf_seq = wf_seq
+            return st
+        return None
+
 def load_state(path):
     try:
         with open(path, "r") as f:
@@ -14,11 +101,14 @@ def load_state(path):
 def main():
     ap = argparse.ArgumentParser()
     ap.add_argument("--title", default="FFT Accélération – Monitoring")
-    ap.add_argument("--state", required=True, help="Chemin du fichier état JSON")
+    ap.add_argument("--state", help="Chemin du fichier état JSON")
+    ap.add_argument("--shm", help="Nom du segment mémoire partagée (ex. /accel_fft_gui)")
     args = ap.parse_args()
+    if not args.state and not args.shm:
+        ap.error("--state ou --shm requis")
 
     plt.ion()
-    fig, ax = plt.subplots()
+    fig, (ax, ax_wf) = plt.subplots(2, 1, gridspec_kw={"height_ratios": [3, 2]})
     fig.canvas.manager.set_window_title(args.title)
     line, = ax.plot([], [], lw=2)
     alarm_text = ax.text(0.5, 0.9, "", color="red", fontsize=24,
@@ -29,31 +119,72 @@ def main():
     ax.set_ylabel("Amplitude (moyenne par bande)")
     ax.grid(True)
 
+    # waterfall : matrice [rows x cols] préparée par le sink, affichée telle quelle
+    ax_wf.set_xlabel("Fréquence (Hz)")
+    ax_wf.set_ylabel("Spectres récents")
+    ax_wf.set_visible(False)
+    wf_img = None
+
+    # état : segment partagé (relu quand seq change) ou fichier (relu quand mtime change)
+    shm = ShmState(args.shm) if args.shm else None
     last_mtime = 0.0
+
+    def read_file():
+        nonlocal last_mtime
+        if not os.path.exists(args.state):
+            return None
+        mtime = os.path.getmtime(args.state)
+        if mtime == last_mtime:
+            return None
+        last_mtime = mtime
+        st = load_state(args.state)
+        if not st or "bands" not in st or not st["bands"]:
+            return None
+        bands = st["bands"]
+        m = None
+        wf = st.get("waterfall")
+        if isinstance(wf, dict) and wf.get("rows", 0) and wf.get("cols", 0):
+            m = np.asarray(wf["data"], dtype=np.float32).reshape(wf["rows"], wf["cols"])
+        # X = centre de bande ; Y = mean_mag
+        return ([0.5*(b["f_low"]+b["f_high"]) for b in bands], [b["mean_mag"] for b in bands],
+                m, bands[0]["f_low"], bands[-1]["f_high"], st.get("alarm", False))
+
+    def read_shm():
+        st = shm.poll()
+        if st is None or not len(st["mag"]):
+            return None
+        lo, hi = st["f_low"], st["f_high"]
+        return (0.5*(lo + hi), st["mag"], st.get("waterfall"), float(lo[0]), float(hi[-1]), st["alarm"])
+
     while True:
         try:
-            if os.path.exists(args.state):
-                mtime = os.path.getmtime(args.state)
-                if mtime != last_mtime:
-                    last_mtime = mtime
-                    st = load_state(args.state)
-                    if st and "bands" in st:
-                        bands = st["bands"]
-                        # X = centre de bande ; Y = mean_mag
-                        xs = [0.5*(b["f_low"]+b["f_high"]) for b in bands]
-                        ys = [b["mean_mag"] for b in bands]
-                        line.set_data(xs, ys)
-                        ax.relim(); ax.autoscale_view()
-
-                        # ALARM !
-                        if st.get("alarm", False):
-                            alarm_text.set_text("ALARM!")
-                        else:
-                            alarm_text.set_text("")
-
-                        fig.canvas.draw_idle()
-
-            plt.pause(0.05)  # rafraîchit ~20 fps, sans bloquer
+            new = read_shm() if shm else read_file()
+            if new is not None:
+                xs, ys, m, f0, f1, alarm = new
+                line.set_data(xs, ys)
+                ax.relim(); ax.autoscale_view()
+
+                # Waterfall (si présent dans l'état)
+                if m is not None:
+                    if wf_img is None or wf_img.get_array().shape != m.shape:
+                        wf_img = ax_wf.imshow(m, aspect="auto", origin="lower",
+                                              extent=(f0, f1, 0, m.shape[0]),
+                                              interpolation="nearest")
+                    else:
+                        wf_img.set_data(m)
+                    wf_img.set_clim(0, float(m.max()) if m.max() > 0 else 1.0)
+                    ax_wf.set_visible(True)
+
+                # ALARM !
+                if alarm:
+                    alarm_text.set_text("ALARM!")
+                else:
+                    alarm_text.set_text("")
+
+                fig.canvas.draw_idle()
+
+            # le segment se relit pour presque rien : on le sonde à ~50 Hz
+            plt.pause(0.02 if shm else 0.05)
 
         except KeyboardInterrupt:
             break
@@ -2,13 +2,18 @@
 # -*- coding: utf-8 -*-
 """
 GUI FFT pour le son :
-- Lit périodiquement un fichier --state JSON (écrit par le sink C++) :
+- Lit l'état publié par le sink C++ :
+    --shm NAME   : segment mémoire partagée (gui_shm.hpp), mappé avec numpy ;
+                   on ne relit que quand son compteur seq a changé
+    --state PATH : fichier JSON (gui_channel = "file" côté sink)
     {
       "bands":[{"f_low":..,"f_high":..,"mean_mag":..}, ...],
       "max_band_mag": 0.12,
       "alarm": true/false
     }
 - Trace l'amplitude (mean_mag) par bande.
+- Si le state contient "waterfall" ({"rows","cols","data"}), affiche le
+  spectrogramme récent sous la courbe (matrice déjà prête, aucun recalcul).
 - Affiche "ALARM!" en rouge quand alarm = true.
 - Plein écran (--fullscreen) possible.
 - Bip continu (--beep) tant que la fenêtre est ouverte.
@@ -18,13 +23,16 @@ Seuil d’affichage visuel : on se base sur alarm (déjà calculée côté filte
 
 import argparse
 import json
+import mmap
 import os
+import struct
 import time
 import shutil
 import subprocess
 import tkinter as tk
 from tkinter import ttk
 
+import numpy as np
 import matplotlib
 matplotlib.use("TkAgg")
 from matplotlib.backends.backend_tkagg import FigureCanvasTkAgg
@@ -90,6 +98,92 @@ class Beeper:
         except Exception:
             pass
 
+# === lecture du segment partagé écrit par le sink (Common/gui_shm.hpp) =======
+class ShmState:
+    # magic, version, header_size, seq, max_bands, wf_cap, n_bands, wf_rows,
+    # wf_cols, wf_head, max_mag, flags, wf_seq (64 octets)
+    HEADER = struct.Struct("<8sIIQIIIIIIfIQ")
+
+    def __init__(self, name):
+        self.path = "/dev/shm/" + name.lstrip("/")
+        self.mm = None
+        self.last_seq = None
+        self.last_wf_seq = None
+        self.checked = 0.0
+
+    def _open(self):
+        try:
+            fd = os.open(self.path, os.O_RDONLY)
+        except OSError:
+            return False
+        try:
+            st = os.fstat(fd)
+            if st.st_size < self.HEADER.size:
+                return False
+            mm = mmap.mmap(fd, st.st_size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        hdr = self.HEADER.unpack_from(mm, 0)
+        mb, cap = hdr[4], hdr[5]
+        if hdr[0] != b"MADSGUI1" or self.HEADER.size + 4 * mb * (3 + cap) > st.st_size:
+            mm.close()
+            return False
+        self.mm, self.ino = mm, st.st_ino
+        self.max_bands, self.wf_cap = mb, cap
+        buf = np.frombuffer(mm, dtype=np.float32, count=mb * (3 + cap), offset=self.HEADER.size)
+        self.f_low, self.f_high, self.mag = buf[:mb], buf[mb:2 * mb], buf[2 * mb:3 * mb]
+        self.wf = buf[3 * mb:].reshape(cap, mb)
+        self.seq = np.frombuffer(mm, dtype=np.uint64, count=1, offset=16)
+        self.last_seq = self.last_wf_seq = None
+        return True
+
+    def _close(self):
+        self.f_low = self.f_high = self.mag = self.wf = self.seq = None
+        if self.mm is not None:
+            self.mm.close()
+        self.mm = None
+
+    def poll(self):
+        """Nouvel état si le sink a publié depuis le dernier appel, sinon None."""
+        now = time.monotonic()
+        if self.mm is not None and now - self.checked > 1.0:
+            # segment recréé (sink relancé après suppression) : on se rattache
+            self.checked = now
+            try:
+                if os.stat(self.path).st_ino != self.ino:
+                    self._close()
+            except OSError:
+                pass
+        if self.mm is None and not self._open():
+            return None
+        for _ in range(100):
+            s0 = int(self.seq[0])
+            if s0 & 1:
+                continue                     # écriture en cours
+            if s0 == self.last_seq:
+                return None
+            h = self.HEADER.unpack_from(self.mm, 0)
+            if (h[4], h[5]) != (self.max_bands, self.wf_cap):
+                self._close()                # capacités changées : on remappe
+                return None
+            n = min(h[6], self.max_bands)
+            st = {"f_low": self.f_low[:n].copy(), "f_high": self.f_high[:n].copy(),
+                  "mag": self.mag[:n].copy(), "max_mag": h[10], "alarm": bool(h[11] & 1)}
+            wf_rows, wf_cols, wf_head, wf_seq = h[7], h[8], h[9], h[12]
+            if wf_seq != self.last_wf_seq and wf_rows and wf_cols:
+                ring = self.wf[:, :wf_cols]
+                if wf_rows < self.wf_cap:
+                    st["waterfall"] = ring[:wf_rows].copy()
+                else:                        # anneau plein : plus ancienne ligne en wf_head
+                    st["waterfall"] = np.concatenate((ring[wf_head:], ring[:wf_head]))
+            if int(self.seq[0]) != s0:
+                continue                     # réécrit pendant la copie : on recommence
+            self.last_seq = s0
+            if "waterfall" in st:
+                self.last_wf_seq = wf_seq
+            return st
+        return None
+
 # === lecture du state file en polling ========================================
 def load_state(path):
     try:
@@ -110,7 +204,8 @@ def band_centers(bands):
 
 def main():
     ap = argparse.ArgumentParser()
-    ap.add_argument("--state", required=True, help="Chemin du fichier JSON d'état")
+    ap.add_argument("--state", help="Chemin du fichier JSON d'état")
+    ap.add_argument("--shm", help="Nom du segment mémoire partagée (ex. /sound_fft_gui)")
     ap.add_argument("--title", default="FFT Son – Monitoring")
     ap.add_argument("--fmin", type=float, default=0.0)
     ap.add_argument("--fmax", type=float, default=20000.0)
@@ -118,6 +213,8 @@ def main():
     ap.add_argument("--beep", action="store_true")
     ap.add_argument("--beep-interval", type=int, default=1000)
     args = ap.parse_args()
+    if not args.state and not args.shm:
+        ap.error("--state ou --shm requis")
 
     if "DISPLAY" not in os.environ:
         print("Avertissement: pas de DISPLAY. Impossible d'ouvrir une fenêtre GUI.")
@@ -134,13 +231,21 @@ def main():
     alarm_lbl.pack(fill="x")
 
     # figure Matplotlib
-    fig = Figure(figsize=(10, 5), dpi=100)
-    ax = fig.add_subplot(111)
+    fig = Figure(figsize=(10, 7), dpi=100)
+    gs = fig.add_gridspec(2, 1, height_ratios=[3, 2])
+    ax = fig.add_subplot(gs[0])
     ax.set_xlabel("Fréquence (Hz)")
     ax.set_ylabel("Amplitude (moyenne par bande)")
     ax.set_xlim(args.fmin, args.fmax)
     ax.grid(True)
 
+    # waterfall (caché tant que le sink n'en publie pas)
+    ax_wf = fig.add_subplot(gs[1])
+    ax_wf.set_xlabel("Fréquence (Hz)")
+    ax_wf.set_ylabel("Spectres récents")
+    ax_wf.set_visible(False)
+    wf_img = None
+
     canvas = FigureCanvasTkAgg(fig, master=root)
     canvas.get_tk_widget().pack(fill="both", expand=True)
 
@@ -150,35 +255,83 @@ def main():
     beeper = Beeper(root, interval_ms=args.beep_interval) if args.beep else None
     if beeper: beeper.start()
 
-    # polling de fichier (mtime)
+    # polling : compteur seq du segment partagé, ou mtime du fichier
+    shm = ShmState(args.shm) if args.shm else None
     last_mtime = 0
 
-    def refresh():
+    def draw_waterfall(m, f0, f1):
+        nonlocal wf_img
+        rows = m.shape[0]
+        if wf_img is None or wf_img.get_array().shape != m.shape:
+            ax_wf.clear()
+            ax_wf.set_xlabel("Fréquence (Hz)")
+            ax_wf.set_ylabel("Spectres récents")
+            wf_img = ax_wf.imshow(m, aspect="auto", origin="lower",
+                                  extent=(f0, f1, 0, rows), interpolation="nearest")
+        else:
+            wf_img.set_data(m)
+        wf_img.set_clim(0, float(m.max()) if m.max() > 0 else 1.0)
+        ax_wf.set_visible(True)
+
+    def show(xs, ys, wf, f0, f1, alarm):
+        line.set_data(xs, ys)
+        ax.set_xlim(args.fmin, args.fmax)
+        if len(ys):
+            top = float(max(ys))
+            ax.set_ylim(0, top*1.15 if top > 0 else 1.0)
+        if wf is not None:
+            draw_waterfall(wf, f0, f1)
+        canvas.draw_idle()
+
+        if alarm:
+            alarm_lbl.config(text="ALARM!")
+            alarm_lbl.pack(fill="x")
+        else:
+            alarm_lbl.config(text="")
+            alarm_lbl.pack_forget()
+
+    def refresh_shm():
+        st = shm.poll()
+        if st is None:
+            return
+        lo, hi = st["f_low"], st["f_high"]
+        f0 = float(lo[0]) if len(lo) else args.fmin
+        f1 = float(hi[-1]) if len(hi) else args.fmax
+        show(0.5*(lo + hi), st["mag"], st.get("waterfall"), f0, f1, st["alarm"])
+
+    def refresh_file():
         nonlocal last_mtime
+        mtime = os.path.getmtime(args.state)
+        if mtime == last_mtime:
+            return
+        last_mtime = mtime
+        st = load_state(args.state)
+        if not st or not isinstance(st, dict):
+            return
+        bands = st.get("bands", [])
+        xs, ys = band_centers(bands)
+        f0 = bands[0].get("f_low", args.fmin) if bands else args.fmin
+        f1 = bands[-1].get("f_high", args.fmax) if bands else args.fmax
+        m = None
+        wf = st.get("waterfall")
+        if isinstance(wf, dict):
+            rows, cols = int(wf.get("rows", 0)), int(wf.get("cols", 0))
+            data = wf.get("data", [])
+            if rows and cols and len(data) == rows*cols:
+                m = np.asarray(data, dtype=np.float32).reshape(rows, cols)
+        show(xs, ys, m, f0, f1, st.get("alarm", False))
+
+    def refresh():
         try:
-            mtime = os.path.getmtime(args.state)
-            if mtime != last_mtime:
-                last_mtime = mtime
-                st = load_state(args.state)
-                if st and isinstance(st, dict):
-                    bands = st.get("bands", [])
-                    xs, ys = band_centers(bands)
-                    line.set_data(xs, ys)
-                    ax.set_xlim(args.fmin, args.fmax)
-                    if ys:
-                        ax.set_ylim(0, max(ys)*1.15 if max(ys) > 0 else 1.0)
-                    canvas.draw_idle()
-
-                    if st.get("alarm", False):
-                        alarm_lbl.config(text="ALARM!")
-                        alarm_lbl.pack(fill="x")
-                    else:
-                        alarm_lbl.config(text="")
-                        alarm_lbl.pack_forget()
+            if shm:
+                refresh_shm()
+            else:
+                refresh_file()
         except Exception:
             pass
 
-        root.after(200, refresh)
+        # le segment se relit pour presque rien : on le sonde à ~50 Hz
+        root.after(20 if shm else 200, refresh)
 
     def on_close():
         if beeper: beeper.stop()
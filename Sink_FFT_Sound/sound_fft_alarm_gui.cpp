@@ -1,6 +1,7 @@
 // sound_fft_alarm_gui.cpp
-// Sink MADS : écoute le topic "sound_fft", écrit l'état dans un fichier JSON,
-// lance une GUI Python persistante qui lit ce fichier et trace la FFT (bandes) + ALARM.
+// Sink MADS : écoute le topic "sound_fft", publie l'état en mémoire partagée
+// (ou dans un fichier JSON), lance une GUI Python persistante qui le lit et
+// trace la FFT (bandes) + ALARM.
 
 #include <sink.hpp>
 #include <nlohmann/json.hpp>
@@ -12,6 +13,12 @@
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "gui_shm.hpp"
+#include "gui_sink_common.hpp"
 
 using json = nlohmann::json;
 using std::string;
@@ -24,6 +31,9 @@ class SoundFftAlarmGui : public Sink<json> {
 public:
   string kind() override { return PLUGIN_NAME; }
 
+  // le segment partagé ne survit pas au sink (une GUI ouverte se rattache au suivant)
+  ~SoundFftAlarmGui() override { _shm.remove(); }
+
   void set_params(void const *params) override {
     Sink::set_params(params);
     _params.merge_patch(*(json*)params);
@@ -42,12 +52,31 @@ public:
     _beep_interval = _params.value("beep_interval_ms", 1000);
     _fmin          = _params.value("f_min", 0.0);
     _fmax          = _params.value("f_max", 4000.0);
+    _wf_rows       = _params.value("waterfall_rows", 120);     // 0 = pas de waterfall
+    _wf_write_ms   = _params.value("waterfall_write_ms", 500);
+
+    // Canal vers la GUI : "shm" (segment POSIX écrit en place) | "file" (JSON + rename)
+    _channel   = _params.value("gui_channel", string("shm"));
+    _shm_name  = _params.value("shm_name", string("/sound_fft_gui"));
+    _max_bands = std::max(1, _params.value("max_bands", 2048));
+    if (_shm.ok() && (_channel != "shm" || _shm.name() != _shm_name)) _shm.remove();   // ancien segment
+    else _shm.close();
+    if (_channel == "shm") {
+      string err;
+      if (!_shm.open(_shm_name, uint32_t(_max_bands), uint32_t(std::max(0, _wf_rows)), err)) {
+        std::cerr << "[sound_fft_alarm_gui] " << err << " -> fichier " << _state_path << std::endl;
+        _channel = "file";
+      }
+    }
+    // waterfall accumulé côté sink : canal fichier seulement (en shm, anneau du segment)
+    _waterfall.reset(_shm.ok() ? 0 : size_t(std::max(0, _wf_rows)));
 
     // Prépare la commande de lancement (une seule fois)
     std::ostringstream cmd;
-    cmd << _python_path << " " << _script_path
-        << " --state "      << quote(_state_path)
-        << " --title "      << quote(_title)
+    cmd << _python_path << " " << _script_path;
+    if (_shm.ok()) cmd << " --shm "   << quote(_shm_name);
+    else           cmd << " --state " << quote(_state_path);
+    cmd << " --title "      << quote(_title)
         << " --fmin "       << _fmin
         << " --fmax "       << _fmax
         << " --beep-interval " << _beep_interval;
@@ -67,21 +96,46 @@ public:
         return return_type::retry;
 
       const auto &sf = input["sound_fft"];
-      if (!sf.contains("bands") || !sf["bands"].is_array())
+      const bool has_tones = sf.contains("tones") && sf["tones"].is_array();
+      if (!has_tones && (!sf.contains("bands") || !sf["bands"].is_array()))
         return return_type::retry;
 
       bool alarm = sf.value("alarm", false);
-      double max_mag = sf.value("max_band_mag", 0.0);
+      double max_mag = has_tones ? sf.value("max_tone_mag", 0.0) : sf.value("max_band_mag", 0.0);
+
+      // mémoire partagée : bandes et lignes de waterfall écrites en place
+      if (_shm.ok()) {
+        _shm.begin();
+        const uint32_t n = gui_shm::write_bands(_shm, has_tones ? sf["tones"] : sf["bands"],
+                                                has_tones, _truncated);
+        if (_wf_rows > 0 && sf.contains("waterfall") && sf["waterfall"].is_object())
+          gui_shm::write_waterfall(_shm, sf["waterfall"]);
+        _shm.commit(n, float(max_mag), alarm);
+        _updates++;
+        return return_type::success;
+      }
+
+      const json bands = has_tones ? tones_as_bands(sf["tones"]) : sf["bands"];
 
       // On écrit l’état pour la GUI Python (écriture atomique)
       json state;
-      state["bands"]       = sf["bands"];
+      state["bands"]       = bands;
       state["alarm"]       = alarm;
       state["max_band_mag"]= max_mag;
 
       // pour debug/affichage facultatif
       state["topic"]       = topic;
 
+      // waterfall : lignes accumulées ici, matrice écrite périodiquement
+      if (_wf_rows > 0 && sf.contains("waterfall") && sf["waterfall"].is_object()) {
+        _waterfall.add(sf["waterfall"]);
+        const auto now = std::chrono::steady_clock::now();
+        if (now - _wf_last_write >= std::chrono::milliseconds(_wf_write_ms)) {
+          state["waterfall"] = _waterfall.to_json();
+          _wf_last_write = now;
+        }
+      }
+
       // write tmp + rename (atomique)
       const string tmp = _state_path + ".tmp";
       {
@@ -92,7 +146,7 @@ public:
       std::rename(tmp.c_str(), _state_path.c_str());
 
       // log console utile pour mads feedback
-      std::cerr << "[sound_fft_alarm_gui] bands=" << sf["bands"].size()
+      std::cerr << "[sound_fft_alarm_gui] bands=" << bands.size()
                 << " max=" << max_mag
                 << " alarm=" << (alarm ? "true" : "false") << std::endl;
 
@@ -109,6 +163,10 @@ public:
       {"python_path", _python_path},
       {"script_path", _script_path},
       {"state_path",  _state_path},
+      {"gui_channel", _channel},
+      {"shm_name",    _shm_name},
+      {"updates",     std::to_string(_updates)},
+      {"bands_truncated", std::to_string(_truncated)},
       {"title",       _title}
     };
   }
@@ -125,6 +183,15 @@ private:
   bool   _fullscreen{true}, _beep{true};
   int    _beep_interval{1000};
   double _fmin{0.0}, _fmax{4000.0};
+
+  int    _wf_rows{120}, _wf_write_ms{500};
+  WaterfallBuffer _waterfall;
+  std::chrono::steady_clock::time_point _wf_last_write{};
+
+  string _channel{"shm"}, _shm_name{"/sound_fft_gui"};
+  int    _max_bands{2048};
+  gui_shm::Writer _shm;
+  uint64_t _updates{0}, _truncated{0};
 };
 
 INSTALL_SINK_DRIVER(SoundFftAlarmGui, json)
@@ -3,7 +3,22 @@
 // Routes :
 //   GET /          -> page HTML
 //   GET /style.css -> CSS (fichier externe si présent, sinon CSS clair par défaut)
-//   GET /api/last  -> dernier échantillon JSON
+//   GET /<fichier> -> tout fichier de static_dir (JS, images...), servi depuis la mémoire
+//                     (gzip, ou .br/.gz précompressé présent à côté du fichier ; ETag fort)
+//   GET /api/last  -> dernier échantillon JSON (ETag + 304 ; ?wait=s : long-poll
+//                     avec If-None-Match, répond dès qu'une nouvelle version arrive)
+//   GET /api/stream -> flux Server-Sent Events (push à chaque message)
+//   GET /api/history?metric=power_W&since=-600&points=300
+//                  -> historique en mémoire, sous-échantillonné (LTTB) à `points`
+//                     points ; since = epoch (s) ou négatif = relatif à maintenant
+//   GET /api/alerts?since=-86400&until=&machine=&limit=500
+//                  -> alertes overpower_email (historique indexé, voir alerts_history)
+//   GET /metrics   -> exposition Prometheus (valeurs, débit, latences, requêtes HTTP)
+//   GET /api/machines -> machines vues (agent_id / machine_name / hostname), état par machine
+//   GET /api/last?machine=<id> -> dernières valeurs d'une machine (ETag + 304)
+//   GET /api/spectra                    -> sources de spectres connues (JSON)
+//   GET /api/spectrum?source=<id>       -> dernière trame binaire d'une source
+//   GET /api/spectrum/stream?source=<id> -> flux binaire de trames (préfixe u32 = longueur)
 //
 // Paramètres mads.ini [web_dashboard]
 //   sub_topic = ["Ampere"]
@@ -12,6 +27,31 @@
 //   title      = "Monitoring Capteurs – Ampere"
 //   refresh_ms = 500
 //   static_dir = "/home/.../Web_Dashboard/static"   # dossier où l'on met style.css
+//   static_max_age_s   = 0     # Cache-Control des fichiers (0 = no-cache + revalidation ETag)
+//   static_watch       = true  # recharge static_dir sur notification inotify (Linux)
+//   http_threads       = 32    # threads HTTP (1 par client SSE connecté)
+//   stream_max_clients = 24    # clients simultanés par flux (/api/stream, chaque spectre)
+//                              # total des flux borné à http_threads - longpoll_max_waiters - 4
+//   stream_queue       = 16    # messages en attente max par client (sinon déconnecté)
+//   stream_heartbeat_s = 15
+//   longpoll_max_s       = 25  # attente max d'un GET /api/last?wait=
+//   longpoll_max_waiters = 8   # au-delà : 304 immédiat (ne bloque pas le pool)
+//   history_raw_points = 36000 # échantillons bruts conservés (par métrique)
+//   history_1s_points  = 3600  # buckets 1 s  (1 h)
+//   history_10s_points = 8640  # buckets 10 s (24 h)
+//   sparkline_s        = 600   # fenêtre des mini-courbes de la page
+//   metrics = [                # registre des valeurs affichées (défaut : voir kDefaultMetrics)
+//     { key = "current_A", path = ["current_A", "I_A"], label = "Courant", unit = "A", precision = 3 },
+//     { key = "acc_x_g", path = "acceleration.x_g", label = "Accélération X", unit = "g" },
+//   ]
+//   (path : chemin JSON pointé, ou liste d'alternatives ; segment numérique = index de tableau)
+//   Messages groupés de buffered_sp (message.data = [[t_rel, ch0, ch1, ...], ...]) :
+//     { key = "acc_x_g", channel = 0, stat = "rms", ... }   # channel = "to" du map buffered_sp
+//   stat affichée : "last" (défaut), "mean", "min", "max", "rms"
+//   batch_key = "data"
+//   spectrum_keys = ["accel_fft", "sound_fft"]   # sorties des filtres FFT à suivre
+//   machine_keys  = ["agent_id", "machine_name", "hostname"]   # identifiant machine
+//   alerts_history = "/path/to/alerts_history.jsonl"   # history_path d'overpower_email
 // ============================================================================
 
 #include <sink.hpp>
@@ -19,13 +59,34 @@
 #include <pugg/Kernel.h>
 #include <httplib.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <deque>
+#include <filesystem>
 #include <fstream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <zlib.h>
+#include "alert_history.hpp"   // Common/ : lecture de l'historique des alertes d'overpower_email
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 using json = nlohmann::json;
 using namespace std::chrono;
@@ -34,16 +95,616 @@ using namespace std::chrono;
 #define PLUGIN_NAME "web_dashboard"
 #endif
 
-struct LatestSample {
-  std::string ts_iso;   // horodatage affiché
-  double current_A   = NAN;
-  double power_W     = NAN;
-  double acc_x_g     = NAN;
-  double acc_y_g     = NAN;
-  double acc_z_g     = NAN;
-  double sound_level = NAN;
+// ——— registre des métriques : les chemins JSON sont découpés une fois à
+//     set_params(), les valeurs vivent dans un tableau plat indexé par métrique
+struct PathSegment {
+  std::string key;
+  long        index{-1};   // segment numérique : index si le noeud est un tableau
+};
+using JsonPath = std::vector<PathSegment>;
+
+struct MetricDef {
+  std::string           key;       // nom exposé par /api/last et /api/history
+  std::vector<JsonPath> paths;     // alternatives : la première présente gagne
+  std::string           label;
+  std::string           unit;
+  int                   precision{3};
+  int                   channel{-1};   // colonne d'un lot buffered_sp (-1 : via path)
+  int                   stat{0};       // valeur affichée pour un lot (BatchStats::Stat)
+};
+
+// ——— statistiques d'un lot (une colonne de message.data)
+struct BatchStats {
+  enum Stat { Last = 0, Mean, Min, Max, Rms };
+  double   last{NAN}, min{NAN}, max{NAN}, mean{NAN}, rms{NAN};
+  uint32_t n{0};
+
+  double get(int st) const {
+    switch (st) {
+      case Mean: return mean;
+      case Min:  return min;
+      case Max:  return max;
+      case Rms:  return rms;
+      default:   return last;
+    }
+  }
+};
+
+static int parse_stat(const std::string &st) {
+  if (st == "mean") return BatchStats::Mean;
+  if (st == "min")  return BatchStats::Min;
+  if (st == "max")  return BatchStats::Max;
+  if (st == "rms")  return BatchStats::Rms;
+  return BatchStats::Last;
+}
+
+// Une passe sur une colonne contiguë ; quatre accumulateurs indépendants pour
+// que le compilateur puisse paralléliser sans -ffast-math
+static BatchStats column_stats(const double *x, size_t n) {
+  BatchStats st;
+  st.n = uint32_t(n);
+  if (n == 0) return st;
+  double mn[4] = {x[0], x[0], x[0], x[0]}, mx[4] = {x[0], x[0], x[0], x[0]};
+  double sm[4] = {0, 0, 0, 0}, sq[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (size_t k = 0; k < 4; ++k) {
+      const double v = x[i + k];
+      mn[k] = v < mn[k] ? v : mn[k];
+      mx[k] = v > mx[k] ? v : mx[k];
+      sm[k] += v;
+      sq[k] += v * v;
+    }
+  }
+  for (; i < n; ++i) {
+    const double v = x[i];
+    mn[0] = v < mn[0] ? v : mn[0];
+    mx[0] = v > mx[0] ? v : mx[0];
+    sm[0] += v;
+    sq[0] += v * v;
+  }
+  st.min  = std::min(std::min(mn[0], mn[1]), std::min(mn[2], mn[3]));
+  st.max  = std::max(std::max(mx[0], mx[1]), std::max(mx[2], mx[3]));
+  st.mean = (sm[0] + sm[1] + sm[2] + sm[3]) / double(n);
+  st.rms  = std::sqrt((sq[0] + sq[1] + sq[2] + sq[3]) / double(n));
+  st.last = x[n - 1];
+  return st;
+}
+
+// Registre par défaut : accepte aussi I_A / P_W émis par Current_Micro1_JSON.ino
+static const char *kDefaultMetrics = R"([
+  {"key": "current_A",   "path": ["current_A", "I_A"], "label": "Courant",        "unit": "A",         "precision": 3},
+  {"key": "power_W",     "path": ["power_W", "P_W"],   "label": "Puissance",      "unit": "W",         "precision": 1},
+  {"key": "sound_level", "path": "sound_level",        "label": "Son",            "unit": "niveau ADC", "precision": 0},
+  {"key": "acc_x_g",     "path": "acceleration.x_g",   "label": "Accélération X", "unit": "g",         "precision": 3},
+  {"key": "acc_y_g",     "path": "acceleration.y_g",   "label": "Accélération Y", "unit": "g",         "precision": 3},
+  {"key": "acc_z_g",     "path": "acceleration.z_g",   "label": "Accélération Z", "unit": "g",         "precision": 3}
+])";
+
+static JsonPath compile_path(const std::string &p) {
+  JsonPath path;
+  size_t start = 0;
+  while (start <= p.size()) {
+    size_t dot = p.find('.', start);
+    if (dot == std::string::npos) dot = p.size();
+    PathSegment seg;
+    seg.key = p.substr(start, dot - start);
+    if (!seg.key.empty() && std::all_of(seg.key.begin(), seg.key.end(), ::isdigit))
+      seg.index = std::stol(seg.key);
+    if (!seg.key.empty()) path.push_back(std::move(seg));
+    start = dot + 1;
+  }
+  return path;
+}
+
+static std::vector<MetricDef> compile_metrics(const json &arr) {
+  std::vector<MetricDef> out;
+  if (!arr.is_array()) return out;
+  for (const auto &e : arr) {
+    if (!e.is_object() || !e.contains("key") || !e["key"].is_string()) {
+      std::cerr << "[web_dashboard] metric ignored (missing key): " << e.dump() << std::endl;
+      continue;
+    }
+    MetricDef m;
+    m.key       = e["key"].get<std::string>();
+    m.label     = e.value("label", m.key);
+    m.unit      = e.value("unit", std::string{});
+    m.precision = std::clamp(e.value("precision", 3), 0, 10);
+    m.channel   = e.value("channel", -1);
+    m.stat      = parse_stat(e.value("stat", std::string("last")));
+    const json path = e.value("path", json(m.key));
+    if (path.is_string()) m.paths.push_back(compile_path(path.get<std::string>()));
+    else if (path.is_array())
+      for (const auto &alt : path)
+        if (alt.is_string()) m.paths.push_back(compile_path(alt.get<std::string>()));
+    if (m.paths.empty()) {
+      std::cerr << "[web_dashboard] metric ignored (bad path): " << m.key << std::endl;
+      continue;
+    }
+    out.push_back(std::move(m));
+  }
+  return out;
+}
+
+// Suit un chemin pré-découpé ; nullptr si absent
+static const json *resolve_path(const json &root, const JsonPath &path) {
+  const json *node = &root;
+  for (const auto &seg : path) {
+    if (node->is_object()) {
+      auto it = node->find(seg.key);
+      if (it == node->end()) return nullptr;
+      node = &*it;
+    } else if (node->is_array() && seg.index >= 0 && size_t(seg.index) < node->size()) {
+      node = &(*node)[size_t(seg.index)];
+    } else {
+      return nullptr;
+    }
+  }
+  return node;
+}
+
+static std::string html_escape(const std::string &in) {
+  std::string o;
+  o.reserve(in.size());
+  for (char c : in) {
+    switch (c) {
+      case '&': o += "&amp;"; break;
+      case '<': o += "&lt;"; break;
+      case '>': o += "&gt;"; break;
+      case '"': o += "&quot;"; break;
+      default:  o += c;
+    }
+  }
+  return o;
+}
+
+// ——— dernières valeurs : POD de taille fixe publié par seqlock. Un seul écrivain
+//     (load_data) qui n'attend jamais ; un lecteur croisé par une écriture recommence.
+//     Les champs sont des std::atomic<double> relaxés (pas de course au sens C++),
+//     l'ordre étant assuré par le compteur de séquence et les barrières.
+class LatestSeqlock {
+public:
+  static constexpr size_t kMaxMetrics = 64;
+  static constexpr size_t kStats      = 6;   // last, min, max, mean, rms, n
+
+  struct Values {
+    uint64_t version{0};
+    double   t{NAN};                         // epoch (s), heure de réception
+    size_t   n{0};
+    double   v[kMaxMetrics];
+    double   st[kMaxMetrics][kStats];        // st[i][5] = effectif du lot (0 : pas de lot)
+  };
+
+  void publish(double t, const double *v, const BatchStats *st, size_t n) {
+    n = std::min(n, kMaxMetrics);
+    const uint64_t s = _seq.load(std::memory_order_relaxed);
+    _seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _t.store(t, std::memory_order_relaxed);
+    _n.store(n, std::memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i) {
+      _v[i].store(v[i], std::memory_order_relaxed);
+      const double row[kStats] = {st[i].last, st[i].min, st[i].max, st[i].mean, st[i].rms, double(st[i].n)};
+      for (size_t k = 0; k < kStats; ++k) _st[i][k].store(row[k], std::memory_order_relaxed);
+    }
+    _seq.store(s + 2, std::memory_order_release);
+  }
+
+  uint64_t version() const { return _seq.load(std::memory_order_acquire) / 2; }
+
+  void read(Values &out) const {
+    for (unsigned spin = 0;; ++spin) {
+      const uint64_t s0 = _seq.load(std::memory_order_acquire);
+      if (s0 & 1) { if (spin > 64) std::this_thread::yield(); continue; }
+      out.t = _t.load(std::memory_order_relaxed);
+      out.n = std::min(_n.load(std::memory_order_relaxed), kMaxMetrics);
+      for (size_t i = 0; i < out.n; ++i) {
+        out.v[i] = _v[i].load(std::memory_order_relaxed);
+        for (size_t k = 0; k < kStats; ++k) out.st[i][k] = _st[i][k].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_seq.load(std::memory_order_relaxed) == s0) { out.version = s0 / 2; return; }
+    }
+  }
+
+private:
+  std::atomic<uint64_t> _seq{0};
+  std::atomic<double>   _t{NAN};
+  std::atomic<size_t>   _n{0};
+  std::atomic<double>   _v[kMaxMetrics];
+  std::atomic<double>   _st[kMaxMetrics][kStats];
+};
+
+static void append_number(std::string &o, double x) {
+  if (!std::isfinite(x)) { o += "null"; return; }
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.12g", x);
+  o += buf;
+}
+
+static std::string format_local_time(double t_epoch) {
+  std::time_t t = std::time_t(std::floor(t_epoch));
+  std::tm tm{};
+  #ifdef _WIN32
+    localtime_s(&tm, &t);
+  #else
+    localtime_r(&t, &tm);
+  #endif
+  char buf[32];
+  std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+  return buf;
+}
+
+// ——— réponse /api/last figée : sérialisée une fois par mise à jour, partagée
+//     en lecture par tous les threads HTTP (publication par std::atomic_store)
+struct LastSnapshot {
+  uint64_t    version{0};
+  double      t_ingest{NAN};   // epoch (s) de réception, pour la latence de service
+  std::string etag;   // "<boot>-<version>", guillemets compris
+  std::string body;   // JSON prêt à envoyer
+};
+
+// ——— exposition Prometheus : compteurs atomiques, rendus dans un tampon
+//     réutilisé d'un scrape à l'autre (aucune allocation par série)
+class LatencyHistogram {
+public:
+  static constexpr size_t kBuckets = 12;
+  static constexpr double kBounds[kBuckets] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+                                               0.1, 0.25, 0.5, 1.0, 2.5, 5.0};
+
+  void observe(double s) {
+    if (!std::isfinite(s)) return;
+    s = std::max(s, 0.0);
+    size_t i = 0;
+    while (i < kBuckets && s > kBounds[i]) ++i;
+    _b[i].fetch_add(1, std::memory_order_relaxed);
+    _sum_us.fetch_add(uint64_t(s * 1e6), std::memory_order_relaxed);
+  }
+
+  // séries _bucket (cumulées), _sum et _count
+  void render(std::string &o, const char *name, const char *labels) const {
+    char line[256];
+    uint64_t cum = 0;
+    for (size_t i = 0; i <= kBuckets; ++i) {
+      cum += _b[i].load(std::memory_order_relaxed);
+      if (i < kBuckets)
+        std::snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels,
+                      kBounds[i], (unsigned long long)cum);
+      else
+        std::snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels,
+                      (unsigned long long)cum);
+      o += line;
+    }
+    std::snprintf(line, sizeof(line), "%s_sum{%s} %.6f\n%s_count{%s} %llu\n", name, labels,
+                  _sum_us.load(std::memory_order_relaxed) * 1e-6, name, labels,
+                  (unsigned long long)cum);
+    o += line;
+  }
+
+private:
+  std::atomic<uint64_t> _b[kBuckets + 1]{};
+  std::atomic<uint64_t> _sum_us{0};
 };
 
+// routes comptées par /metrics (label route=)
+enum HttpRoute { RoutePage = 0, RouteLast, RouteHistory, RouteStream, RouteMetrics, RouteSpectrum,
+                 RouteMachines, RouteAlerts, RouteStatic, kRouteCount };
+static const char *kRouteNames[kRouteCount] = {"/", "/api/last", "/api/history", "/api/stream", "/metrics",
+                                               "/api/spectrum", "/api/machines", "/api/alerts", "static"};
+
+static HttpRoute route_of(const std::string &path) {
+  if (path == "/")             return RoutePage;
+  if (path == "/api/last")     return RouteLast;
+  if (path == "/api/history")  return RouteHistory;
+  if (path == "/api/stream")   return RouteStream;
+  if (path == "/metrics")      return RouteMetrics;
+  if (path.rfind("/api/spectr", 0) == 0) return RouteSpectrum;
+  if (path == "/api/machines") return RouteMachines;
+  if (path == "/api/alerts")   return RouteAlerts;
+  return RouteStatic;
+}
+
+// valeur de label Prometheus : \\, \" et \n échappés
+static std::string prom_label_value(const std::string &in) {
+  std::string o;
+  for (char c : in) {
+    if (c == '\\' || c == '"') { o += '\\'; o += c; }
+    else if (c == '\n') o += "\\n";
+    else o += c;
+  }
+  return o;
+}
+
+// If-None-Match peut contenir une liste ou "*"
+static bool etag_matches(const std::string &inm, const std::string &etag) {
+  if (inm.empty()) return false;
+  if (inm.find('*') != std::string::npos) return true;
+  return inm.find(etag) != std::string::npos;
+}
+
+// ——— historique en mémoire : anneaux en colonnes (une colonne de temps partagée,
+//     une colonne float par métrique) à trois résolutions : brut, 1 s et 10 s.
+//     Les niveaux agrégés gardent min / max / moyenne de chaque bucket.
+//     Une requête choisit le niveau le plus fin qui couvre la fenêtre avec au plus
+//     kOversample * points éléments : le coût ne dépend pas du nombre d'échantillons bruts.
+class HistoryStore {
+public:
+  struct Series {
+    std::string         resolution;
+    std::vector<double> t;
+    std::vector<float>  v, vmin, vmax;
+  };
+
+  static constexpr size_t kOversample = 4;
+
+  void configure(size_t n_metrics, size_t raw_cap, size_t s1_cap, size_t s10_cap) {
+    std::lock_guard<std::mutex> lk(_mx);
+    _n = n_metrics;
+    _levels.clear();
+    _levels.emplace_back("raw", 0.0,  std::max<size_t>(2, raw_cap), _n);
+    _levels.emplace_back("1s",  1.0,  std::max<size_t>(2, s1_cap),  _n);
+    _levels.emplace_back("10s", 10.0, std::max<size_t>(2, s10_cap), _n);
+    _last_t = -INFINITY;
+  }
+
+  // values[_n] ; NaN = métrique absente de ce message.
+  // Pour un lot : vmin / vmax / moyenne / effectif de chaque métrique (nullptr =
+  // échantillon unique), afin que les niveaux agrégés gardent la vraie enveloppe.
+  void push(double t, const double *values, const double *vmin = nullptr,
+            const double *vmax = nullptr, const double *vmean = nullptr,
+            const uint32_t *count = nullptr) {
+    std::lock_guard<std::mutex> lk(_mx);
+    if (_levels.empty()) return;
+    t = std::max(t, _last_t);   // horloge monotone pour la recherche dichotomique
+    _last_t = t;
+    for (auto &L : _levels) L.add(t, values, vmin, vmax, vmean, count);
+  }
+
+  size_t metrics() const { return _n; }
+
+  bool query(size_t metric, double since, size_t points, Series &out) {
+    std::lock_guard<std::mutex> lk(_mx);
+    if (metric >= _n || _levels.empty()) return false;
+    points = std::max<size_t>(points, 2);
+
+    const Level *best = &_levels.back();
+    for (const auto &L : _levels) {
+      const size_t n = L.count - L.lower_bound(since);
+      const bool covers = L.count < L.cap || (L.count > 0 && L.t_at(0) <= since);
+      if (covers && n <= kOversample * points) { best = &L; break; }
+    }
+
+    // points valides de la fenêtre (les NaN sont ignorés)
+    const Level &L = *best;
+    const float *col  = &L.mean[metric * L.cap];
+    const float *cmin = &L.mn[metric * L.cap];
+    const float *cmax = &L.mx[metric * L.cap];
+    _t.clear(); _v.clear(); _lo.clear(); _hi.clear();
+    for (size_t i = L.lower_bound(since); i < L.count; ++i) {
+      const size_t k = L.slot(i);
+      if (std::isnan(col[k])) continue;
+      _t.push_back(L.t[k]); _v.push_back(col[k]);
+      _lo.push_back(cmin[k]); _hi.push_back(cmax[k]);
+    }
+
+    lttb(_t, _v, points, _sel);
+
+    // chaque point retenu porte l'enveloppe min/max de la tranche qu'il représente
+    out.resolution = L.name;
+    out.t.clear(); out.v.clear(); out.vmin.clear(); out.vmax.clear();
+    for (size_t j = 0; j < _sel.size(); ++j) {
+      const size_t a = _sel[j];
+      const size_t b = (j + 1 < _sel.size()) ? _sel[j + 1] : _t.size();
+      float lo = _lo[a], hi = _hi[a];
+      for (size_t i = a + 1; i < b; ++i) { lo = std::min(lo, _lo[i]); hi = std::max(hi, _hi[i]); }
+      out.t.push_back(_t[a]); out.v.push_back(_v[a]);
+      out.vmin.push_back(lo); out.vmax.push_back(hi);
+    }
+    return true;
+  }
+
+  // Largest-Triangle-Three-Buckets : indices des points conservés, O(n)
+  static void lttb(const std::vector<double> &t, const std::vector<float> &v,
+                   size_t points, std::vector<size_t> &sel) {
+    const size_t n = t.size();
+    sel.clear();
+    if (n <= points) { for (size_t i = 0; i < n; ++i) sel.push_back(i); return; }
+    const double every = double(n - 2) / double(points - 2);
+    size_t a = 0;
+    sel.push_back(0);
+    for (size_t b = 0; b < points - 2; ++b) {
+      size_t r0 = size_t(std::floor((b + 1) * every)) + 1;
+      size_t r1 = std::min(size_t(std::floor((b + 2) * every)) + 1, n);
+      double at = 0.0, av = 0.0;
+      for (size_t i = r0; i < r1; ++i) { at += t[i]; av += v[i]; }
+      const double cnt = double(std::max<size_t>(1, r1 - r0));
+      at /= cnt; av /= cnt;
+
+      const size_t c0 = size_t(std::floor(b * every)) + 1;
+      const size_t c1 = size_t(std::floor((b + 1) * every)) + 1;
+      double best = -1.0; size_t pick = c0;
+      for (size_t i = c0; i < c1; ++i) {
+        const double area = std::fabs((t[a] - at) * (v[i] - v[a]) - (t[a] - t[i]) * (av - v[a]));
+        if (area > best) { best = area; pick = i; }
+      }
+      sel.push_back(pick);
+      a = pick;
+    }
+    sel.push_back(n - 1);
+  }
+
+private:
+  struct Level {
+    std::string name;
+    double width;                 // 0 = brut
+    size_t cap, n, head{0}, count{0};
+    std::vector<double> t;        // instant (brut) ou début du bucket
+    std::vector<float>  mean, mn, mx;   // colonne m : [m*cap, (m+1)*cap)
+    // bucket en cours
+    double open_t{NAN};
+    std::vector<double>   sum;
+    std::vector<uint32_t> cnt;
+    std::vector<float>    omin, omax;
+
+    Level(const char *nm, double w, size_t c, size_t n_metrics)
+      : name(nm), width(w), cap(c), n(n_metrics), t(c),
+        mean(c * n_metrics), mn(c * n_metrics), mx(c * n_metrics) {
+      if (width > 0.0) {
+        sum.assign(n_metrics, 0.0); cnt.assign(n_metrics, 0);
+        omin.assign(n_metrics, INFINITY); omax.assign(n_metrics, -INFINITY);
+      }
+    }
+
+    size_t slot(size_t i) const { return (head + cap - count + i) % cap; }
+    double t_at(size_t i) const { return t[slot(i)]; }
+
+    size_t lower_bound(double since) const {
+      size_t lo = 0, hi = count;
+      while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (t_at(mid) < since) lo = mid + 1; else hi = mid;
+      }
+      return lo;
+    }
+
+    size_t append(double tt) {
+      const size_t k = head;
+      t[k] = tt;
+      head = (head + 1) % cap;
+      if (count < cap) count++;
+      return k;
+    }
+
+    void add(double tt, const double *values, const double *vmin, const double *vmax,
+             const double *vmean, const uint32_t *count) {
+      if (width <= 0.0) {
+        const size_t k = append(tt);
+        for (size_t m = 0; m < n; ++m) {
+          mean[m * cap + k] = float(values[m]);
+          mn[m * cap + k]   = float(vmin && !std::isnan(values[m]) ? vmin[m] : values[m]);
+          mx[m * cap + k]   = float(vmax && !std::isnan(values[m]) ? vmax[m] : values[m]);
+        }
+        return;
+      }
+      const double bt = std::floor(tt / width) * width;
+      if (std::isnan(open_t)) open_t = bt;
+      if (bt > open_t) close_bucket(bt);
+      for (size_t m = 0; m < n; ++m) {
+        const double x = values[m];
+        if (std::isnan(x)) continue;
+        const uint32_t w = count ? std::max<uint32_t>(count[m], 1) : 1;
+        sum[m] += (vmean ? vmean[m] : x) * w; cnt[m] += w;
+        omin[m] = std::min(omin[m], float(vmin ? vmin[m] : x));
+        omax[m] = std::max(omax[m], float(vmax ? vmax[m] : x));
+      }
+    }
+
+    void close_bucket(double next_t) {
+      const size_t k = append(open_t);
+      for (size_t m = 0; m < n; ++m) {
+        const bool has = cnt[m] > 0;
+        mean[m * cap + k] = has ? float(sum[m] / cnt[m]) : NAN;
+        mn[m * cap + k]   = has ? omin[m] : NAN;
+        mx[m * cap + k]   = has ? omax[m] : NAN;
+        sum[m] = 0.0; cnt[m] = 0; omin[m] = INFINITY; omax[m] = -INFINITY;
+      }
+      open_t = next_t;
+    }
+  };
+
+  std::mutex _mx;
+  size_t _n{0};
+  double _last_t{-INFINITY};
+  std::vector<Level> _levels;
+  // tampons de requête réutilisés
+  std::vector<double> _t;
+  std::vector<float>  _v, _lo, _hi;
+  std::vector<size_t> _sel;
+};
+
+// ——— lignes d'historique en attente : file SPSC bornée de lignes de taille fixe.
+//     load_data (seul écrivain) dépose la ligne sans verrou ni allocation ; le thread
+//     de publication (seul lecteur) la verse dans HistoryStore. Le verrou de
+//     l'historique n'est donc partagé qu'entre ce thread et les requêtes /api/history.
+//     File pleine (publieur bloqué par une longue requête) : la ligne est perdue et comptée.
+class HistoryQueue {
+public:
+  static constexpr size_t kCapacity = 256;
+  static constexpr size_t kWidth    = LatestSeqlock::kMaxMetrics;
+
+  struct Row {
+    double   t{NAN};
+    double   v[kWidth], vmin[kWidth], vmax[kWidth], vmean[kWidth];
+    uint32_t n[kWidth];
+  };
+
+  HistoryQueue() : _rows(kCapacity) {}
+
+  // écrivain (load_data)
+  bool push(double t, const double *v, const double *vmin, const double *vmax,
+            const double *vmean, const uint32_t *cnt, size_t n) {
+    const uint64_t h = _head.load(std::memory_order_relaxed);
+    if (h - _tail.load(std::memory_order_acquire) >= kCapacity) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    Row &r = _rows[h % kCapacity];
+    n = std::min(n, kWidth);
+    r.t = t;
+    std::copy(v, v + n, r.v);          std::fill(r.v + n, r.v + kWidth, NAN);
+    std::copy(vmin, vmin + n, r.vmin);
+    std::copy(vmax, vmax + n, r.vmax);
+    std::copy(vmean, vmean + n, r.vmean);
+    std::copy(cnt, cnt + n, r.n);      std::fill(r.n + n, r.n + kWidth, 0u);
+    _head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const {
+    return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_relaxed);
+  }
+
+  // lecteur (thread de publication) : f(const Row&) pour chaque ligne en attente
+  template <class F> size_t drain(F &&f) {
+    const uint64_t t0 = _tail.load(std::memory_order_relaxed);
+    const uint64_t h  = _head.load(std::memory_order_acquire);
+    for (uint64_t i = t0; i < h; ++i) f(_rows[i % kCapacity]);
+    _tail.store(h, std::memory_order_release);
+    return size_t(h - t0);
+  }
+
+  uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  std::vector<Row>      _rows;
+  std::atomic<uint64_t> _head{0}, _tail{0};
+  std::atomic<uint64_t> _dropped{0};
+};
+
+// Sérialisation compacte d'une série (les floats passés par json donneraient 17 chiffres)
+static std::string series_json(const std::string &metric, const HistoryStore::Series &s) {
+  std::string o;
+  o.reserve(64 + s.t.size() * 48);
+  char buf[32];
+  auto arr = [&](const char *key, auto const &vec, const char *fmtspec) {
+    o += ",\""; o += key; o += "\":[";
+    for (size_t i = 0; i < vec.size(); ++i) {
+      if (i) o += ',';
+      std::snprintf(buf, sizeof(buf), fmtspec, double(vec[i]));
+      o += buf;
+    }
+    o += ']';
+  };
+  o += "{\"metric\":" + json(metric).dump();
+  o += ",\"resolution\":\"" + s.resolution + "\"";
+  arr("t",   s.t,    "%.3f");
+  arr("v",   s.v,    "%.6g");
+  arr("min", s.vmin, "%.6g");
+  arr("max", s.vmax, "%.6g");
+  o += '}';
+  return o;
+}
+
 // ——— CSS clair (fallback si on ne trouve pas style.css sur disque) ———
 static const char* kDefaultLightCSS = R"(/* Light theme for lab display */
 *{box-sizing:border-box}
@@ -59,10 +720,12 @@ main{max-width:1200px;margin:24px auto;padding:0 16px;display:grid;gap:20px}
 pre{margin:8px 0 0 0;font-size:16px;background:#f7f7f7;border:1px solid #ddd;border-radius:12px;padding:12px}
 footer{text-align:center;color:#444;font-size:14px;margin:10px 0}
 .mono{font-family: ui-monospace,Menlo,Consolas,monospace}
+.spark{display:block;width:100%;height:56px;margin-top:8px}
 )";
 
 // ——— page HTML (on lie le CSS externe via /style.css) ———
-static std::string make_html(const std::string &title, int refresh_ms) {
+static std::string make_html(const std::string &title, int refresh_ms, int sparkline_s,
+                             const std::vector<MetricDef> &metrics) {
   std::ostringstream h;
   h <<
 R"(<!doctype html>
@@ -76,39 +739,39 @@ R"(<!doctype html>
 <body>
 <header>
   <h1>)" << title << R"(</h1>
+  <select id="machine" style="display:none;font-size:18px"></select>
   <div class="ts" id="ts">—</div>
 </header>
 
 <main>
   <section class="grid">
-    <div class="card">
-      <div class="label">Courant (A)</div>
-      <div class="kpi mono" id="current">—</div>
-    </div>
-    <div class="card">
-      <div class="label">Puissance (W)</div>
-      <div class="kpi mono" id="power">—</div>
-    </div>
-    <div class="card">
-      <div class="label">Son (niveau ADC)</div>
-      <div class="kpi mono" id="sound">—</div>
-    </div>
-  </section>
+)";
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    const auto &m = metrics[i];
+    h << "    <div class=\"card\">\n"
+      << "      <div class=\"label\">" << html_escape(m.label)
+      << (m.unit.empty() ? "" : " (" + html_escape(m.unit) + ")") << "</div>\n"
+      << "      <div class=\"kpi mono\" id=\"m" << i << "\">—</div>\n"
+      << "      <canvas class=\"spark\" data-metric=\"" << html_escape(m.key)
+      << "\" style=\"width:100%;height:56px\"></canvas>\n"
+      << "    </div>\n";
+  }
+  json reg = json::array();
+  for (const auto &m : metrics) reg.push_back({{"key", m.key}, {"precision", m.precision}});
+  std::string reg_js = reg.dump();
+  for (size_t p = 0; (p = reg_js.find("</", p)) != std::string::npos; p += 3) reg_js.replace(p, 2, "<\\/");
+  h <<
+R"(  </section>
 
-  <section class="grid">
-    <div class="card">
-      <div class="label">Accélération X (g)</div>
-      <div class="kpi mono" id="ax">—</div>
-    </div>
-    <div class="card">
-      <div class="label">Accélération Y (g)</div>
-      <div class="kpi mono" id="ay">—</div>
-    </div>
-    <div class="card">
-      <div class="label">Accélération Z (g)</div>
-      <div class="kpi mono" id="az">—</div>
+  <div class="card" id="spec-card" style="display:none">
+    <div class="label">Spectre
+      <select id="spec-src"></select>
+      <label style="font-weight:400"><input type="checkbox" id="spec-wf" checked> waterfall</label>
+      <span class="mono" id="spec-info"></span>
     </div>
-  </section>
+    <canvas id="spec" style="width:100%;height:200px;display:block"></canvas>
+    <canvas id="spec-wf-canvas" style="width:100%;height:240px;display:block;margin-top:8px;background:#000"></canvas>
+  </div>
 
   <div class="card">
     <div class="label">Dernier JSON reçu</div>
@@ -116,39 +779,222 @@ R"(<!doctype html>
   </div>
 </main>
 
-<footer>Données mises à jour automatiquement toutes les )" << refresh_ms << R"( ms</footer>
+<footer id="mode">Données mises à jour automatiquement toutes les )" << refresh_ms << R"( ms</footer>
 
 <script>
 const REFRESH_MS = )" << refresh_ms << R"(;
+const SPARK_S    = )" << sparkline_s << R"(;
+const METRICS    = )" << reg_js << R"(;
 
 function fmt(x, digits=3){ if(x===null||x===undefined||Number.isNaN(x)) return "—"; return Number(x).toFixed(digits); }
 
+function render(j){
+    document.getElementById('ts').textContent = j.ts_iso ?? '—';
+    METRICS.forEach((m, i) => {
+      document.getElementById('m' + i).textContent = fmt(j[m.key], m.precision);
+    });
+    document.getElementById('raw').textContent     = JSON.stringify(j, null, 2);
+}
+
+// Flux SSE (push) si disponible ; sinon, ou en cas de coupure, polling.
+// Une machine choisie dans la liste est suivie par polling de /api/last?machine=
+let es = null, MACHINE = '', ticking = false;
+function kick(){ if(!ticking){ ticking = true; tick(); } }
+function startStream(){
+  if(!window.EventSource || MACHINE) return false;
+  es = new EventSource('/api/stream');
+  es.onopen = () => { document.getElementById('mode').textContent = 'Données en direct (flux)'; };
+  es.onmessage = (ev) => { try{ render(JSON.parse(ev.data)); }catch(e){} };
+  es.onerror = () => {
+    es.close(); es = null;
+    document.getElementById('mode').textContent = 'Données mises à jour toutes les ' + REFRESH_MS + ' ms';
+    setTimeout(kick, REFRESH_MS);
+    setTimeout(() => { if(!es && !MACHINE) startStream(); }, 5000);
+  };
+  return true;
+}
+
+// Polling conditionnel : 304 tant que la version (ETag) n'a pas changé,
+// et long-poll côté serveur pour recevoir la nouvelle version sans attendre
+let etag = null;
 async function tick(){
+  if(es){ ticking = false; return; }  // le flux a repris
   try{
-    const r = await fetch('/api/last', {cache:'no-store'});
+    const h = etag ? {'If-None-Match': etag} : {};
+    const url = MACHINE ? '/api/last?machine=' + encodeURIComponent(MACHINE)
+                        : '/api/last' + (etag ? '?wait=10' : '');
+    const r = await fetch(url, {cache:'no-store', headers:h});
+    if(r.status === 304) return;
     if(!r.ok) throw new Error('HTTP '+r.status);
-    const j = await r.json();
+    etag = r.headers.get('ETag');
+    render(await r.json());
+  }catch(e){}
+  finally{ if(es) ticking = false; else setTimeout(tick, REFRESH_MS); }
+}
+if(!startStream()) kick();
 
-    document.getElementById('ts').textContent = j.ts_iso ?? '—';
-    document.getElementById('current').textContent = fmt(j.current_A, 3);
-    document.getElementById('power').textContent   = fmt(j.power_W, 1);
-    document.getElementById('sound').textContent   = fmt(j.sound_level, 0);
-    document.getElementById('ax').textContent      = fmt(j.acc_x_g, 3);
-    document.getElementById('ay').textContent      = fmt(j.acc_y_g, 3);
-    document.getElementById('az').textContent      = fmt(j.acc_z_g, 3);
-    document.getElementById('raw').textContent     = JSON.stringify(j, null, 2);
+// Liste des machines (affichée dès qu'il y en a plus d'une)
+async function loadMachines(){
+  try{
+    const r = await fetch('/api/machines', {cache:'no-store'});
+    const list = r.ok ? await r.json() : [];
+    const sel = document.getElementById('machine');
+    sel.style.display = list.length > 1 ? '' : 'none';
+    const ids = [''].concat(list.map(m => m.id));
+    if(ids.join() !== Array.from(sel.options).map(o => o.value).join()){
+      sel.innerHTML = '';
+      for(const id of ids){
+        const o = document.createElement('option');
+        o.value = id; o.textContent = id || 'Toutes machines (dernier message)';
+        sel.appendChild(o);
+      }
+      sel.value = ids.includes(MACHINE) ? MACHINE : '';
+    }
   }catch(e){}
-  finally{ setTimeout(tick, REFRESH_MS); }
+  setTimeout(loadMachines, 5000);
+}
+document.getElementById('machine').addEventListener('change', (e) => {
+  MACHINE = e.target.value; etag = null;
+  if(es){ es.close(); es = null; }
+  if(!MACHINE && startStream()) return;
+  kick();
+});
+loadMachines();
+
+// Mini-courbes : enveloppe min/max + valeur, depuis /api/history
+function drawSpark(c, h){
+  const w = c.width = c.clientWidth * (window.devicePixelRatio || 1);
+  const ht = c.height = c.clientHeight * (window.devicePixelRatio || 1);
+  const g = c.getContext('2d');
+  g.clearRect(0, 0, w, ht);
+  const n = h.t.length;
+  if(n < 2) return;
+  let lo = Math.min(...h.min), hi = Math.max(...h.max);
+  if(hi - lo < 1e-9){ hi += 0.5; lo -= 0.5; }
+  const t0 = h.t[0], t1 = h.t[n-1];
+  const X = (t) => (t - t0) / Math.max(t1 - t0, 1e-9) * (w - 2) + 1;
+  const Y = (v) => ht - 2 - (v - lo) / (hi - lo) * (ht - 4);
+  g.fillStyle = '#ddd';
+  g.beginPath();
+  for(let i = 0; i < n; i++) g.lineTo(X(h.t[i]), Y(h.max[i]));
+  for(let i = n - 1; i >= 0; i--) g.lineTo(X(h.t[i]), Y(h.min[i]));
+  g.fill();
+  g.strokeStyle = '#000'; g.lineWidth = 1.5 * (window.devicePixelRatio || 1);
+  g.beginPath();
+  for(let i = 0; i < n; i++) g.lineTo(X(h.t[i]), Y(h.v[i]));
+  g.stroke();
+}
+
+async function sparks(){
+  for(const c of document.querySelectorAll('canvas.spark')){
+    try{
+      const pts = Math.max(32, Math.round(c.clientWidth));
+      const r = await fetch('/api/history?metric=' + encodeURIComponent(c.dataset.metric) + '&since=-' + SPARK_S + '&points=' + pts, {cache:'no-store'});
+      if(r.ok) drawSpark(c, await r.json());
+    }catch(e){}
+  }
+  setTimeout(sparks, 5000);
 }
-tick();
+sparks();
+
+// Spectres : flux binaire (fetch + ReadableStream), trame = en-tête 40 o + Float32Array
+const SPEC_MAGIC = 0x3150534d;  // "MSP1"
+let specAbort = null, specScale = 1e-9;
+function specColor(x){  // 0..1 -> bleu..rouge
+  x = Math.max(0, Math.min(1, x));
+  const h = (1 - x) * 240;
+  return 'hsl(' + h + ',100%,' + (20 + 35 * x) + '%)';
+}
+function drawSpectrum(ab){
+  const dv = new DataView(ab);
+  if(dv.getUint32(0, true) !== SPEC_MAGIC) return;
+  const n = dv.getUint32(4, true), alarm = dv.getUint32(12, true);
+  const fmin = dv.getFloat32(24, true), fmax = dv.getFloat32(28, true);
+  const mags = new Float32Array(ab, 40, n);
+  let m = 0; for(let i = 0; i < n; i++) if(mags[i] > m) m = mags[i];
+  specScale = Math.max(m, specScale * 0.98, 1e-9);
+  document.getElementById('spec-info').textContent =
+    ' ' + fmin.toFixed(0) + '–' + fmax.toFixed(0) + ' Hz, ' + n + ' bandes' + (alarm ? '  ALARME' : '');
+
+  const c = document.getElementById('spec'), dpr = window.devicePixelRatio || 1;
+  const w = c.width = c.clientWidth * dpr, h = c.height = c.clientHeight * dpr;
+  const g = c.getContext('2d');
+  g.clearRect(0, 0, w, h);
+  g.fillStyle = alarm ? '#c00' : '#000';
+  const bw = w / Math.max(n, 1);
+  for(let i = 0; i < n; i++){
+    const bh = mags[i] / specScale * (h - 2);
+    g.fillRect(i * bw, h - bh, Math.max(bw - 1, 1), bh);
+  }
+
+  if(!document.getElementById('spec-wf').checked) return;
+  const wc = document.getElementById('spec-wf-canvas');
+  const ww = Math.round(wc.clientWidth * dpr), wh = Math.round(wc.clientHeight * dpr);
+  if(wc.width !== ww || wc.height !== wh){ wc.width = ww; wc.height = wh; }
+  const wg = wc.getContext('2d');
+  wg.drawImage(wc, 0, 2 * dpr, ww, wh - 2 * dpr, 0, 0, ww, wh - 2 * dpr);  // défilement vers le haut
+  const cw = ww / Math.max(n, 1);
+  for(let i = 0; i < n; i++){
+    wg.fillStyle = specColor(mags[i] / specScale);
+    wg.fillRect(i * cw, wh - 2 * dpr, Math.ceil(cw), 2 * dpr);
+  }
+}
+
+async function startSpectrum(id){
+  if(specAbort) specAbort.abort();
+  const ctl = specAbort = new AbortController();
+  try{
+    const r = await fetch('/api/spectrum/stream?source=' + encodeURIComponent(id), {signal: ctl.signal});
+    if(!r.ok || !r.body) throw new Error('HTTP ' + r.status);
+    const rd = r.body.getReader();
+    let buf = new Uint8Array(0);
+    for(;;){
+      const {value, done} = await rd.read();
+      if(done) break;
+      const nb = new Uint8Array(buf.length + value.length);
+      nb.set(buf); nb.set(value, buf.length); buf = nb;
+      while(buf.length >= 4){
+        const len = new DataView(buf.buffer, buf.byteOffset, 4).getUint32(0, true);
+        if(buf.length < 4 + len) break;
+        if(len > 0) drawSpectrum(buf.slice(4, 4 + len).buffer);  // len 0 : heartbeat
+        buf = buf.slice(4 + len);
+      }
+    }
+  }catch(e){}
+  if(specAbort === ctl) setTimeout(() => { if(specAbort === ctl) startSpectrum(id); }, 2000);
+}
+
+async function loadSpectra(){
+  try{
+    const r = await fetch('/api/spectra', {cache:'no-store'});
+    const list = r.ok ? await r.json() : [];
+    const sel = document.getElementById('spec-src');
+    document.getElementById('spec-card').style.display = list.length ? '' : 'none';
+    const ids = list.map(s => s.id);
+    if(ids.join() !== Array.from(sel.options).map(o => o.value).join()){
+      const cur = sel.value;
+      sel.innerHTML = '';
+      for(const s of list){
+        const o = document.createElement('option');
+        o.value = s.id; o.textContent = s.id;
+        sel.appendChild(o);
+      }
+      if(ids.includes(cur)) sel.value = cur;
+    }
+    if(list.length && !specAbort) startSpectrum(sel.value);
+  }catch(e){}
+  setTimeout(loadSpectra, 5000);
+}
+document.getElementById('spec-src').addEventListener('change', (e) => startSpectrum(e.target.value));
+loadSpectra();
 </script>
 </body></html>
 )";
   return h.str();
 }
 
-// ——— util : lire un fichier texte si présent ———
-static bool slurp_text_file(const std::string& path, std::string& out) {
+// ——— util : lire un fichier (texte ou binaire) si présent ———
+static bool slurp_file(const std::string& path, std::string& out) {
   std::ifstream f(path, std::ios::in | std::ios::binary);
   if(!f) return false;
   std::ostringstream ss;
@@ -157,6 +1003,289 @@ static bool slurp_text_file(const std::string& path, std::string& out) {
   return true;
 }
 
+// ——— ressources statiques en mémoire : la page générée et les fichiers de
+//     static_dir, avec leurs variantes compressées. Le catalogue entier est
+//     reconstruit puis publié d'un bloc (std::atomic_store) ; une requête ne fait
+//     qu'une recherche dans la table et une copie du corps.
+struct Asset {
+  std::string mime;
+  std::string cache_control;
+  std::string etag, etag_gz, etag_br;   // ETag fort par représentation
+  std::string body, gz, br;             // gz / br vides si absents ou pas rentables
+};
+using AssetMap = std::unordered_map<std::string, std::shared_ptr<const Asset>>;
+
+static std::string content_etag(const std::string &data, const char *suffix = "") {
+  uint64_t h = 1469598103934665603ull;   // FNV-1a 64
+  for (unsigned char c : data) { h ^= c; h *= 1099511628211ull; }
+  char buf[40];
+  std::snprintf(buf, sizeof(buf), "\"%016llx%s\"", (unsigned long long)h, suffix);
+  return buf;
+}
+
+static std::string mime_for(const std::string &path) {
+  static const std::pair<const char *, const char *> kTypes[] = {
+    {".html", "text/html; charset=utf-8"},  {".htm", "text/html; charset=utf-8"},
+    {".css",  "text/css; charset=utf-8"},   {".js",  "text/javascript; charset=utf-8"},
+    {".mjs",  "text/javascript; charset=utf-8"},
+    {".json", "application/json; charset=utf-8"},
+    {".svg",  "image/svg+xml"},             {".png", "image/png"},
+    {".jpg",  "image/jpeg"},                {".jpeg", "image/jpeg"},
+    {".gif",  "image/gif"},                 {".ico", "image/x-icon"},
+    {".webp", "image/webp"},                {".woff2", "font/woff2"},
+    {".txt",  "text/plain; charset=utf-8"},
+  };
+  const std::string ext = std::filesystem::path(path).extension().string();
+  for (const auto &t : kTypes)
+    if (ext == t.first) return t.second;
+  return "application/octet-stream";
+}
+
+static bool is_compressible(const std::string &mime) {
+  return mime.rfind("text/", 0) == 0 || mime.find("json") != std::string::npos ||
+         mime.find("svg") != std::string::npos;
+}
+
+static bool gzip_compress(const std::string &in, std::string &out) {
+  z_stream zs{};
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+    return false;
+  out.resize(deflateBound(&zs, uLong(in.size())));
+  zs.next_in   = (Bytef *)in.data();
+  zs.avail_in  = uInt(in.size());
+  zs.next_out  = (Bytef *)&out[0];
+  zs.avail_out = uInt(out.size());
+  const int rc = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return rc == Z_STREAM_END;
+}
+
+// body + éventuels fichiers .gz / .br déjà présents sur disque (prioritaires)
+static std::shared_ptr<const Asset> make_asset(std::string body, std::string mime,
+                                               std::string cache_control,
+                                               const std::string &disk_path = {}) {
+  auto a = std::make_shared<Asset>();
+  a->mime          = std::move(mime);
+  a->cache_control = std::move(cache_control);
+  a->body          = std::move(body);
+  a->etag          = content_etag(a->body);
+  if (!disk_path.empty()) {
+    slurp_file(disk_path + ".br", a->br);
+    slurp_file(disk_path + ".gz", a->gz);
+  }
+  if (a->gz.empty() && is_compressible(a->mime) && a->body.size() > 256) {
+    std::string z;
+    if (gzip_compress(a->body, z) && z.size() < a->body.size()) a->gz = std::move(z);
+  }
+  if (!a->gz.empty()) a->etag_gz = content_etag(a->body, "-gz");
+  if (!a->br.empty()) a->etag_br = content_etag(a->body, "-br");
+  return a;
+}
+
+static bool accepts_encoding(const std::string &ae, const char *enc) {
+  const size_t p = ae.find(enc);
+  if (p == std::string::npos) return false;
+  const size_t q = ae.find(';', p);
+  const size_t c = ae.find(',', p);
+  if (q != std::string::npos && q < c) {
+    const size_t e = ae.find("q=", q);
+    if (e != std::string::npos && e < c && std::atof(ae.c_str() + e + 2) <= 0.0) return false;
+  }
+  return true;
+}
+
+// ——— diffusion SSE : une mise à jour est sérialisée une seule fois, puis le
+//     même buffer (shared_ptr) est déposé dans la file bornée de chaque client.
+//     Un client trop lent (file pleine) est déconnecté au lieu de ralentir les autres.
+class StreamHub {
+public:
+  struct Message {
+    std::string data;       // trame SSE complète ("data: ...\n\n")
+    double      t_ingest;   // epoch (s) de réception
+  };
+  using Event = std::shared_ptr<const Message>;
+
+  struct Client {
+    std::mutex              mx;
+    std::condition_variable cv;
+    std::deque<Event>       q;
+    bool                    dropped{false};
+  };
+
+  void configure(size_t max_clients, size_t queue_len) {
+    std::lock_guard<std::mutex> lk(_mx);
+    _max_clients = std::max<size_t>(1, max_clients);
+    _queue_len   = std::max<size_t>(1, queue_len);
+  }
+
+  // nullptr si trop de clients ; le dernier événement est envoyé d'emblée
+  std::shared_ptr<Client> subscribe() {
+    std::lock_guard<std::mutex> lk(_mx);
+    if (_closed || _clients.size() >= _max_clients) return nullptr;
+    auto c = std::make_shared<Client>();
+    if (_last) c->q.push_back(_last);
+    _clients.push_back(c);
+    return c;
+  }
+
+  void unsubscribe(const std::shared_ptr<Client> &c) {
+    std::lock_guard<std::mutex> lk(_mx);
+    _clients.erase(std::remove(_clients.begin(), _clients.end(), c), _clients.end());
+  }
+
+  void publish(Event ev) {
+    std::lock_guard<std::mutex> lk(_mx);
+    _last = ev;
+    for (auto &c : _clients) {
+      {
+        std::lock_guard<std::mutex> lc(c->mx);
+        if (c->dropped) continue;
+        if (c->q.size() >= _queue_len) { c->dropped = true; c->q.clear(); _dropped++; }
+        else c->q.push_back(ev);
+      }
+      c->cv.notify_one();
+    }
+  }
+
+  // Attend le prochain événement (nullptr au timeout -> heartbeat) ;
+  // false si le client doit être fermé
+  bool next(Client &c, std::chrono::milliseconds timeout, Event &ev) {
+    std::unique_lock<std::mutex> lk(c.mx);
+    c.cv.wait_for(lk, timeout, [&]() { return !c.q.empty() || c.dropped || _closed.load(); });
+    if (c.dropped || _closed.load()) return false;
+    ev = nullptr;
+    if (!c.q.empty()) { ev = std::move(c.q.front()); c.q.pop_front(); }
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lk(_mx);
+    _closed = true;
+    for (auto &c : _clients) {
+      { std::lock_guard<std::mutex> lc(c->mx); }
+      c->cv.notify_all();
+    }
+  }
+
+  size_t clients() { std::lock_guard<std::mutex> lk(_mx); return _clients.size(); }
+  size_t dropped() { std::lock_guard<std::mutex> lk(_mx); return _dropped; }
+
+private:
+  std::mutex _mx;
+  std::vector<std::shared_ptr<Client>> _clients;
+  Event  _last;
+  size_t _max_clients{24}, _queue_len{16}, _dropped{0};
+  std::atomic<bool> _closed{false};
+};
+
+// ——— état par machine : une table de hachage découpée en kShards morceaux,
+//     chacun avec son verrou, tenu seulement le temps de trouver / créer l'entrée.
+//     Les valeurs d'une machine sont ensuite lues sans verrou via son seqlock.
+struct MachineState {
+  std::string             id;
+  std::vector<double>     values;   // écrits seulement par load_data
+  std::vector<BatchStats> stats;
+  LatestSeqlock           latest;
+  std::atomic<uint64_t>   messages{0};
+};
+
+class MachineMap {
+public:
+  static constexpr size_t kShards = 16;
+
+  // Écrivain (load_data) : trouve ou crée l'entrée
+  std::shared_ptr<MachineState> get_or_create(const std::string &id, size_t n_metrics) {
+    Shard &sh = shard(id);
+    std::lock_guard<std::mutex> lk(sh.mx);
+    auto &slot = sh.map[id];
+    if (!slot) {
+      slot = std::make_shared<MachineState>();
+      slot->id = id;
+      slot->values.assign(n_metrics, NAN);
+      slot->stats.assign(n_metrics, BatchStats{});
+    }
+    return slot;
+  }
+
+  std::shared_ptr<MachineState> find(const std::string &id) {
+    Shard &sh = shard(id);
+    std::lock_guard<std::mutex> lk(sh.mx);
+    auto it = sh.map.find(id);
+    return it == sh.map.end() ? nullptr : it->second;
+  }
+
+  // Copie des pointeurs, un morceau à la fois (jamais deux verrous tenus)
+  std::vector<std::shared_ptr<MachineState>> all() {
+    std::vector<std::shared_ptr<MachineState>> out;
+    for (auto &sh : _shards) {
+      std::lock_guard<std::mutex> lk(sh.mx);
+      for (const auto &kv : sh.map) out.push_back(kv.second);
+    }
+    return out;
+  }
+
+  void clear() {
+    for (auto &sh : _shards) { std::lock_guard<std::mutex> lk(sh.mx); sh.map.clear(); }
+  }
+
+private:
+  struct Shard {
+    std::mutex mx;
+    std::unordered_map<std::string, std::shared_ptr<MachineState>> map;
+  };
+  Shard &shard(const std::string &id) { return _shards[std::hash<std::string>{}(id) % kShards]; }
+  Shard _shards[kShards];
+};
+
+// ——— spectres des filtres FFT : la dernière trame binaire de chaque source est
+//     construite une fois à la réception puis envoyée telle quelle aux
+//     navigateurs (Float32Array côté client). Trame (little-endian, 40 o d'en-tête) :
+//       u32 magic "MSP1" | u32 n | u32 seq | u32 alarm | f64 t (epoch s)
+//       f32 f_min | f32 f_max | f32 band_width | f32 max_mag | f32 mag[n]
+//     Sur le flux, chaque trame est précédée de sa longueur (u32) ; 0 = heartbeat.
+static constexpr uint32_t kSpectrumMagic  = 0x3150534d;   // "MSP1"
+static constexpr size_t   kSpectrumHeader = 40;
+
+struct SpectrumSource {
+  std::string id, kind, axis;
+  std::atomic<uint32_t> seq{0};
+  StreamHub   hub;                                   // clients du flux binaire
+  std::shared_ptr<const StreamHub::Message> last;    // std::atomic_load / atomic_store
+};
+
+template <typename T>
+static void put_le(std::string &buf, size_t off, T v) {
+  std::memcpy(&buf[off], &v, sizeof(T));   // cibles little-endian (x86, ARM)
+}
+
+// Trame préfixée de sa longueur, à partir de "bands" [{f_low, f_high, mean_mag}]
+static std::string spectrum_frame(const json &bands, uint32_t seq, bool alarm, double t) {
+  const uint32_t n = uint32_t(bands.size());
+  const uint32_t len = uint32_t(kSpectrumHeader + 4 * n);
+  std::string buf(4 + len, '\0');
+  float f_min = NAN, f_max = NAN, bw = NAN, max_mag = 0.0f;
+  for (uint32_t i = 0; i < n; ++i) {
+    const json &b = bands[i];
+    const float m = float(b.value("mean_mag", 0.0));
+    put_le(buf, 4 + kSpectrumHeader + 4 * i, m);
+    max_mag = std::max(max_mag, m);
+    if (i == 0) { f_min = float(b.value("f_low", 0.0)); bw = float(b.value("f_high", 0.0) - b.value("f_low", 0.0)); }
+    if (i + 1 == n) f_max = float(b.value("f_high", 0.0));
+  }
+  put_le(buf, 0, len);
+  put_le(buf, 4, kSpectrumMagic);
+  put_le(buf, 8, n);
+  put_le(buf, 12, seq);
+  put_le(buf, 16, uint32_t(alarm ? 1 : 0));
+  put_le(buf, 20, t);
+  put_le(buf, 28, f_min);
+  put_le(buf, 32, f_max);
+  put_le(buf, 36, bw);
+  put_le(buf, 40, max_mag);
+  return buf;
+}
+
 class WebDashboardSink : public Sink<json> {
 public:
   std::string kind() override { return PLUGIN_NAME; }
@@ -165,55 +1294,155 @@ public:
     Sink::set_params(params);
     _params.merge_patch(*(json*)params);
 
+    // Serveur et publieur déjà lancés : registre des métriques, tampons, historique
+    // et réglages HTTP sont lus sans verrou par leurs threads, on ne les reconstruit
+    // pas. Seules les limites des flux (protégées par le mutex du hub) suivent.
+    if (_server_started.load()) {
+      _stream_max_clients = _params.value<size_t>("stream_max_clients", 24);
+      _stream_queue       = _params.value<size_t>("stream_queue", 16);
+      _hub.configure(_stream_max_clients, _stream_queue);
+      std::cerr << "[web_dashboard] settings are frozen once the server runs, "
+                   "restart the agent to apply them" << std::endl;
+      return;
+    }
+
     _host       = _params.value<std::string>("http_host", "0.0.0.0");
     _port       = _params.value<int>("http_port", 8088);
     _title      = _params.value<std::string>("title", "Monitoring Capteurs – Ampere");
     _refresh_ms = _params.value<int>("refresh_ms", 500);
     _static_dir = _params.value<std::string>("static_dir", "");
+    _static_max_age_s = _params.value<int>("static_max_age_s", 0);
+    _static_watch     = _params.value<bool>("static_watch", true);
+    _http_threads = _params.value<int>("http_threads", 32);
+    _heartbeat_s  = _params.value<int>("stream_heartbeat_s", 15);
+    _hub.configure(_params.value<size_t>("stream_max_clients", 24),
+                   _params.value<size_t>("stream_queue", 16));
+    _longpoll_max_s       = _params.value<int>("longpoll_max_s", 25);
+    _longpoll_max_waiters = _params.value<int>("longpoll_max_waiters", 8);
+    _sparkline_s          = _params.value<int>("sparkline_s", 600);
+    _alerts_history       = _params.value<std::string>("alerts_history", "");
+    _metrics = compile_metrics(_params.contains("metrics") ? _params["metrics"]
+                                                           : json::parse(kDefaultMetrics));
+    if (_metrics.empty()) {
+      std::cerr << "[web_dashboard] no valid metric, using the default set" << std::endl;
+      _metrics = compile_metrics(json::parse(kDefaultMetrics));
+    }
+    if (_metrics.size() > LatestSeqlock::kMaxMetrics) {
+      std::cerr << "[web_dashboard] only the first " << LatestSeqlock::kMaxMetrics
+                << " metrics are kept" << std::endl;
+      _metrics.resize(LatestSeqlock::kMaxMetrics);
+    }
+    _key_json.clear();
+    _prom_labels.clear();
+    for (const auto &m : _metrics) {
+      _key_json.push_back(json(m.key).dump());
+      _prom_labels.push_back("metric=\"" + prom_label_value(m.key) + "\"");
+    }
+    _values.assign(_metrics.size(), NAN);
+    _row.assign(_metrics.size(), NAN);
+    _row_min.assign(_metrics.size(), NAN);
+    _row_max.assign(_metrics.size(), NAN);
+    _row_mean.assign(_metrics.size(), NAN);
+    _row_n.assign(_metrics.size(), 0);
+    _stats.assign(_metrics.size(), BatchStats{});
+    _batch_key = _params.value<std::string>("batch_key", "data");
+    _spectrum_keys = _params.value<std::vector<std::string>>("spectrum_keys", {"accel_fft", "sound_fft"});
+    _machine_keys  = _params.value<std::vector<std::string>>("machine_keys",
+                                                             {"agent_id", "machine_name", "hostname"});
+    _stream_max_clients = _params.value<size_t>("stream_max_clients", 24);
+    _stream_queue       = _params.value<size_t>("stream_queue", 16);
+    // Budget global des flux (SSE + spectres) : chaque connexion tient un thread
+    // du pool, on en garde pour /api/last, les long-polls et /api/history.
+    _stream_budget = std::max(1, std::max(4, _http_threads) - std::max(0, _longpoll_max_waiters)
+                                 - kHttpReservedThreads);
+    _chan_metrics.clear();
+    for (size_t i = 0; i < _metrics.size(); ++i)
+      if (_metrics[i].channel >= 0) _chan_metrics.push_back(i);
+    _history.configure(_metrics.size(),
+                       _params.value<size_t>("history_raw_points", 36000),
+                       _params.value<size_t>("history_1s_points", 3600),
+                       _params.value<size_t>("history_10s_points", 8640));
 
-    if(!_server_started.exchange(true)) start_http_server();
+    build_assets();
+    if(!_server_started.exchange(true)) {
+      start_http_server();
+      _pub_thread = std::thread([this]() { publisher_loop(); });
+      if (_static_watch && !_static_dir.empty())
+        _watch_thread = std::thread([this]() { watch_static_dir(); });
+    }
   }
 
-  return_type load_data(json const &input, std::string /*topic*/) override {
+  return_type load_data(json const &input, std::string topic) override {
     try {
       const json* root = &input;
       if (input.contains("message") && input["message"].is_object())
         root = &input["message"];
 
-      LatestSample s{};
-      if (root->contains("timestamp") && (*root)["timestamp"].is_string()) {
-        s.ts_iso = (*root)["timestamp"].get<std::string>();
-      } else {
-        // ici on force l'heure locale
-        auto now = system_clock::now();
-        std::time_t t = system_clock::to_time_t(now);
-        std::tm tm{};
-        #ifdef _WIN32
-          localtime_s(&tm, &t);
-        #else
-          localtime_r(&t, &tm);
-        #endif
-        char buf[32];
-        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
-        s.ts_iso = buf;
-      }
-
-      auto num = [&](const char* k, double& dst){
+      // identifiant machine : dans le message, sinon à la racine (agent_id de buffered_sp)
+      const std::string machine = machine_id(input, *root);
+
+      // sorties accel_fft / sound_fft : trame spectre de la source
+      for (const auto &k : _spectrum_keys) {
         auto it = root->find(k);
-        if (it!=root->end() && it->is_number()) dst = it->get<double>();
-      };
-      num("current_A",   s.current_A);
-      num("power_W",     s.power_W);
-      num("sound_level", s.sound_level);
+        if (it != root->end() && it->is_object())
+          ingest_spectrum(machine.empty() ? topic : machine + "/" + topic, k, *it);
+      }
+
+      // O(métriques) : chemins déjà découpés, valeurs dans un tableau plat.
+      // Une métrique absente du message garde sa dernière valeur (les deux
+      // Arduinos publient des champs différents).
+      std::fill(_row.begin(), _row.end(), NAN);
+      std::fill(_row_n.begin(), _row_n.end(), 0u);
+
+      // lot buffered_sp : les métriques avec `channel` sont lues dans message.data
+      const json *batch = nullptr;
+      if (!_chan_metrics.empty()) {
+        auto it = root->find(_batch_key);
+        if (it != root->end() && it->is_array() && !it->empty() && it->front().is_array())
+          batch = &*it;
+      }
+      bool any = batch ? ingest_batch(*batch) : false;
 
-      if (root->contains("acceleration") && (*root)["acceleration"].is_object()) {
-        const json& acc = (*root)["acceleration"];
-        if (acc.contains("x_g") && acc["x_g"].is_number()) s.acc_x_g = acc["x_g"].get<double>();
-        if (acc.contains("y_g") && acc["y_g"].is_number()) s.acc_y_g = acc["y_g"].get<double>();
-        if (acc.contains("z_g") && acc["z_g"].is_number()) s.acc_z_g = acc["z_g"].get<double>();
+      for (size_t i = 0; i < _metrics.size(); ++i) {
+        if (batch && _metrics[i].channel >= 0) continue;
+        for (const auto &path : _metrics[i].paths) {
+          const json *v = resolve_path(*root, path);
+          if (v && v->is_number()) {
+            const double x = v->get<double>();
+            _row[i] = _row_min[i] = _row_max[i] = _row_mean[i] = _values[i] = x;
+            _row_n[i] = 1;
+            any = true;
+            break;
+          }
+        }
       }
+      if (!any) return return_type::success;
+
+      // horodatage de réception (numérique ; mis en forme à la lecture, en heure locale)
+      const double t = duration<double>(system_clock::now().time_since_epoch()).count();
+      // historique : ligne déposée dans la file, versée dans HistoryStore par le
+      // thread de publication (load_data ne prend jamais le verrou de l'historique)
+      _history_q.push(t, _row.data(), _row_min.data(), _row_max.data(), _row_mean.data(),
+                      _row_n.data(), _metrics.size());
 
-      { std::lock_guard<std::mutex> lk(_mx); _last = s; _has_last = true; }
+      // publication sans attente : seqlock + réveil du thread de mise en forme
+      // (la notification sans verrou peut se perdre : le publieur scrute aussi
+      //  la version toutes les kPublisherPollMs)
+      _latest.publish(t, _values.data(), _stats.data(), _metrics.size());
+      _msg_total.fetch_add(1, std::memory_order_relaxed);
+
+      // état propre à la machine (sans identifiant : seulement l'état global ci-dessus)
+      if (!machine.empty()) {
+        auto m = _machines.get_or_create(machine, _metrics.size());
+        for (size_t i = 0; i < _metrics.size(); ++i) {
+          if (_row_n[i] == 0) continue;
+          m->values[i] = _row[i];
+          if (batch && _metrics[i].channel >= 0) m->stats[i] = _stats[i];
+        }
+        m->latest.publish(t, m->values.data(), m->stats.data(), _metrics.size());
+        m->messages.fetch_add(1, std::memory_order_relaxed);
+      }
+      _pub_cv.notify_one();
       return return_type::success;
 
     } catch (const std::exception& e) {
@@ -223,6 +1452,18 @@ public:
   }
 
   ~WebDashboardSink() override {
+    { std::lock_guard<std::mutex> lk(_pub_mx); _pub_stop = true; }
+    _pub_cv.notify_all();
+    if (_pub_thread.joinable()) _pub_thread.join();
+    _watch_stop = true;
+    if (_watch_thread.joinable()) _watch_thread.join();
+    _hub.close();
+    {
+      std::lock_guard<std::mutex> lk(_spec_mx);
+      for (auto &kv : _spectra) kv.second->hub.close();
+    }
+    { std::lock_guard<std::mutex> lk(_ver_mx); _stopping = true; }
+    _ver_cv.notify_all();
     if (_server_started.load()) {
       _svr.stop();
       if (_http_thread.joinable()) _http_thread.join();
@@ -235,47 +1476,641 @@ public:
       {"http_port", std::to_string(_port)},
       {"title", _title},
       {"refresh_ms", std::to_string(_refresh_ms)},
-      {"static_dir", _static_dir}
+      {"static_dir", _static_dir},
+      {"metrics", std::to_string(_metrics.size())},
+      {"http_threads", std::to_string(_http_threads)},
+      {"stream_clients", std::to_string(_hub.clients())},
+      {"stream_dropped", std::to_string(_hub.dropped())},
+      {"streams", std::to_string(_streams.load()) + "/" + std::to_string(_stream_budget)},
+      {"history_dropped", std::to_string(_history_q.dropped())},
+      {"version", std::to_string(std::atomic_load(&_snap)->version)}
     };
   }
 
 private:
-  void start_http_server() {
-    // Page HTML
-    _svr.Get("/", [this](const httplib::Request&, httplib::Response& res) {
-      res.set_content(make_html(_title, _refresh_ms), "text/html; charset=utf-8");
-    });
+  static std::shared_ptr<const LastSnapshot> initial_snapshot() {
+    auto snap = std::make_shared<LastSnapshot>();
+    snap->etag = "\"" + boot_id() + "-0\"";
+    snap->body = json{{"status", "no_data_yet"}}.dump();
+    return snap;
+  }
+
+  // distingue les instances : un redémarrage ne doit pas produire de faux 304
+  static const std::string &boot_id() {
+    static const std::string id = [] {
+      std::ostringstream os;
+      os << std::hex << duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+      return os.str();
+    }();
+    return id;
+  }
+
+  std::string machine_id(const json &input, const json &root) const {
+    for (const auto &k : _machine_keys) {
+      for (const json *node : {&root, &input}) {
+        auto it = node->find(k);
+        if (it != node->end() && it->is_string() && !it->get_ref<const std::string &>().empty())
+          return it->get<std::string>();
+      }
+    }
+    return {};
+  }
+
+  // Une source = [machine/]topic (+ axe pour accel_fft) ; créée au premier spectre reçu
+  void ingest_spectrum(const std::string &topic, const std::string &kind, const json &obj) {
+    auto bit = obj.find("bands");
+    if (bit == obj.end() || !bit->is_array() || bit->empty()) return;   // ex. mode goertzel
+    const std::string axis = obj.value("axis", std::string{});
+    std::string id = topic.empty() ? kind : topic;
+    if (!axis.empty()) id += "." + axis;
+
+    std::shared_ptr<SpectrumSource> src;
+    {
+      std::lock_guard<std::mutex> lk(_spec_mx);
+      auto &slot = _spectra[id];
+      if (!slot) {
+        slot = std::make_shared<SpectrumSource>();
+        slot->id = id; slot->kind = kind; slot->axis = axis;
+        slot->hub.configure(_stream_max_clients, _stream_queue);
+      }
+      src = slot;
+    }
+    const double t = duration<double>(system_clock::now().time_since_epoch()).count();
+    auto msg = std::make_shared<const StreamHub::Message>(
+      StreamHub::Message{spectrum_frame(*bit, ++src->seq, obj.value("alarm", false), t), t});
+    std::atomic_store(&src->last, msg);
+    src->hub.publish(msg);
+  }
+
+  std::shared_ptr<SpectrumSource> find_spectrum(const std::string &id) {
+    std::lock_guard<std::mutex> lk(_spec_mx);
+    auto it = _spectra.find(id);
+    return it == _spectra.end() ? nullptr : it->second;
+  }
+
+  // Rassemble chaque colonne du lot dans un tampon contigu, puis une passe
+  // de statistiques par colonne. Retourne true si au moins une valeur lue.
+  bool ingest_batch(const json &batch) {
+    const size_t rows = batch.size();
+    _cols.resize(rows * _chan_metrics.size());
+    _col_n.assign(_chan_metrics.size(), 0);
+    for (const auto &r : batch) {
+      if (!r.is_array()) continue;
+      for (size_t j = 0; j < _chan_metrics.size(); ++j) {
+        const size_t c = size_t(_metrics[_chan_metrics[j]].channel) + 1;   // r[0] = t_rel
+        if (c < r.size() && r[c].is_number())
+          _cols[j * rows + _col_n[j]++] = r[c].get<double>();
+      }
+    }
+    bool any = false;
+    for (size_t j = 0; j < _chan_metrics.size(); ++j) {
+      if (_col_n[j] == 0) continue;
+      const size_t i = _chan_metrics[j];
+      const BatchStats st = column_stats(&_cols[j * rows], _col_n[j]);
+      _stats[i]    = st;
+      _values[i]   = _row[i] = st.get(_metrics[i].stat);
+      _row_min[i]  = st.min;
+      _row_max[i]  = st.max;
+      _row_mean[i] = st.mean;
+      _row_n[i]    = st.n;
+      any = true;
+    }
+    return any;
+  }
 
-    // CSS : on sert <static_dir>/style.css si présent, sinon le CSS clair par défaut
-    _svr.Get("/style.css", [this](const httplib::Request&, httplib::Response& res) {
-      std::string css;
-      if (!_static_dir.empty()) {
-        std::string path = _static_dir + "/style.css";
-        if (slurp_text_file(path, css)) {
-          res.set_content(css, "text/css; charset=utf-8");
-          return;
+  // JSON de /api/last à partir d'une copie du POD
+  std::string format_latest(const LatestSeqlock::Values &v, const std::string &machine = {}) const {
+    static const char *kStatNames[LatestSeqlock::kStats] = {"last", "min", "max", "mean", "rms", "n"};
+    std::string o;
+    o.reserve(64 + v.n * 32);
+    o += "{\"ts_iso\":\"" + format_local_time(v.t) + "\"";
+    if (!machine.empty()) o += ",\"machine\":" + json(machine).dump();
+    for (size_t i = 0; i < v.n; ++i) {
+      o += ','; o += _key_json[i]; o += ':';
+      append_number(o, v.v[i]);
+    }
+    bool first = true;
+    for (size_t i = 0; i < v.n; ++i) {
+      if (v.st[i][5] <= 0.0) continue;
+      o += first ? ",\"stats\":{" : ",";
+      first = false;
+      o += _key_json[i]; o += ":{";
+      for (size_t k = 0; k < LatestSeqlock::kStats; ++k) {
+        if (k) o += ',';
+        o += '"'; o += kStatNames[k]; o += "\":";
+        append_number(o, v.st[i][k]);
+      }
+      o += '}';
+    }
+    if (!first) o += '}';
+    o += '}';
+    return o;
+  }
+
+  // Une place dans le budget global des flux ; false (-> 503) si épuisé
+  bool acquire_stream() {
+    if (_streams.fetch_add(1) < _stream_budget) return true;
+    _streams.fetch_sub(1);
+    return false;
+  }
+  void release_stream() { _streams.fetch_sub(1); }
+
+  // Thread de publication : lit le seqlock, met en forme une fois par version
+  // (les rafales sont fusionnées), puis alimente /api/last et le flux SSE ;
+  // verse ensuite les lignes en attente dans l'historique (seul écrivain de
+  // HistoryStore, dont le verrou n'est partagé qu'avec /api/history).
+  // Tout le travail d'allocation, de diffusion et d'historique est donc hors de load_data.
+  void publisher_loop() {
+    auto v = std::make_unique<LatestSeqlock::Values>();
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lk(_pub_mx);
+    while (!_pub_stop) {
+      _pub_cv.wait_for(lk, milliseconds(kPublisherPollMs), [&]() {
+        return _pub_stop || _latest.version() != seen || !_history_q.empty();
+      });
+      if (_pub_stop) break;
+      lk.unlock();
+      if (_latest.version() != seen) {
+        _latest.read(*v);
+        seen = v->version;
+        auto snap = publish_snapshot(v->version, v->t, format_latest(*v));
+        _hub.publish(std::make_shared<const StreamHub::Message>(
+          StreamHub::Message{"data: " + snap->body + "\n\n", v->t}));
+      }
+      _history_q.drain([this](const HistoryQueue::Row &r) {
+        _history.push(r.t, r.v, r.vmin, r.vmax, r.vmean, r.n);
+      });
+      lk.lock();
+    }
+  }
+
+  size_t metric_index(const std::string &key) const {
+    for (size_t i = 0; i < _metrics.size(); ++i)
+      if (_metrics[i].key == key) return i;
+    return _metrics.size();
+  }
+
+  // Publie une nouvelle version (thread de publication) ; les lecteurs HTTP ne prennent aucun verrou.
+  // Le mutex ne sert qu'à réveiller les long-polls en attente (s'il y en a).
+  std::shared_ptr<const LastSnapshot> publish_snapshot(uint64_t version, double t_ingest, std::string body) {
+    auto snap = std::make_shared<LastSnapshot>();
+    snap->version  = version;
+    snap->t_ingest = t_ingest;
+    snap->etag    = "\"" + _boot_id + "-" + std::to_string(snap->version) + "\"";
+    snap->body    = std::move(body);
+    std::shared_ptr<const LastSnapshot> c = snap;
+    std::atomic_store(&_snap, c);
+    if (_waiters.load(std::memory_order_acquire) > 0) {
+      { std::lock_guard<std::mutex> lk(_ver_mx); }
+      _ver_cv.notify_all();
+    }
+    return c;
+  }
+
+  // Reconstruit tout le catalogue (page + static_dir) puis le publie d'un bloc
+  void build_assets() {
+    auto map = std::make_shared<AssetMap>();
+    const std::string cc = _static_max_age_s > 0
+      ? "public, max-age=" + std::to_string(_static_max_age_s) : "no-cache";
+
+    (*map)["/"] = make_asset(make_html(_title, _refresh_ms, _sparkline_s, _metrics),
+                             "text/html; charset=utf-8", "no-cache");
+    (*map)["/style.css"] = make_asset(kDefaultLightCSS, "text/css; charset=utf-8", cc);
+
+    std::vector<std::string> dirs;
+    if (!_static_dir.empty()) {
+      namespace fs = std::filesystem;
+      std::error_code ec;
+      const fs::path root(_static_dir);
+      if (fs::is_directory(root, ec)) dirs.push_back(root.string());
+      for (fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec), end;
+           !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec)) { dirs.push_back(it->path().string()); continue; }
+        if (!it->is_regular_file(ec)) continue;
+        const std::string ext = it->path().extension().string();
+        if (ext == ".gz" || ext == ".br") continue;   // variantes d'un autre fichier
+        std::string body;
+        if (!slurp_file(it->path().string(), body)) continue;
+        const std::string url = "/" + it->path().lexically_relative(root).generic_string();
+        (*map)[url] = make_asset(std::move(body), mime_for(url), cc, it->path().string());
+      }
+    }
+    std::atomic_store(&_assets, std::shared_ptr<const AssetMap>(map));
+    std::lock_guard<std::mutex> lk(_dirs_mx);
+    _static_dirs = std::move(dirs);
+  }
+
+  // Recherche + copie ; 304 si l'ETag de la représentation choisie correspond
+  bool serve_asset(const std::string &url, const httplib::Request &req, httplib::Response &res) {
+    auto assets = std::atomic_load(&_assets);
+    if (!assets) return false;
+    auto it = assets->find(url);
+    if (it == assets->end()) return false;
+    const Asset &a = *it->second;
+
+    const std::string ae = req.get_header_value("Accept-Encoding");
+    const std::string *body = &a.body, *etag = &a.etag;
+    const char *enc = nullptr;
+    if (!a.br.empty() && accepts_encoding(ae, "br"))        { body = &a.br; etag = &a.etag_br; enc = "br"; }
+    else if (!a.gz.empty() && accepts_encoding(ae, "gzip")) { body = &a.gz; etag = &a.etag_gz; enc = "gzip"; }
+
+    res.set_header("ETag", *etag);
+    res.set_header("Cache-Control", a.cache_control);
+    if (!a.gz.empty() || !a.br.empty()) res.set_header("Vary", "Accept-Encoding");
+    if (etag_matches(req.get_header_value("If-None-Match"), *etag)) {
+      res.status = 304;
+      return true;
+    }
+    if (enc) res.set_header("Content-Encoding", enc);
+    res.set_content(*body, a.mime);
+    return true;
+  }
+
+  // Recharge le catalogue quand un fichier de static_dir change (Linux/inotify).
+  // Ailleurs, les fichiers sont lus une seule fois au démarrage.
+  void watch_static_dir() {
+#ifdef __linux__
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+      std::cerr << "[web_dashboard] inotify unavailable, static files will not reload" << std::endl;
+      return;
+    }
+    const uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                          IN_MOVED_TO | IN_DELETE_SELF;
+    // ajouter un dossier déjà surveillé est sans effet : on ré-arme après chaque
+    // rechargement pour suivre les nouveaux sous-dossiers
+    auto arm = [&]() {
+      std::lock_guard<std::mutex> lk(_dirs_mx);
+      for (const auto &d : _static_dirs) inotify_add_watch(fd, d.c_str(), mask);
+    };
+    // vide la file ; true si un événement concerne le contenu (pas IN_IGNORED)
+    auto drain = [&]() {
+      alignas(struct inotify_event) char buf[4096];
+      bool any = false;
+      ssize_t n;
+      while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+          const auto *ev = reinterpret_cast<const struct inotify_event *>(p);
+          if (ev->mask & mask) any = true;
+          p += sizeof(struct inotify_event) + ev->len;
         }
       }
-      res.set_content(kDefaultLightCSS, "text/css; charset=utf-8");
+      return any;
+    };
+    arm();
+    while (!_watch_stop.load()) {
+      pollfd pfd{fd, POLLIN, 0};
+      if (::poll(&pfd, 1, 500) <= 0 || !drain()) continue;
+      // regroupe les rafales d'événements (éditeur : écriture puis renommage)
+      std::this_thread::sleep_for(milliseconds(200));
+      drain();
+      build_assets();
+      arm();
+      std::cerr << "[web_dashboard] static files reloaded" << std::endl;
+    }
+    ::close(fd);
+#endif
+  }
+
+  // /api/last?machine= : copie du seqlock de la machine, mise en forme à la lecture
+  void serve_machine(const std::string &id, const httplib::Request &req, httplib::Response &res) {
+    auto m = _machines.find(id);
+    if (!m) {
+      res.status = 404;
+      res.set_content(json{{"error", "unknown machine"}, {"machine", id}}.dump(),
+                      "application/json; charset=utf-8");
+      return;
+    }
+    const std::string etag = "\"" + _boot_id + "-m" + std::to_string(m->latest.version()) + "\"";
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "no-cache");
+    if (etag_matches(req.get_header_value("If-None-Match"), etag)) {
+      res.status = 304;
+      return;
+    }
+    auto v = std::make_unique<LatestSeqlock::Values>();
+    m->latest.read(*v);
+    res.set_content(format_latest(*v, m->id), "application/json; charset=utf-8");
+  }
+
+  // Rendu texte Prometheus dans `o` (vidé, capacité conservée) ; valeurs lues
+  // dans le seqlock, donc sans bloquer l'ingestion
+  void render_metrics(std::string &o) {
+    o.clear();
+    char line[512];
+    _latest.read(*_prom_values);
+    const auto &v = *_prom_values;
+
+    o += "# HELP mads_dashboard_value Latest value of each configured metric.\n"
+         "# TYPE mads_dashboard_value gauge\n";
+    for (size_t i = 0; i < v.n && i < _prom_labels.size(); ++i) {
+      o += "mads_dashboard_value{"; o += _prom_labels[i]; o += "} ";
+      if (std::isfinite(v.v[i])) { std::snprintf(line, sizeof(line), "%.12g\n", v.v[i]); o += line; }
+      else o += "NaN\n";
+    }
+
+    const double now = duration<double>(system_clock::now().time_since_epoch()).count();
+    const uint64_t total = _msg_total.load(std::memory_order_relaxed);
+    const double dt = now - _prom_last_t;
+    const double rate = dt > 0.0 ? double(total - _prom_last_total) / dt : 0.0;
+    _prom_last_t = now;
+    _prom_last_total = total;
+
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_last_update_seconds Reception time of the latest message (epoch).\n"
+      "# TYPE mads_dashboard_last_update_seconds gauge\n"
+      "mads_dashboard_last_update_seconds %.3f\n", std::isfinite(v.t) ? v.t : 0.0);
+    o += line;
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_messages_total Messages ingested.\n"
+      "# TYPE mads_dashboard_messages_total counter\n"
+      "mads_dashboard_messages_total %llu\n", (unsigned long long)total);
+    o += line;
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_ingest_rate_hz Message rate since the previous scrape.\n"
+      "# TYPE mads_dashboard_ingest_rate_hz gauge\n"
+      "mads_dashboard_ingest_rate_hz %.3f\n", rate);
+    o += line;
+
+    o += "# HELP mads_dashboard_ingest_to_serve_seconds Delay between reception and delivery to a client.\n"
+         "# TYPE mads_dashboard_ingest_to_serve_seconds histogram\n";
+    _lat_last.render(o, "mads_dashboard_ingest_to_serve_seconds", "route=\"/api/last\"");
+    _lat_stream.render(o, "mads_dashboard_ingest_to_serve_seconds", "route=\"/api/stream\"");
+
+    static const char *kClasses[5] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+    o += "# HELP mads_dashboard_http_requests_total HTTP requests by route and status class.\n"
+         "# TYPE mads_dashboard_http_requests_total counter\n";
+    for (size_t r = 0; r < kRouteCount; ++r)
+      for (size_t c = 0; c < 5; ++c) {
+        const uint64_t n = _http_requests[r][c].load(std::memory_order_relaxed);
+        if (n == 0) continue;
+        std::snprintf(line, sizeof(line), "mads_dashboard_http_requests_total{route=\"%s\",code=\"%s\"} %llu\n",
+                      kRouteNames[r], kClasses[c], (unsigned long long)n);
+        o += line;
+      }
+
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_stream_clients Connected /api/stream clients.\n"
+      "# TYPE mads_dashboard_stream_clients gauge\n"
+      "mads_dashboard_stream_clients %zu\n", _hub.clients());
+    o += line;
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_streams Open streaming connections on all routes (bounded by the stream budget).\n"
+      "# TYPE mads_dashboard_streams gauge\n"
+      "mads_dashboard_streams %d\n", _streams.load());
+    o += line;
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_stream_dropped_total Stream clients dropped for falling behind.\n"
+      "# TYPE mads_dashboard_stream_dropped_total counter\n"
+      "mads_dashboard_stream_dropped_total %zu\n", _hub.dropped());
+    o += line;
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_longpoll_waiters Requests parked in a /api/last long-poll.\n"
+      "# TYPE mads_dashboard_longpoll_waiters gauge\n"
+      "mads_dashboard_longpoll_waiters %d\n", std::max(0, _waiters.load()));
+    o += line;
+    std::snprintf(line, sizeof(line),
+      "# HELP mads_dashboard_history_dropped_total History rows lost because the publisher fell behind.\n"
+      "# TYPE mads_dashboard_history_dropped_total counter\n"
+      "mads_dashboard_history_dropped_total %llu\n", (unsigned long long)_history_q.dropped());
+    o += line;
+  }
+
+  void start_http_server() {
+    // un thread par client SSE connecté : pool dimensionné en conséquence
+    const size_t n_threads = size_t(std::max(4, _http_threads));
+    _svr.new_task_queue = [n_threads] { return new httplib::ThreadPool(n_threads); };
+    _prom_buf.reserve(16384 + _metrics.size() * 96);
+    _prom_last_t = duration<double>(system_clock::now().time_since_epoch()).count();
+
+    // compteur de requêtes par route et classe de statut (appelé après chaque réponse)
+    _svr.set_logger([this](const httplib::Request& req, const httplib::Response& res) {
+      const int cls = std::clamp(res.status / 100, 1, 5) - 1;
+      _http_requests[route_of(req.path)][cls].fetch_add(1, std::memory_order_relaxed);
+    });
+
+    // Exposition Prometheus
+    _svr.Get("/metrics", [this](const httplib::Request&, httplib::Response& res) {
+      std::lock_guard<std::mutex> lk(_prom_mx);
+      render_metrics(_prom_buf);
+      res.set_content(_prom_buf.data(), _prom_buf.size(), "text/plain; version=0.0.4; charset=utf-8");
+    });
+
+    // Page HTML (générée une fois, voir build_assets)
+    _svr.Get("/", [this](const httplib::Request& req, httplib::Response& res) {
+      serve_asset("/", req, res);
     });
 
     // API JSON
-    _svr.Get("/api/last", [this](const httplib::Request&, httplib::Response& res) {
-      json j;
-      { std::lock_guard<std::mutex> lk(_mx);
-        if (_has_last) {
-          j["ts_iso"]      = _last.ts_iso;   // maintenant en LOCAL
-          j["current_A"]   = _last.current_A;
-          j["power_W"]     = _last.power_W;
-          j["acc_x_g"]     = _last.acc_x_g;
-          j["acc_y_g"]     = _last.acc_y_g;
-          j["acc_z_g"]     = _last.acc_z_g;
-          j["sound_level"] = _last.sound_level;
-        } else {
-          j["status"] = "no_data_yet";
+    _svr.Get("/api/last", [this](const httplib::Request& req, httplib::Response& res) {
+      if (req.has_param("machine")) {
+        serve_machine(req.get_param_value("machine"), req, res);
+        return;
+      }
+      auto snap = std::atomic_load(&_snap);
+      const std::string inm = req.get_header_value("If-None-Match");
+
+      // long-poll : on attend une version plus récente que celle du client
+      if (etag_matches(inm, snap->etag) && req.has_param("wait")) {
+        int wait_s = 0;
+        try { wait_s = std::stoi(req.get_param_value("wait")); } catch (...) {}
+        wait_s = std::min(std::max(wait_s, 0), _longpoll_max_s);
+        if (wait_s > 0) {
+          if (_waiters.fetch_add(1) < _longpoll_max_waiters) {
+            const uint64_t seen = snap->version;
+            std::unique_lock<std::mutex> lk(_ver_mx);
+            _ver_cv.wait_for(lk, std::chrono::seconds(wait_s), [&]() {
+              return _stopping || std::atomic_load(&_snap)->version != seen;
+            });
+            lk.unlock();
+            snap = std::atomic_load(&_snap);
+          }
+          _waiters.fetch_sub(1);
         }
       }
-      res.set_content(j.dump(), "application/json; charset=utf-8");
+
+      res.set_header("ETag", snap->etag);
+      res.set_header("Cache-Control", "no-cache");
+      if (etag_matches(inm, snap->etag)) {
+        res.status = 304;
+        return;
+      }
+      res.set_content(snap->body, "application/json; charset=utf-8");
+      _lat_last.observe(duration<double>(system_clock::now().time_since_epoch()).count() - snap->t_ingest);
+    });
+
+    // Historique sous-échantillonné
+    _svr.Get("/api/history", [this](const httplib::Request& req, httplib::Response& res) {
+      const std::string metric = req.get_param_value("metric");
+      const size_t idx = metric_index(metric);
+      if (idx == _metrics.size()) {
+        res.status = 404;
+        res.set_content(json{{"error", "unknown metric"}, {"metric", metric}}.dump(),
+                        "application/json; charset=utf-8");
+        return;
+      }
+      const double now = duration<double>(system_clock::now().time_since_epoch()).count();
+      double since = -600.0;
+      size_t points = 300;
+      try {
+        if (req.has_param("since"))  since  = std::stod(req.get_param_value("since"));
+        if (req.has_param("points")) points = size_t(std::max(2L, std::stol(req.get_param_value("points"))));
+      } catch (...) {
+        res.status = 400;
+        res.set_content(json{{"error", "bad since/points"}}.dump(), "application/json; charset=utf-8");
+        return;
+      }
+      if (since <= 0.0) since = now + since;
+      points = std::min<size_t>(points, 5000);
+
+      HistoryStore::Series ser;
+      _history.query(idx, since, points, ser);
+      res.set_header("Cache-Control", "no-cache");
+      res.set_content(series_json(metric, ser), "application/json; charset=utf-8");
+    });
+
+    // Alertes overpower_email : lecture des index de l'historique, puis des seules lignes retenues
+    _svr.Get("/api/alerts", [this](const httplib::Request& req, httplib::Response& res) {
+      if (_alerts_history.empty()) {
+        res.status = 404;
+        res.set_content(json{{"error", "alerts_history not configured"}}.dump(), "application/json; charset=utf-8");
+        return;
+      }
+      const double now = duration<double>(system_clock::now().time_since_epoch()).count();
+      double since = -86400.0, until = now;
+      size_t limit = 500;
+      try {
+        if (req.has_param("since")) since = std::stod(req.get_param_value("since"));
+        if (req.has_param("until")) until = std::stod(req.get_param_value("until"));
+        if (req.has_param("limit")) limit = size_t(std::max(1L, std::stol(req.get_param_value("limit"))));
+      } catch (...) {
+        res.status = 400;
+        res.set_content(json{{"error", "bad since/until/limit"}}.dump(), "application/json; charset=utf-8");
+        return;
+      }
+      if (since <= 0.0) since = now + since;
+      if (until <= 0.0) until = now + until;
+      auto rows = alert_history::history_query(_alerts_history, int64_t(since * 1000), int64_t(until * 1000),
+                                               req.get_param_value("machine"), std::min<size_t>(limit, 10000));
+      res.set_header("Cache-Control", "no-cache");
+      res.set_content(json(std::move(rows)).dump(), "application/json; charset=utf-8");
+    });
+
+    // Flux SSE : le provider bloque jusqu'au prochain événement (ou heartbeat)
+    _svr.Get("/api/stream", [this](const httplib::Request&, httplib::Response& res) {
+      if (!acquire_stream()) {
+        res.status = 503;
+        res.set_content("too many stream clients", "text/plain; charset=utf-8");
+        return;
+      }
+      auto client = _hub.subscribe();
+      if (!client) {
+        release_stream();
+        res.status = 503;
+        res.set_content("too many stream clients", "text/plain; charset=utf-8");
+        return;
+      }
+      res.set_header("Cache-Control", "no-cache");
+      res.set_header("X-Accel-Buffering", "no");
+      res.set_chunked_content_provider("text/event-stream",
+        [this, client](size_t, httplib::DataSink &sink) {
+          StreamHub::Event ev;
+          if (!_hub.next(*client, std::chrono::seconds(_heartbeat_s), ev)) return false;
+          if (!ev) {
+            static const char ping[] = ": ping\n\n";
+            return sink.write(ping, sizeof(ping) - 1);
+          }
+          _lat_stream.observe(duration<double>(system_clock::now().time_since_epoch()).count() - ev->t_ingest);
+          return sink.write(ev->data.data(), ev->data.size());
+        },
+        [this, client](bool) { _hub.unsubscribe(client); release_stream(); });
+    });
+
+    // Machines connues
+    _svr.Get("/api/machines", [this](const httplib::Request&, httplib::Response& res) {
+      const double now = duration<double>(system_clock::now().time_since_epoch()).count();
+      auto list = _machines.all();
+      std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) { return a->id < b->id; });
+      json out = json::array();
+      for (const auto &m : list) {
+        const uint64_t version = m->latest.version();
+        LatestSeqlock::Values v;
+        m->latest.read(v);
+        out.push_back({{"id", m->id}, {"last_seen", v.t}, {"age_s", now - v.t},
+                       {"messages", m->messages.load(std::memory_order_relaxed)}, {"version", version}});
+      }
+      res.set_header("Cache-Control", "no-cache");
+      res.set_content(out.dump(), "application/json; charset=utf-8");
+    });
+
+    // Spectres : liste des sources
+    _svr.Get("/api/spectra", [this](const httplib::Request&, httplib::Response& res) {
+      json list = json::array();
+      std::lock_guard<std::mutex> lk(_spec_mx);
+      for (const auto &kv : _spectra) {
+        const auto &src = *kv.second;
+        auto last = std::atomic_load(&src.last);
+        uint32_t n = 0;
+        if (last) std::memcpy(&n, last->data.data() + 8, sizeof(n));
+        list.push_back({{"id", src.id}, {"kind", src.kind}, {"axis", src.axis},
+                        {"bands", n}, {"seq", src.seq.load()}, {"clients", kv.second->hub.clients()}});
+      }
+      res.set_header("Cache-Control", "no-cache");
+      res.set_content(list.dump(), "application/json; charset=utf-8");
+    });
+
+    // Dernière trame d'une source (sans le préfixe de longueur)
+    _svr.Get("/api/spectrum", [this](const httplib::Request& req, httplib::Response& res) {
+      auto src = find_spectrum(req.get_param_value("source"));
+      auto last = src ? std::atomic_load(&src->last) : nullptr;
+      if (!last) {
+        res.status = 404;
+        res.set_content("unknown spectrum source", "text/plain; charset=utf-8");
+        return;
+      }
+      res.set_header("Cache-Control", "no-cache");
+      res.set_content(last->data.data() + 4, last->data.size() - 4, "application/octet-stream");
+    });
+
+    // Flux binaire : mêmes règles que /api/stream (file bornée, heartbeat)
+    _svr.Get("/api/spectrum/stream", [this](const httplib::Request& req, httplib::Response& res) {
+      auto src = find_spectrum(req.get_param_value("source"));
+      if (!src) {
+        res.status = 404;
+        res.set_content("unknown spectrum source", "text/plain; charset=utf-8");
+        return;
+      }
+      std::shared_ptr<StreamHub::Client> client;
+      if (acquire_stream()) {
+        client = src->hub.subscribe();
+        if (!client) release_stream();
+      }
+      if (!client) {
+        res.status = 503;
+        res.set_content("too many stream clients", "text/plain; charset=utf-8");
+        return;
+      }
+      res.set_header("Cache-Control", "no-cache");
+      res.set_header("X-Accel-Buffering", "no");
+      res.set_chunked_content_provider("application/octet-stream",
+        [this, src, client](size_t, httplib::DataSink &sink) {
+          StreamHub::Event ev;
+          if (!src->hub.next(*client, std::chrono::seconds(_heartbeat_s), ev)) return false;
+          if (!ev) {
+            static const char zero[4] = {0, 0, 0, 0};
+            return sink.write(zero, sizeof(zero));
+          }
+          return sink.write(ev->data.data(), ev->data.size());
+        },
+        [this, src, client](bool) { src->hub.unsubscribe(client); release_stream(); });
+    });
+
+    // Fichiers statiques (style.css, JS, images...) : en dernier, après les routes /api
+    _svr.Get(R"(/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
+      if (!serve_asset(req.path, req, res)) {
+        res.status = 404;
+        res.set_content("not found", "text/plain; charset=utf-8");
+      }
     });
 
     // Thread HTTP
@@ -294,16 +2129,88 @@ private:
   std::string _title{"Monitoring Capteurs – Ampere"};
   int         _refresh_ms{500};
   std::string _static_dir{};
+  int         _static_max_age_s{0};
+  bool        _static_watch{true};
+  int         _http_threads{32};
+  int         _heartbeat_s{15};
 
   // http
   httplib::Server _svr;
   std::thread     _http_thread;
   std::atomic<bool> _server_started{false};
+  StreamHub       _hub;
+
+  // ressources statiques en mémoire
+  std::shared_ptr<const AssetMap> _assets;
+  std::vector<std::string> _static_dirs;   // dossiers surveillés
+  std::mutex               _dirs_mx;
+  std::thread              _watch_thread;
+  std::atomic<bool>        _watch_stop{false};
+
+  // registre et dernières valeurs (écrits seulement par load_data)
+  std::vector<MetricDef> _metrics;
+  std::vector<double>    _values;   // dernière valeur connue, par métrique
+  std::vector<double>    _row;      // valeurs de ce message (NaN = absente)
+  std::vector<double>    _row_min, _row_max, _row_mean;   // enveloppe pour l'historique
+  std::vector<uint32_t>  _row_n;
+  std::vector<std::string> _key_json;      // clés déjà échappées pour la mise en forme
+  std::vector<std::string> _prom_labels;   // metric="<key>" pour /metrics
+  LatestSeqlock          _latest;
+
+  // publication (mise en forme hors du chemin d'ingestion)
+  static constexpr int    kPublisherPollMs = 50;
+  std::thread             _pub_thread;
+  std::mutex              _pub_mx;
+  std::condition_variable _pub_cv;
+  bool                    _pub_stop{false};
+
+  // lots buffered_sp
+  std::string             _batch_key{"data"};
+  std::vector<size_t>     _chan_metrics;   // métriques avec `channel`
+  std::vector<BatchStats> _stats;          // dernières stats de lot, par métrique
+  std::vector<double>     _cols;           // colonnes du lot, contiguës
+  std::vector<uint32_t>   _col_n;
+
+  // data : dernière réponse /api/last, publiée atomiquement
+  std::shared_ptr<const LastSnapshot> _snap{initial_snapshot()};
+  const std::string       _boot_id{boot_id()};
+
+  // long-poll
+  int                     _longpoll_max_s{25};
+  int                     _longpoll_max_waiters{8};
+  std::atomic<int>        _waiters{0};
+  std::mutex              _ver_mx;
+  std::condition_variable _ver_cv;
+  bool                    _stopping{false};
+
+  // machines
+  std::vector<std::string> _machine_keys;
+  MachineMap               _machines;
+
+  // spectres
+  std::vector<std::string> _spectrum_keys;
+  size_t                   _stream_max_clients{24}, _stream_queue{16};
+  static constexpr int     kHttpReservedThreads = 4;   // hors flux et long-polls
+  int                      _stream_budget{20};         // flux simultanés, toutes routes
+  std::atomic<int>         _streams{0};
+  std::map<std::string, std::shared_ptr<SpectrumSource>> _spectra;
+  std::mutex               _spec_mx;
+
+  // /metrics
+  std::atomic<uint64_t> _msg_total{0};
+  std::atomic<uint64_t> _http_requests[kRouteCount][5]{};
+  LatencyHistogram      _lat_last, _lat_stream;
+  std::mutex            _prom_mx;       // un scrape à la fois : tampons partagés
+  std::string           _prom_buf;
+  std::unique_ptr<LatestSeqlock::Values> _prom_values{std::make_unique<LatestSeqlock::Values>()};
+  double                _prom_last_t{0.0};
+  uint64_t              _prom_last_total{0};
 
-  // data
-  LatestSample _last;
-  bool         _has_last{false};
-  std::mutex   _mx;
+  // historique
+  HistoryStore _history;          // écrit par le thread de publication seulement
+  HistoryQueue _history_q;        // load_data -> thread de publication
+  int          _sparkline_s{600};
+  std::string  _alerts_history;   // historique overpower_email pour /api/alerts
 
   json _params;
 };